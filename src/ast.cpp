@@ -1,1368 +1,1453 @@
+#include <algorithm>
+#include <cstdlib>
+
 #include "ast.hpp"
+#include "parallel.hpp"
+#include "resolve.hpp"
+
+// 所有 AST 节点所在的内存池, 每个线程一个
+thread_local AstArena ast_arena;
+
+// 每次向系统申请的内存块大小
+static const size_t AST_CHUNK_SIZE = 256 * 1024;
+
+void* AstArena::Alloc(size_t size) {
+  size = (size + 7) / 8 * 8;
+  if (size > AST_CHUNK_SIZE) {
+    // 大块内存单独申请, 放在当前块之前, 不影响当前块的剩余空间
+    char* big = static_cast<char*>(malloc(size));
+    chunks.insert(chunks.end() - (chunks.empty() ? 0 : 1), big);
+    return big;
+  }
+  if (used + size > capacity) {
+    chunks.push_back(static_cast<char*>(malloc(AST_CHUNK_SIZE)));
+    used = 0;
+    capacity = AST_CHUNK_SIZE;
+  }
+  void* ptr = chunks.back() + used;
+  used += size;
+  return ptr;
+}
+
+void AstArena::Clear() {
+  for (char* chunk : chunks)
+    free(chunk);
+  chunks.clear();
+  used = 0;
+  capacity = 0;
+}
+
+void AstArena::Reset() {
+  if (capacity == 0) {
+    Clear();
+    return;
+  }
+  // 最后一块总是普通大小的块, 保留它, 其余的释放
+  char* last = chunks.back();
+  chunks.pop_back();
+  Clear();
+  chunks.push_back(last);
+  capacity = AST_CHUNK_SIZE;
+}
+
+void AstArena::Swap(AstArena& other) {
+  std::swap(chunks, other.chunks);
+  std::swap(used, other.used);
+  std::swap(capacity, other.capacity);
+}
 
+ast_list_t AstList(BaseAST* first, const std::vector<BaseAST*>& rest) {
+  ast_list_t list;
+  list.len = rest.size() + (first != nullptr);
+  list.items = static_cast<BaseAST**>(ast_arena.Alloc(list.len * sizeof(BaseAST*)));
+  if (first != nullptr)
+    list.items[0] = first;
+  std::copy(rest.begin(), rest.end(), list.items + (first != nullptr));
+  return list;
+}
+
+// 生成 IR 的状态
+// 除全局变量, 函数声明与 result_sym 外, 其余状态都只属于当前函数, 每个函数开始时重置;
+// 它们是 thread_local 的, 并行生成 IR 时每个线程各自生成一个函数, 互不影响.
+// 全局部分由 OutputGlobals 在生成函数体之前写入, 之后只读
+
+// 正在构建的 IR
+thread_local IRBuilder* ir_builder = nullptr;
 // Koopa IR 返回值计数器
-int cnt = 0;
-// if 计数器（用于标定ir中不同if的基本块 then else end）
-int if_cnt = -1;
+thread_local int cnt = 0;
+// 当前函数中 %N 对应的值
+thread_local std::vector<koopa_raw_value_t> values;
+// 变量: 标识符编号与定义所在的块, 同名变量在不同块中是不同的变量
+typedef uint64_t var_t;
+
+var_t VarKey(symbol_t sym, int block) {
+  return (uint64_t(sym) << 32) | uint32_t(block);
+}
+
+// 变量在 IR 中的名字, 即 @ident_<block>; 以 % 开头的内部变量为 %name_<block>
+std::string VarName(var_t var) {
+  const char* name = interner.Name(var >> 32);
+  return (name[0] == '%' ? "" : "@") + std::string(name) + "_" + std::to_string(uint32_t(var));
+}
+
+// 全局变量, 在整个编译过程中有效, 生成函数体时只读
+std::unordered_map<var_t, koopa_raw_value_t> global_variables;
+// 当前函数中局部变量的 alloc, 函数结束时清空
+thread_local std::unordered_map<var_t, koopa_raw_value_t> variables;
+// 函数名对应的函数, 生成函数体时只读
+std::unordered_map<symbol_t, koopa_raw_function_t> callees;
+// if 计数器（用于标定ir中不同if的基本块 then else end）, 每个函数从名字解析得到的编号开始
+thread_local int if_cnt = -1;
 // 记录 while 当前层数序号
-int while_level = -1;
-// while 计数器（标定不同while的基本块）
-int while_cnt = -1;
+thread_local int while_level = -1;
+// while 计数器（标定不同while的基本块）, 每个函数从名字解析得到的编号开始
+thread_local int while_cnt = -1;
 // 当前块
-int cur_block = 0;
+thread_local int cur_block = 0;
 // 用于全局变量生成不同 ir
-bool is_global_area = false;
+thread_local bool is_global_area = false;
 // 父子块关系记录
-std::unordered_map<int, int> parent;
-// 记录当前块是否终止
-std::vector<bool> is_block_end;
+thread_local std::unordered_map<int, int> parent;
+// 记录当前函数中各块是否终止
+thread_local std::unordered_map<int, bool> is_block_end;
 // 记录 while_level 与 while_cnt 对应关系
-std::unordered_map<int, int> level_to_cnt;
+thread_local std::unordered_map<int, int> level_to_cnt;
+
+// 块计数器, 为每个块的 is_block_end 与 parent 编号
+// 函数开始时取名字解析得到的函数块编号, 与全程连续编号的结果相同
+thread_local int block_cnt = 0;
+// 逻辑运算结果的内部变量 %result, 在 OutputBegin 中驻留, 生成 IR 时不再调用 Intern
+symbol_t result_sym = 0;
+
+// 变量对应的全局变量或 alloc, 块编号为 0 的是全局变量
+koopa_raw_value_t& Variable(var_t var) {
+  if (uint32_t(var) != 0)
+    return variables[var];
+  // 函数中只读取全局变量, 不能插入, 并行生成 IR 时其他线程也在读取
+  return is_global_area ? global_variables[var] : global_variables.at(var);
+}
+
+// 记录指令的结果, 之后可通过 %cnt 引用
+koopa_raw_value_t Def(koopa_raw_value_t value) {
+  values.push_back(value);
+  cnt++;
+  return value;
+}
+
+// Output 结果对应的值, 结果不是常量时为 %index
+koopa_raw_value_t Val(std::pair<bool, int> result, int index) {
+  return result.first ? ir_builder->Integer(result.second) : values[index];
+}
 
-typedef enum {
-  CONSTANT,
-  VARIABLE,
-  FUNCTION,
-  UNDEFINED,
-} value_type;
+// ---------------------------------------------------------------------------
+// 即时构造 SSA (Braun et al., "Simple and Efficient Construction of SSA Form")
+//
+// ssa_mode 下局部变量不再生成 alloc/load/store, 而是记录每个变量在每个基本块
+// 中的当前定义, 读取时沿前驱查找, 汇合处生成基本块参数 (phi).
+// 基本块在其所有前驱都已生成后封闭 (seal), 未封闭时读取变量先生成不完整的参数,
+// 封闭时再补齐实参. 基本块参数列表与跳转实参在函数结束时写入.
+// ---------------------------------------------------------------------------
 
-typedef enum {
-  INT,
-  VOID,
-  UND,
-} func_type;
+bool ssa_mode = false;
 
+// 基本块参数 (phi)
 typedef struct {
-  value_type type;
-  union Value {
-    func_type type;
-    int val;
-  } value;
-} stored_object;
-
-std::vector<std::unordered_map<std::string, std::unique_ptr<stored_object>>*> symbol_tables;
-
-void insertSymbol(const std::string& key, value_type type, int value, func_type func_type) {
-  switch (type) {
-    case CONSTANT: {
-      stored_object* object_to_store = new stored_object();
-      object_to_store->type = CONSTANT;
-      object_to_store->value.val = value;
-      (*symbol_tables[cur_block])[key] = std::unique_ptr<stored_object>(object_to_store);
-      break;
-    }
-    case VARIABLE: {
-      stored_object* object_to_store = new stored_object();
-      object_to_store->type = VARIABLE;
-      object_to_store->value.val = value;
-      (*symbol_tables[cur_block])[key] = std::unique_ptr<stored_object>(object_to_store);
-      break;
-    }
-    case FUNCTION: {
-      stored_object* object_to_store = new stored_object();
-      object_to_store->type = FUNCTION;
-      object_to_store->value.type = func_type;
-      (*symbol_tables[cur_block])[key] = std::unique_ptr<stored_object>(object_to_store);
-      break;
-    }
-    default:
-      break;
+  koopa_raw_value_data_t* param;
+  int block;
+  var_t var;
+  // 与所在基本块的入边一一对应
+  std::vector<koopa_raw_value_t> operands;
+  // 以该参数为实参的其他参数
+  std::vector<int> users;
+  bool removed;
+} ssa_phi_t;
+
+typedef struct {
+  koopa_raw_basic_block_t bb;
+  // 入边编号
+  std::vector<int> preds;
+  std::vector<int> phis;
+  // 封闭前读取变量生成的参数
+  std::unordered_map<var_t, int> incomplete;
+  bool sealed;
+} ssa_block_t;
+
+typedef struct {
+  int from;
+  int to;
+  // 该边是目标基本块的第几条入边
+  int index;
+  // 边对应的跳转指令, 以及是否为 branch 的 false 分支
+  koopa_raw_value_data_t* inst;
+  bool false_edge;
+} ssa_edge_t;
+
+thread_local std::vector<ssa_block_t> ssa_blocks;
+thread_local std::unordered_map<koopa_raw_basic_block_t, int> ssa_block_id;
+thread_local std::vector<ssa_edge_t> ssa_edges;
+thread_local std::vector<ssa_phi_t> ssa_phis;
+thread_local std::unordered_map<koopa_raw_value_t, int> ssa_phi_of;
+// 变量 -> 基本块 -> 当前定义
+thread_local std::unordered_map<var_t, std::unordered_map<int, koopa_raw_value_t>> current_def;
+// 被删除的平凡参数到其替代值的映射
+thread_local std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> ssa_replace;
+// 当前基本块
+thread_local int ssa_cur = 0;
+
+void SSAReset() {
+  ssa_blocks.clear();
+  ssa_block_id.clear();
+  ssa_edges.clear();
+  ssa_phis.clear();
+  ssa_phi_of.clear();
+  current_def.clear();
+  ssa_replace.clear();
+  ssa_cur = 0;
+}
+
+int SSABlock(koopa_raw_basic_block_t bb) {
+  auto it = ssa_block_id.find(bb);
+  if (it != ssa_block_id.end())
+    return it->second;
+  ssa_blocks.push_back(ssa_block_t{bb, {}, {}, {}, false});
+  ssa_block_id[bb] = ssa_blocks.size() - 1;
+  return ssa_blocks.size() - 1;
+}
+
+koopa_raw_value_t SSAResolve(koopa_raw_value_t value) {
+  auto it = ssa_replace.find(value);
+  while (it != ssa_replace.end()) {
+    value = it->second;
+    it = ssa_replace.find(value);
   }
+  return value;
+}
+
+void SSAWrite(var_t var, int block, koopa_raw_value_t value) {
+  current_def[var][block] = value;
+}
+
+koopa_raw_value_t SSARead(var_t var, int block);
+
+int SSANewPhi(var_t var, int block) {
+  // 参数以变量名加序号命名, 如 %x_3_0
+  std::string name = VarName(var);
+  name[0] = '%';
+  name += "_" + std::to_string(ssa_phis.size());
+  ssa_phis.push_back(ssa_phi_t{ir_builder->NewBlockParam(name), block, var, {}, {}, false});
+  ssa_phi_of[ssa_phis.back().param] = ssa_phis.size() - 1;
+  ssa_blocks[block].phis.push_back(ssa_phis.size() - 1);
+  return ssa_phis.size() - 1;
 }
 
-// Value type, Constant value, Varible level, Func type
-std::tuple<value_type, int, int, func_type> fetchSymbol(const std::string& key) {
-  int cur = cur_block;
-  while (cur >= 0) {
-    if ((*symbol_tables[cur]).find(key) == (*symbol_tables[cur]).end()) {
-      cur = parent[cur];
-      // cur--;
+// 实参都相同 (除自身外) 的参数是平凡的, 用该实参代替, 并递归检查使用它的参数
+koopa_raw_value_t SSATryRemoveTrivialPhi(int phi) {
+  koopa_raw_value_t self = ssa_phis[phi].param;
+  koopa_raw_value_t same = nullptr;
+  for (auto operand : ssa_phis[phi].operands) {
+    auto op = SSAResolve(operand);
+    if (op == self || op == same)
       continue;
-    } else {
-      if ((*symbol_tables[cur])[key]->type == CONSTANT || (*symbol_tables[cur])[key]->type == VARIABLE) {
-        return std::make_tuple((*symbol_tables[cur])[key]->type, (*symbol_tables[cur])[key]->value.val, cur, UND);
-      } else if ((*symbol_tables[cur])[key]->type == FUNCTION) {
-        return std::make_tuple((*symbol_tables[cur])[key]->type, 0, cur, (*symbol_tables[cur])[key]->value.type);
-      } else
-        assert(false);
-    }
+    if (same != nullptr)
+      return self;
+    same = op;
   }
-  // Mark here
-  str += "\tUNDEFINED\n";
-  return std::make_tuple(UNDEFINED, -1, -1, UND);
-}
-
-int search(const ConstExpAST* constExp);
-int search(const ExpAST* exp);
-int search(const LOrExpAST* lOrExp);
-int search(const LOrExpWithOpAST* lOrExp);
-int search(const LAndExpAST* lAndExp);
-int search(const LAndExpWithOpAST* lAndExp);
-int search(const EqExpAST* eqExp);
-int search(const EqExpWithOpAST* eqExp);
-int search(const RelExpAST* relExp);
-int search(const RelExpWithOpAST* relExp);
-int search(const AddExpAST* addExp);
-int search(const AddExpWithOpAST* addExp);
-int search(const MulExpAST* mulExp);
-int search(const MulExpWithOpAST* mulExp);
-int search(const UnaryExpAST* unaryExp);
-int search(const UnaryExpWithOpAST* unaryExp);
-int search(const PrimaryExpWithBrAST* primaryExp);
-int search(const PrimaryExpWithLValAST* primaryExp);
-int search(const PrimaryExpWithNumAST* primaryExp);
-int search(const LValAST* lVal);
-
-void CompUnitAST::Dump() const {
-  std::cout << "CompUnitAST { ";
-  sub->Dump();
-  std::cout << "} ";
+  // 没有实参 (不可达或未初始化) 时取 0
+  if (same == nullptr)
+    same = ir_builder->Integer(0);
+  ssa_phis[phi].removed = true;
+  ssa_replace[self] = same;
+  for (int user : ssa_phis[phi].users)
+    if (user != phi && !ssa_phis[user].removed)
+      SSATryRemoveTrivialPhi(user);
+  return SSAResolve(same);
+}
+
+koopa_raw_value_t SSAAddPhiOperands(int phi) {
+  // 读取前驱时可能新建参数, 不能持有 ssa_phis 中元素的引用
+  int block = ssa_phis[phi].block;
+  var_t var = ssa_phis[phi].var;
+  for (int edge : ssa_blocks[block].preds) {
+    auto op = SSAResolve(SSARead(var, ssa_edges[edge].from));
+    ssa_phis[phi].operands.push_back(op);
+    auto it = ssa_phi_of.find(op);
+    if (it != ssa_phi_of.end())
+      ssa_phis[it->second].users.push_back(phi);
+  }
+  return SSATryRemoveTrivialPhi(phi);
+}
+
+koopa_raw_value_t SSAReadRecursive(var_t var, int block) {
+  koopa_raw_value_t value;
+  auto& bb = ssa_blocks[block];
+  if (!bb.sealed) {
+    int phi = SSANewPhi(var, block);
+    bb.incomplete[var] = phi;
+    value = ssa_phis[phi].param;
+  } else if (bb.preds.size() == 1) {
+    value = SSARead(var, ssa_edges[bb.preds[0]].from);
+  } else {
+    // 先写入参数本身以打断环路
+    int phi = SSANewPhi(var, block);
+    SSAWrite(var, block, ssa_phis[phi].param);
+    value = SSAAddPhiOperands(phi);
+  }
+  SSAWrite(var, block, value);
+  return value;
 }
 
-std::pair<bool, int> CompUnitAST::Output() const {
-  std::unordered_map<std::string, std::unique_ptr<stored_object>> table;
-  symbol_tables.push_back(&table);
-  parent[0] = -1;
+koopa_raw_value_t SSARead(var_t var, int block) {
+  auto& defs = current_def[var];
+  auto it = defs.find(block);
+  if (it != defs.end())
+    return SSAResolve(it->second);
+  return SSAReadRecursive(var, block);
+}
 
-  str += "decl @getint(): i32\n";
-  str += "decl @getch(): i32\n";
-  str += "decl @getarray(*i32): i32\n";
-  str += "decl @putint(i32)\n";
-  str += "decl @putch(i32)\n";
-  str += "decl @putarray(i32, *i32)\n";
-  str += "decl @starttime()\n";
-  str += "decl @stoptime()\n\n";
-
-  insertSymbol("getint", FUNCTION, 0, INT);
-  insertSymbol("getch", FUNCTION, 0, INT);
-  insertSymbol("getarray", FUNCTION, 0, INT);
-  insertSymbol("putint", FUNCTION, 0, VOID);
-  insertSymbol("putch", FUNCTION, 0, VOID);
-  insertSymbol("putarray", FUNCTION, 0, VOID);
-  insertSymbol("starttime", FUNCTION, 0, VOID);
-  insertSymbol("stoptime", FUNCTION, 0, VOID);
-
-  sub->Output();
+void SSASeal(int block) {
+  // 补齐实参时可能再次向 incomplete 插入, 先取出
+  auto incomplete = std::move(ssa_blocks[block].incomplete);
+  ssa_blocks[block].incomplete.clear();
+  for (auto& [var, phi] : incomplete)
+    SSAAddPhiOperands(phi);
+  ssa_blocks[block].sealed = true;
+}
+
+// 读取变量, 常量直接返回, 否则作为 %cnt 记录, 使调用方仍可用 cnt - 1 引用
+std::pair<bool, int> SSAUse(var_t var) {
+  auto value = SSARead(var, ssa_cur);
+  if (value->kind.tag == KOOPA_RVT_INTEGER)
+    return std::pair<bool, int>(true, value->kind.data.integer.value);
+  Def(value);
   return std::pair<bool, int>(false, 0);
 }
 
-void CompUnitSubWithDeclAST::Dump() const {
-  std::cout << "CompUnitSubWithDeclAST { ";
-  if (compUnit)
-    (*compUnit)->Dump();
-  decl->Dump();
+// 将 Output 的结果写入变量
+void SSADef(var_t var, std::pair<bool, int> result) {
+  SSAWrite(var, ssa_cur, Val(result, cnt - 1));
+}
+
+void SSAEdge(koopa_raw_value_data_t* inst, koopa_raw_basic_block_t target, bool false_edge) {
+  int to = SSABlock(target);
+  ssa_edges.push_back(ssa_edge_t{ssa_cur, to, (int)ssa_blocks[to].preds.size(), inst, false_edge});
+  ssa_blocks[to].preds.push_back(ssa_edges.size() - 1);
+}
+
+// 函数结束时写入基本块参数与跳转实参, 并替换被删除参数的所有使用
+void SSAFinish() {
+  auto& arena = ir_builder->BodyArena();
+  for (auto& block : ssa_blocks) {
+    auto& params = ir_builder->BlockParams(block.bb);
+    for (int phi : block.phis)
+      if (!ssa_phis[phi].removed)
+        params.push_back(ssa_phis[phi].param);
+  }
+  for (auto& edge : ssa_edges) {
+    std::vector<const void*> args;
+    for (int phi : ssa_blocks[edge.to].phis)
+      if (!ssa_phis[phi].removed)
+        args.push_back(SSAResolve(ssa_phis[phi].operands[edge.index]));
+    if (args.empty())
+      continue;
+    auto& kind = edge.inst->kind;
+    if (kind.tag == KOOPA_RVT_JUMP)
+      kind.data.jump.args = arena.Slice(args, KOOPA_RSIK_VALUE);
+    else if (edge.false_edge)
+      kind.data.branch.false_args = arena.Slice(args, KOOPA_RSIK_VALUE);
+    else
+      kind.data.branch.true_args = arena.Slice(args, KOOPA_RSIK_VALUE);
+  }
+  ir_builder->ReplaceUses(ssa_replace);
+}
+
+// 开始新的基本块; 除 while 的入口外, 基本块开始时其所有前驱均已生成
+void EmitLabel(const std::string& label, bool seal = true) {
+  auto bb = ir_builder->Block(label);
+  ir_builder->SetBlock(bb);
+  if (ssa_mode) {
+    ssa_cur = SSABlock(bb);
+    if (seal)
+      SSASeal(ssa_cur);
+  }
+}
+
+void EmitJump(const std::string& label) {
+  auto target = ir_builder->Block(label);
+  auto inst = ir_builder->Jump(target);
+  if (ssa_mode)
+    SSAEdge(inst, target, false);
+}
+
+void EmitBranch(koopa_raw_value_t cond, const std::string& true_label, const std::string& false_label) {
+  auto true_bb = ir_builder->Block(true_label);
+  auto false_bb = ir_builder->Block(false_label);
+  auto inst = ir_builder->Branch(cond, true_bb, false_bb);
+  if (ssa_mode) {
+    SSAEdge(inst, true_bb, false);
+    SSAEdge(inst, false_bb, true);
+  }
+}
+
+// 遍历的入口, 在显式栈上反复执行各节点的步进函数
+void BaseAST::Dump() const {
+  AstStack stack(this);
+  stack.Run([&](BaseAST* node) { return node->DumpStep(stack); });
+}
+
+std::pair<bool, int> BaseAST::Output() const {
+  AstStack stack(this);
+  stack.Run([&](BaseAST* node) { return node->OutputStep(stack); });
+  return stack.result;
+}
+
+bool CompUnitAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "CompUnitAST { ";
+    return stack.Call(1, sub);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> CompUnitSubWithDeclAST::Output() const {
-  if (compUnit)
-    (*compUnit)->Output();
+// 函数的参数类型, 参数都是 int
+static std::vector<koopa_raw_type_t> ParamTypes(const FuncDefAST* func, RawArena& arena) {
+  size_t n = func->params ? ((FuncFParamsAST*)func->params)->paramList.size() : 0;
+  return std::vector<koopa_raw_type_t>(n, arena.Int32());
+}
 
-  auto decl_p = decl.get();
-  if (typeid(*decl_p) == typeid(DeclWithVarAST)) {
-    // 全局区域
+void OutputBegin() {
+  block_cnt = 1;
+  parent[0] = -1;
+  result_sym = interner.Intern("%result");
+
+  auto& arena = ir_builder->Arena();
+  auto i32 = arena.Int32();
+  auto unit = arena.Unit();
+  auto i32_ptr = arena.Pointer(i32);
+  callees[interner.Intern("getint")] = ir_builder->Declare("@getint", {}, i32);
+  callees[interner.Intern("getch")] = ir_builder->Declare("@getch", {}, i32);
+  callees[interner.Intern("getarray")] = ir_builder->Declare("@getarray", {i32_ptr}, i32);
+  callees[interner.Intern("putint")] = ir_builder->Declare("@putint", {i32}, unit);
+  callees[interner.Intern("putch")] = ir_builder->Declare("@putch", {i32}, unit);
+  callees[interner.Intern("putarray")] = ir_builder->Declare("@putarray", {i32, i32_ptr}, unit);
+  callees[interner.Intern("starttime")] = ir_builder->Declare("@starttime", {}, unit);
+  callees[interner.Intern("stoptime")] = ir_builder->Declare("@stoptime", {}, unit);
+}
+
+void OutputUnit(const BaseAST* item) {
+  // 全局区域
+  if (item->kind == ast_kind_t::DECL_WITH_VAR)
     is_global_area = true;
-    decl->Output();
-    is_global_area = false;
-  } else {
-    decl->Output();
+  item->Output();
+  is_global_area = false;
+}
+
+// 并行生成 IR 的第一遍: 按源程序顺序生成全局变量并声明所有函数, 函数定义按顺序放入 funcs
+// 之后 global_variables 与 callees 不再修改, 函数体只需读取它们
+static void OutputGlobals(const BaseAST* comp_unit, std::vector<const BaseAST*>& funcs) {
+  OutputBegin();
+
+  // CompUnitSub 左递归, 最外层是最后一个单元, 先逆序收集
+  std::vector<const BaseAST*> items;
+  for (auto sub = ((const CompUnitAST*)comp_unit)->sub; sub;) {
+    if (sub->kind == ast_kind_t::COMP_UNIT_SUB_WITH_FUNC) {
+      items.push_back(((const CompUnitSubWithFuncAST*)sub)->func_def);
+      sub = ((const CompUnitSubWithFuncAST*)sub)->compUnit;
+    } else {
+      items.push_back(((const CompUnitSubWithDeclAST*)sub)->decl);
+      sub = ((const CompUnitSubWithDeclAST*)sub)->compUnit;
+    }
   }
 
-  return std::pair<bool, int>(false, 0);
+  auto& arena = ir_builder->Arena();
+  for (auto it = items.rbegin(); it != items.rend(); it++) {
+    if ((*it)->kind != ast_kind_t::FUNC_DEF) {
+      OutputUnit(*it);
+      continue;
+    }
+    auto func = (const FuncDefAST*)*it;
+    auto ret = func->symbol->value.type == INT ? arena.Int32() : arena.Unit();
+    callees[func->ident] = ir_builder->Declare("@" + std::string(interner.Name(func->ident)), ParamTypes(func, arena), ret);
+    funcs.push_back(func);
+  }
 }
 
-void CompUnitSubWithFuncAST::Dump() const {
-  std::cout << "CompUnitSubWithFuncAST { ";
-  if (compUnit)
-    (*compUnit)->Dump();
-  func_def->Dump();
-  std::cout << "} ";
+void OutputParallel(const BaseAST* comp_unit, std::vector<RawArena>& arenas) {
+  std::vector<const BaseAST*> funcs;
+  OutputGlobals(comp_unit, funcs);
+
+  // 调用线程也参与生成, 结束后恢复它的 ir_builder
+  IRBuilder* builder = ir_builder;
+  ParallelFor(funcs.size(), arenas.size(), [&](size_t i, int worker) {
+    IRBuilder body(arenas[worker]);
+    ir_builder = &body;
+    funcs[i]->Output();
+  });
+  ir_builder = builder;
 }
 
-std::pair<bool, int> CompUnitSubWithFuncAST::Output() const {
-  if (compUnit)
-    (*compUnit)->Output();
-  func_def->Output();
-  return std::pair<bool, int>(false, 0);
+bool CompUnitAST::OutputStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    OutputBegin();
+    return stack.Call(1, sub);
+  }
+  return stack.Return(std::pair<bool, int>(false, 0));
+}
+
+bool CompUnitSubWithDeclAST::DumpStep(AstStack& stack) const {
+  switch (stack.Top().state) {
+    case 0:
+      std::cout << "CompUnitSubWithDeclAST { ";
+      if (compUnit)
+        return stack.Call(1, compUnit);
+      [[fallthrough]];
+    case 1:
+      return stack.Call(2, decl);
+    default:
+      std::cout << "} ";
+      return true;
+  }
 }
 
-void DeclWithConstAST::Dump() const {
-  std::cout << "DeclWithConstAST { ";
-  constDecl->Dump();
-  std::cout << "} ";
+bool CompUnitSubWithDeclAST::OutputStep(AstStack& stack) const {
+  switch (stack.Top().state) {
+    case 0:
+      if (compUnit)
+        return stack.Call(1, compUnit);
+      [[fallthrough]];
+    case 1:
+      // 全局区域
+      if (decl->kind == ast_kind_t::DECL_WITH_VAR)
+        is_global_area = true;
+      return stack.Call(2, decl);
+    default:
+      is_global_area = false;
+      return stack.Return(std::pair<bool, int>(false, 0));
+  }
 }
 
-std::pair<bool, int> DeclWithConstAST::Output() const {
-  constDecl->Output();
-  return std::make_pair(false, 0);
+bool CompUnitSubWithFuncAST::DumpStep(AstStack& stack) const {
+  switch (stack.Top().state) {
+    case 0:
+      std::cout << "CompUnitSubWithFuncAST { ";
+      if (compUnit)
+        return stack.Call(1, compUnit);
+      [[fallthrough]];
+    case 1:
+      return stack.Call(2, func_def);
+    default:
+      std::cout << "} ";
+      return true;
+  }
 }
 
-void DeclWithVarAST::Dump() const {
-  std::cout << "DeclWithVarAST { ";
-  varDecl->Dump();
+bool CompUnitSubWithFuncAST::OutputStep(AstStack& stack) const {
+  switch (stack.Top().state) {
+    case 0:
+      if (compUnit)
+        return stack.Call(1, compUnit);
+      [[fallthrough]];
+    case 1:
+      return stack.Call(2, func_def);
+    default:
+      return stack.Return(std::pair<bool, int>(false, 0));
+  }
+}
+
+bool DeclWithConstAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "DeclWithConstAST { ";
+    return stack.Call(1, constDecl);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> DeclWithVarAST::Output() const {
-  varDecl->Output();
-  return std::make_pair(false, 0);
+bool DeclWithConstAST::OutputStep(AstStack& stack) const {
+  return stack.Tail(constDecl);
 }
 
-void ConstDeclAST::Dump() const {
-  std::cout << "ConstDeclAST { ";
-  std::cout << "BTypeAST { " << bType << " } ";
-  for (auto& constDef : constDefList) {
-    constDef->Dump();
+bool DeclWithVarAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "DeclWithVarAST { ";
+    return stack.Call(1, varDecl);
   }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> ConstDeclAST::Output() const {
-  for (auto& constDef : constDefList) {
-    constDef->Output();
-  }
-  return std::pair<bool, int>(false, 0);
+bool DeclWithVarAST::OutputStep(AstStack& stack) const {
+  return stack.Tail(varDecl);
 }
 
-void ConstDefAST::Dump() const {
-  std::cout << "ConstDefAST { ";
-  std::cout << "Ident { " << ident << " } ";
-  constInitVal->Dump();
+bool ConstDeclAST::DumpStep(AstStack& stack) const {
+  auto& frame = stack.Top();
+  if (frame.state == 0) {
+    std::cout << "ConstDeclAST { ";
+    std::cout << "BTypeAST { " << bType << " } ";
+  }
+  if (frame.index < constDefList.size())
+    return stack.Call(1, constDefList[frame.index++]);
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> ConstDefAST::Output() const {
-  std::pair<bool, int> result = constInitVal->Output();
-  insertSymbol(ident, CONSTANT, result.second, UND);
-  return std::pair<bool, int>(false, 0);
+bool ConstDeclAST::OutputStep(AstStack& stack) const {
+  // 常量的值已在名字解析时求出, ConstDef 不生成 IR
+  return stack.Return(std::pair<bool, int>(false, 0));
 }
 
-void ConstInitValAST::Dump() const {
-  std::cout << "ConstInitValAST { ";
-  constExp->Dump();
+bool ConstDefAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "ConstDefAST { ";
+    std::cout << "Ident { " << interner.Name(ident) << " } ";
+    return stack.Call(1, constInitVal);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> ConstInitValAST::Output() const {
-  int ret = search((ConstExpAST*)constExp.get());
-  return std::pair<bool, int>(true, ret);
+bool ConstDefAST::OutputStep(AstStack& stack) const {
+  // 常量的值已在名字解析时求出
+  return stack.Return(std::pair<bool, int>(false, 0));
 }
 
-void VarDeclAST::Dump() const {
-  std::cout << "VarDeclAST { ";
-  std::cout << "BTypeAST { " << bType << " } ";
-  for (auto& varDef : varDefList) {
-    varDef->Dump();
+bool ConstInitValAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "ConstInitValAST { ";
+    return stack.Call(1, constExp);
   }
   std::cout << "} ";
+  return true;
+}
+
+bool ConstInitValAST::OutputStep(AstStack& stack) const {
+  int ret = search(constExp);
+  return stack.Return(std::pair<bool, int>(true, ret));
 }
 
-std::pair<bool, int> VarDeclAST::Output() const {
-  for (auto& varDef : varDefList) {
-    varDef->Output();
+bool VarDeclAST::DumpStep(AstStack& stack) const {
+  auto& frame = stack.Top();
+  if (frame.state == 0) {
+    std::cout << "VarDeclAST { ";
+    std::cout << "BTypeAST { " << bType << " } ";
   }
-  return std::pair<bool, int>(false, 0);
+  if (frame.index < varDefList.size())
+    return stack.Call(1, varDefList[frame.index++]);
+  std::cout << "} ";
+  return true;
 }
 
-void VarDefAST::Dump() const {
+bool VarDeclAST::OutputStep(AstStack& stack) const {
+  auto& frame = stack.Top();
+  if (frame.index < varDefList.size())
+    return stack.Call(1, varDefList[frame.index++]);
+  return stack.Return(std::pair<bool, int>(false, 0));
+}
+
+bool VarDefAST::DumpStep(AstStack& stack) const {
   std::cout << "VarDefAST { ";
-  std::cout << "Ident { " << ident << " } ";
+  std::cout << "Ident { " << interner.Name(ident) << " } ";
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> VarDefAST::Output() const {
-  if (is_global_area) {
-    str += "global @";
-    str += ident;
-    str += "_";
-    str += std::to_string(cur_block);
-    str += " = alloc i32, zeroinit\n\n";
-  } else {
-    str += "\t@";
-    str += ident;
-    str += "_";
-    str += std::to_string(cur_block);
-    str += " = alloc i32\n";
-  }
-
-  insertSymbol(ident, VARIABLE, 0, UND);
-  return std::pair<bool, int>(false, 0);
+bool VarDefAST::OutputStep(AstStack& stack) const {
+  var_t var = VarKey(ident, symbol->block);
+  if (is_global_area)
+    Variable(var) = ir_builder->GlobalAlloc(VarName(var), nullptr);
+  else if (!ssa_mode)
+    Variable(var) = ir_builder->Alloc(VarName(var));
+  return stack.Return(std::pair<bool, int>(false, 0));
 }
 
-void VarDefWithAssignAST::Dump() const {
-  std::cout << "VarDefWithAssignAST { ";
-  std::cout << "Ident { " << ident << "} ";
-  initVal->Dump();
+bool VarDefWithAssignAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "VarDefWithAssignAST { ";
+    std::cout << "Ident { " << interner.Name(ident) << "} ";
+    return stack.Call(1, initVal);
+  }
   std::cout << " } ";
+  return true;
 }
 
-std::pair<bool, int> VarDefWithAssignAST::Output() const {
-  std::pair<bool, int> result = initVal->Output();
-  if (is_global_area)
-    str += "global @";
-  else
-    str += "\t@";
-  str += ident;
-  str += "_";
-  str += std::to_string(cur_block);
-  str += " = alloc i32\n";
+bool VarDefWithAssignAST::OutputStep(AstStack& stack) const {
+  if (stack.Top().state == 0)
+    return stack.Call(1, initVal);
+
+  std::pair<bool, int> result = stack.result;
+  var_t var = VarKey(ident, symbol->block);
 
   if (is_global_area) {
-    str.pop_back();
-    if (result.first) {
-      str += ", ";
-      str += std::to_string(result.second);
-      str += "\n\n";
-    } else {
+    if (result.first)
+      Variable(var) = ir_builder->GlobalAlloc(VarName(var), ir_builder->Integer(result.second));
+    else
       assert(false);
-    }
+  } else if (ssa_mode) {
+    SSADef(var, result);
   } else {
-    if (result.first) {
-      str += "\tstore ";
-      str += std::to_string(result.second);
-      str += ", @";
-      str += ident;
-      str += "_";
-      str += std::to_string(cur_block);
-      str += "\n";
-    } else {
-      str += "\tstore %";
-      str += std::to_string(cnt - 1);
-      str += ", @";
-      str += ident;
-      str += "_";
-      str += std::to_string(cur_block);
-      str += "\n";
-    }
+    auto alloc = ir_builder->Alloc(VarName(var));
+    Variable(var) = alloc;
+    ir_builder->Store(Val(result, cnt - 1), alloc);
   }
-
-  insertSymbol(ident, VARIABLE, 0, UND);
-  return std::pair<bool, int>(false, 0);
+  return stack.Return(std::pair<bool, int>(false, 0));
 }
 
-void InitValAST::Dump() const {
-  std::cout << "InitValAST { ";
-  exp->Dump();
+bool InitValAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "InitValAST { ";
+    return stack.Call(1, exp);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> InitValAST::Output() const {
-  return exp->Output();
+bool InitValAST::OutputStep(AstStack& stack) const {
+  return stack.Tail(exp);
 }
 
-void FuncDefAST::Dump() const {
-  std::cout << "FuncDefAST { ";
-  std::cout << "FuncTypeAST { " << funcType << " } ";
-  std::cout << "Ident { " << ident << " } ";
-  if (params)
-    (*params)->Dump();
-  block->Dump();
-  std::cout << "} ";
+bool FuncDefAST::DumpStep(AstStack& stack) const {
+  switch (stack.Top().state) {
+    case 0:
+      std::cout << "FuncDefAST { ";
+      std::cout << "FuncTypeAST { " << funcType << " } ";
+      std::cout << "Ident { " << interner.Name(ident) << " } ";
+      if (params)
+        return stack.Call(1, params);
+      [[fallthrough]];
+    case 1:
+      return stack.Call(2, block);
+    default:
+      std::cout << "} ";
+      return true;
+  }
 }
 
-std::pair<bool, int> FuncDefAST::Output() const {
-  // 向当前符号表中插入该函数定义
-  func_type ty = UND;
-  if (funcType == "int")
-    ty = INT;
-  else if (funcType == "void")
-    ty = VOID;
-  insertSymbol(ident, FUNCTION, 0, ty);
+bool FuncDefAST::OutputStep(AstStack& stack) const {
+  func_type ty = symbol->value.type;
 
-  // 清空计数器
-  cnt = 0;
+  switch (stack.Top().state) {
+    case 0: {
+      // 清空计数器
+      cnt = 0;
+      values.clear();
+      if_cnt = firstIf - 1;
+      while_cnt = firstWhile - 1;
 
-  // 为整个函数添加符号表，便于参数定义
-  std::unordered_map<std::string, std::unique_ptr<stored_object>> table;
+      // 参数位于函数自身的块中
+      int parent_block = cur_block;
+      cur_block = blockId;
+      block_cnt = blockId + 1;
+      parent[cur_block] = parent_block;
 
-  int parent_block = cur_block;
-  cur_block = symbol_tables.size();
-  parent[cur_block] = parent_block;
-  symbol_tables.push_back(&table);
+      is_block_end[cur_block] = false;
 
-  is_block_end.push_back(false);
-
-  str += "fun ";
-  str += "@";
-  str += ident;
-  str += "(";
-  if (params)
-    (*params)->Output();
-  str += ")";
-  if (funcType == "int")
-    str += ": i32";
-  str += " {\n";
-  str += "\%entry:\n";
-
-  // 函数参数及 Block 输出
-  if (params)
-    ((FuncFParamsAST*)(*params).get())->declare();
-  block->Output();
-
-  // 无返回值补 ret
-  if (funcType == "void" && !is_block_end[cur_block])
-    str += "\tret\n";
-
-  str += "}\n\n";
-
-  cur_block = parent[cur_block];
-  return std::pair<bool, int>(false, 0);
+      // 已由 OutputGlobals 声明时直接生成其函数体
+      auto it = callees.find(ident);
+      if (it != callees.end()) {
+        ir_builder->BeginFunction(it->second);
+      } else {
+        auto& arena = ir_builder->Arena();
+        callees[ident] = ir_builder->BeginFunction("@" + std::string(interner.Name(ident)), ParamTypes(this, arena), ty == INT ? arena.Int32() : arena.Unit());
+      }
+      if (params)
+        return stack.Call(1, params);
+      [[fallthrough]];
+    }
+    case 1:
+      if (ssa_mode)
+        SSAReset();
+      EmitLabel("%entry");
+
+      // 函数参数及 Block 输出
+      if (params)
+        ((FuncFParamsAST*)params)->declare();
+      return stack.Call(2, block);
+    default:
+      // 末尾没有 return 时补 ret
+      if (!is_block_end[cur_block])
+        ir_builder->Return(ty == INT ? ir_builder->Integer(0) : nullptr);
+
+      if (ssa_mode)
+        SSAFinish();
+      ir_builder->EndFunction();
+
+      // 局部变量与函数中各块的父子关系不再使用
+      variables.clear();
+      is_block_end.clear();
+      int func_block = cur_block;
+      cur_block = parent[func_block];
+      for (int b = func_block; b < block_cnt; b++)
+        parent.erase(b);
+      return stack.Return(std::pair<bool, int>(false, 0));
+  }
 }
 
-void FuncFParamsAST::Dump() const {
-  std::cout << "FuncFParamsAST { ";
-  for (auto& param : paramList) {
-    param->Dump();
-  }
+bool FuncFParamsAST::DumpStep(AstStack& stack) const {
+  auto& frame = stack.Top();
+  if (frame.state == 0)
+    std::cout << "FuncFParamsAST { ";
+  if (frame.index < paramList.size())
+    return stack.Call(1, paramList[frame.index++]);
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> FuncFParamsAST::Output() const {
-  for (int i = 0; i < paramList.size(); i++) {
-    paramList[i]->Output();
-    if (i != paramList.size() - 1)
-      str += ", ";
-  }
-  return std::pair<bool, int>(false, 0);
+bool FuncFParamsAST::OutputStep(AstStack& stack) const {
+  auto& frame = stack.Top();
+  if (frame.index < paramList.size())
+    return stack.Call(1, paramList[frame.index++]);
+  return stack.Return(std::pair<bool, int>(false, 0));
 }
 
 void FuncFParamsAST::declare() {
-  for (auto& param : paramList) {
-    ((FuncFParamAST*)param.get())->declare();
+  for (size_t i = 0; i < paramList.size(); i++) {
+    ((FuncFParamAST*)paramList[i])->declare(ir_builder->Param(i));
   }
 }
 
-void FuncFParamAST::Dump() const {
+bool FuncFParamAST::DumpStep(AstStack& stack) const {
   std::cout << "FuncFParamAST { ";
   std::cout << "BTypeAST { " << bType << " } ";
-  std::cout << "Ident { " << ident << " } ";
+  std::cout << "Ident { " << interner.Name(ident) << " } ";
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> FuncFParamAST::Output() const {
-  str += "@";
-  str += ident;
-  if (bType == "int")
-    str += ": i32";
+bool FuncFParamAST::OutputStep(AstStack& stack) const {
+  if (!strcmp(bType, "int"))
+    ir_builder->AddParam("@" + std::string(interner.Name(ident)));
   else
     assert(false);
-  return std::pair<bool, int>(false, 0);
+  return stack.Return(std::pair<bool, int>(false, 0));
 }
 
-void FuncFParamAST::declare() {
-  str += "\t@";
-  str += ident;
-  str += "_";
-  str += std::to_string(cur_block);
-  str += " = alloc i32\n";
-  str += "\tstore @";
-  str += ident;
-  str += ", @";
-  str += ident;
-  str += "_";
-  str += std::to_string(cur_block);
-  str += "\n";
-
-  insertSymbol(ident, VARIABLE, 0, UND);
+void FuncFParamAST::declare(koopa_raw_value_t param) {
+  var_t var = VarKey(ident, symbol->block);
+  if (ssa_mode) {
+    SSAWrite(var, ssa_cur, param);
+  } else {
+    auto alloc = ir_builder->Alloc(VarName(var));
+    Variable(var) = alloc;
+    ir_builder->Store(param, alloc);
+  }
 }
 
-void BlockAST::Dump() const {
-  std::cout << "BlockAST { ";
-  for (auto& blockItem : blockItemList) {
-    blockItem->Dump();
-  }
+bool BlockAST::DumpStep(AstStack& stack) const {
+  auto& frame = stack.Top();
+  if (frame.state == 0)
+    std::cout << "BlockAST { ";
+  if (frame.index < blockItemList.size())
+    return stack.Call(1, blockItemList[frame.index++]);
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> BlockAST::Output() const {
-  std::unordered_map<std::string, std::unique_ptr<stored_object>> table;
-
-  int parent_block = cur_block;
-  cur_block = symbol_tables.size();
-  parent[cur_block] = parent_block;
-  symbol_tables.push_back(&table);
-
-  is_block_end.push_back(false);
+bool BlockAST::OutputStep(AstStack& stack) const {
+  auto& frame = stack.Top();
+  // frame.num 为外层块
+  if (frame.state == 0) {
+    frame.num = cur_block;
+    cur_block = block_cnt++;
+    parent[cur_block] = frame.num;
 
-  for (auto& blockItem : blockItemList) {
-    if (is_block_end[cur_block])
-      break;
-    blockItem->Output();
+    is_block_end[cur_block] = false;
   }
 
-  if (parent_block != 0) {
-    is_block_end[parent_block] = is_block_end[cur_block];
+  if (frame.index < blockItemList.size() && !is_block_end[cur_block])
+    return stack.Call(1, blockItemList[frame.index++]);
+
+  if (frame.num != 0) {
+    is_block_end[frame.num] = is_block_end[cur_block];
   }
   cur_block = parent[cur_block];
-  return std::pair<bool, int>(false, 0);
+  return stack.Return(std::pair<bool, int>(false, 0));
 }
 
-void BlockItemWithDeclAST::Dump() const {
-  std::cout << "BlockItemWithDeclAST { ";
-  decl->Dump();
+bool BlockItemWithDeclAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "BlockItemWithDeclAST { ";
+    return stack.Call(1, decl);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> BlockItemWithDeclAST::Output() const {
-  return decl->Output();
+bool BlockItemWithDeclAST::OutputStep(AstStack& stack) const {
+  return stack.Tail(decl);
 }
 
-void BlockItemWithStmtAST::Dump() const {
-  std::cout << "BlockItemWithStmtAST { ";
-  stmt->Dump();
+bool BlockItemWithStmtAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "BlockItemWithStmtAST { ";
+    return stack.Call(1, stmt);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> BlockItemWithStmtAST::Output() const {
-  return stmt->Output();
+bool BlockItemWithStmtAST::OutputStep(AstStack& stack) const {
+  return stack.Tail(stmt);
 }
 
-void StmtWithAssignAST::Dump() const {
-  std::cout << "StmtWithAssignAST { ";
-  lVal->Dump();
-  exp->Dump();
-  std::cout << "} ";
+bool StmtWithAssignAST::DumpStep(AstStack& stack) const {
+  switch (stack.Top().state) {
+    case 0:
+      std::cout << "StmtWithAssignAST { ";
+      return stack.Call(1, lVal);
+    case 1:
+      return stack.Call(2, exp);
+    default:
+      std::cout << "} ";
+      return true;
+  }
 }
 
-std::pair<bool, int> StmtWithAssignAST::Output() const {
-  auto ident = ((LValAST*)lVal.get())->ident;
-  auto fetch_result = fetchSymbol(ident);
-
-  if (std::get<0>(fetch_result) != VARIABLE) {
-    assert(false);
-  }
+bool StmtWithAssignAST::OutputStep(AstStack& stack) const {
+  if (stack.Top().state == 0)
+    return stack.Call(1, exp);
 
-  std::pair<bool, int> result = exp->Output();
+  auto symbol = ((LValAST*)lVal)->symbol;
+  std::pair<bool, int> result = stack.result;
+  var_t var = VarKey(((LValAST*)lVal)->ident, symbol->block);
 
-  if (result.first) {
-    str += "\tstore ";
-    str += std::to_string(result.second);
-    str += ", @";
-    str += ident;
-    str += "_";
-    str += std::to_string(std::get<2>(fetch_result));
-    str += "\n";
-  } else {
-    str += "\tstore %";
-    str += std::to_string(cnt - 1);
-    str += ", @";
-    str += ident;
-    str += "_";
-    str += std::to_string(std::get<2>(fetch_result));
-    str += "\n";
-  }
+  if (ssa_mode && symbol->block != 0)
+    SSADef(var, result);
+  else
+    ir_builder->Store(Val(result, cnt - 1), Variable(var));
 
-  return std::pair<bool, int>(false, 0);
+  return stack.Return(std::pair<bool, int>(false, 0));
 }
 
-void StmtWithExpAST::Dump() const {
-  std::cout << "StmtWithExpAST { ";
-  if (exp) {
-    (*exp)->Dump();
+bool StmtWithExpAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "StmtWithExpAST { ";
+    if (exp)
+      return stack.Call(1, exp);
   }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> StmtWithExpAST::Output() const {
-  if (exp)
-    (*exp)->Output();
-  return std::pair<bool, int>(false, 0);
+bool StmtWithExpAST::OutputStep(AstStack& stack) const {
+  if (stack.Top().state == 0 && exp)
+    return stack.Call(1, exp);
+  return stack.Return(std::pair<bool, int>(false, 0));
 }
 
-void StmtWithBlockAST::Dump() const {
-  std::cout << "StmtWithBlockAST { ";
-  block->Dump();
+bool StmtWithBlockAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "StmtWithBlockAST { ";
+    return stack.Call(1, block);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> StmtWithBlockAST::Output() const {
-  return block->Output();
+bool StmtWithBlockAST::OutputStep(AstStack& stack) const {
+  return stack.Tail(block);
 }
 
-void StmtWithIfAST::Dump() const {
-  std::cout << "StmtWithIfAST { ";
-  exp->Dump();
-  if_stmt->Dump();
-  if (else_stmt)
-    (*else_stmt)->Dump();
-  std::cout << "} ";
+bool StmtWithIfAST::DumpStep(AstStack& stack) const {
+  switch (stack.Top().state) {
+    case 0:
+      std::cout << "StmtWithIfAST { ";
+      return stack.Call(1, exp);
+    case 1:
+      return stack.Call(2, if_stmt);
+    case 2:
+      if (else_stmt)
+        return stack.Call(3, else_stmt);
+      [[fallthrough]];
+    default:
+      std::cout << "} ";
+      return true;
+  }
 }
 
-std::pair<bool, int> StmtWithIfAST::Output() const {
-  auto result = exp->Output();
+bool StmtWithIfAST::OutputStep(AstStack& stack) const {
+  auto& frame = stack.Top();
+  // frame.num 为当前 if 的编号, frame.flag 记录 then 分支是否终止
+  // cur_if 为 0 时基本块名不加后缀
+  std::string suffix = frame.num != 0 ? "_" + std::to_string(frame.num) : "";
 
-  if_cnt++;
-  int cur_if = if_cnt;
+  switch (frame.state) {
+    case 0:
+      return stack.Call(1, exp);
+    case 1:
+      if_cnt++;
+      frame.num = if_cnt;
+      suffix = frame.num != 0 ? "_" + std::to_string(frame.num) : "";
+      EmitBranch(Val(stack.result, cnt - 1), "%then" + suffix, (else_stmt ? "%else" : "%end") + suffix);
 
-  if (result.first) {
-    str += "\tbr ";
-    str += std::to_string(result.second);
-    str += ", %then";
-    if (cur_if != 0) {
-      str += "_";
-      str += std::to_string(cur_if);
-    }
-    str += else_stmt ? ", %else" : ", %end";
-    if (cur_if != 0) {
-      str += "_";
-      str += std::to_string(cur_if);
-    }
-    str += "\n";
-  } else {
-    str += "\tbr %";
-    str += std::to_string(cnt - 1);
-    str += ", %then";
-    if (cur_if != 0) {
-      str += "_";
-      str += std::to_string(cur_if);
-    }
-    str += else_stmt ? ", %else" : ", %end";
-    if (cur_if != 0) {
-      str += "_";
-      str += std::to_string(cur_if);
-    }
-    str += "\n";
-  }
+      EmitLabel("%then" + suffix);
 
-  str += "%then";
-  if (cur_if != 0) {
-    str += "_";
-    str += std::to_string(cur_if);
-  }
-  str += ":\n";
+      return stack.Call(2, if_stmt);
+    case 2:
+      if (!is_block_end[cur_block])
+        EmitJump("%end" + suffix);
 
-  if_stmt->Output();
+      frame.flag = is_block_end[cur_block];
+      is_block_end[cur_block] = false;
 
-  if (!is_block_end[cur_block]) {
-    str += "\tjump %end";
-    if (cur_if != 0) {
-      str += "_";
-      str += std::to_string(cur_if);
-    }
-    str += "\n";
-  }
+      if (else_stmt) {
+        EmitLabel("%else" + suffix);
 
-  // int else_block = cur_table + 1;
-  bool if_end = is_block_end[cur_block];
-  is_block_end[cur_block] = false;
+        return stack.Call(3, else_stmt);
+      }
+      break;
+  }
 
   bool else_end = false;
 
-  if (else_stmt) {
-    str += "%else";
-    if (cur_if != 0) {
-      str += "_";
-      str += std::to_string(cur_if);
-    }
-    str += ":\n";
-
-    (*else_stmt)->Output();
-
-    if (!is_block_end[cur_block]) {
-      str += "\tjump %end";
-      if (cur_if != 0) {
-        str += "_";
-        str += std::to_string(cur_if);
-      }
-      str += "\n";
-    } else {
+  if (frame.state == 3) {
+    if (!is_block_end[cur_block])
+      EmitJump("%end" + suffix);
+    else
       else_end = true;
-    }
   }
 
   is_block_end[cur_block] = false;
 
-  if (if_end && (else_stmt && else_end)) {
+  if (frame.flag && (else_stmt && else_end)) {
     is_block_end[cur_block] = true;
   } else {
-    str += "%end";
-    if (cur_if != 0) {
-      str += "_";
-      str += std::to_string(cur_if);
-    }
-    str += ":\n";
+    EmitLabel("%end" + suffix);
   }
 
-  return std::make_pair(false, 0);
+  return stack.Return(std::make_pair(false, 0));
 }
 
-void StmtWithWhileAST::Dump() const {
-  std::cout << "StmtWithWhileAST { ";
-  exp->Dump();
-  stmt->Dump();
-  std::cout << "} ";
+bool StmtWithWhileAST::DumpStep(AstStack& stack) const {
+  switch (stack.Top().state) {
+    case 0:
+      std::cout << "StmtWithWhileAST { ";
+      return stack.Call(1, exp);
+    case 1:
+      return stack.Call(2, stmt);
+    default:
+      std::cout << "} ";
+      return true;
+  }
 }
 
-std::pair<bool, int> StmtWithWhileAST::Output() const {
-  while_level++;
-  while_cnt++;
-  int cur_while = while_cnt;
-
-  level_to_cnt[while_level] = while_cnt;
-
-  str += "\tjump %while_";
-  str += std::to_string(cur_while);
-  str += "_entry\n";
+bool StmtWithWhileAST::OutputStep(AstStack& stack) const {
+  auto& frame = stack.Top();
+  // frame.num 为当前 while 的编号, frame.index 为入口基本块
+  std::string prefix = "%while_" + std::to_string(frame.num);
 
-  str += "%while_";
-  str += std::to_string(cur_while);
-  str += "_entry:\n";
+  switch (frame.state) {
+    case 0:
+      while_level++;
+      while_cnt++;
+      frame.num = while_cnt;
 
-  auto result = exp->Output();
+      level_to_cnt[while_level] = while_cnt;
 
-  if (result.first) {
-    str += "\tbr ";
-    str += std::to_string(result.second);
-    str += ", %while_";
-    str += std::to_string(cur_while);
-    str += "_body, %while_";
-    str += std::to_string(cur_while);
-    str += "_end\n";
-  } else {
-    str += "\tbr %";
-    str += std::to_string(cnt - 1);
-    str += ", %while_";
-    str += std::to_string(cur_while);
-    str += "_body, %while_";
-    str += std::to_string(cur_while);
-    str += "_end\n";
-  }
+      prefix = "%while_" + std::to_string(frame.num);
+      EmitJump(prefix + "_entry");
+      // 循环体中的 continue 与回边都是入口的前驱, 循环体生成后才能封闭
+      EmitLabel(prefix + "_entry", false);
+      frame.index = ssa_cur;
 
-  str += "%while_";
-  str += std::to_string(cur_while);
-  str += "_body:\n";
+      return stack.Call(1, exp);
+    case 1:
+      EmitBranch(Val(stack.result, cnt - 1), prefix + "_body", prefix + "_end");
 
-  stmt->Output();
+      EmitLabel(prefix + "_body");
 
-  if (!is_block_end[cur_block]) {
-    str += "\tjump %while_";
-    str += std::to_string(cur_while);
-    str += "_entry";
-    str += "\n";
+      return stack.Call(2, stmt);
   }
 
+  if (!is_block_end[cur_block])
+    EmitJump(prefix + "_entry");
+  if (ssa_mode)
+    SSASeal(frame.index);
+
   is_block_end[cur_block] = false;
 
-  str += "%while_";
-  str += std::to_string(cur_while);
-  str += "_end:\n";
+  EmitLabel(prefix + "_end");
 
   level_to_cnt.erase(while_level);
   while_level--;
 
-  return std::make_pair(false, 0);
+  return stack.Return(std::make_pair(false, 0));
 }
 
-void StmtWithBreakAST::Dump() const {
+bool StmtWithBreakAST::DumpStep(AstStack& stack) const {
   std::cout << "StmtWithBreakAST ";
+  return true;
 }
 
-std::pair<bool, int> StmtWithBreakAST::Output() const {
+bool StmtWithBreakAST::OutputStep(AstStack& stack) const {
   if (while_level < 0)
     assert(false);
 
-  str += "\tjump %while_";
-  str += std::to_string(level_to_cnt[while_level]);
-  str += "_end";
-  str += "\n";
+  EmitJump("%while_" + std::to_string(level_to_cnt[while_level]) + "_end");
 
   is_block_end[cur_block] = true;
 
-  return std::make_pair(false, 0);
+  return stack.Return(std::make_pair(false, 0));
 }
 
-void StmtWithContinueAST::Dump() const {
+bool StmtWithContinueAST::DumpStep(AstStack& stack) const {
   std::cout << "StmtWithReturnAST ";
+  return true;
 }
 
-std::pair<bool, int> StmtWithContinueAST::Output() const {
+bool StmtWithContinueAST::OutputStep(AstStack& stack) const {
   if (while_level < 0)
     assert(false);
 
-  str += "\tjump %while_";
-  str += std::to_string(level_to_cnt[while_level]);
-  str += "_entry";
-  str += "\n";
+  EmitJump("%while_" + std::to_string(level_to_cnt[while_level]) + "_entry");
 
   is_block_end[cur_block] = true;
 
-  return std::make_pair(false, 0);
+  return stack.Return(std::make_pair(false, 0));
 }
 
-void StmtWithReturnAST::Dump() const {
-  std::cout << "StmtWithReturnAST { ";
-  if (exp)
-    (*exp)->Dump();
+bool StmtWithReturnAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "StmtWithReturnAST { ";
+    if (exp)
+      return stack.Call(1, exp);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> StmtWithReturnAST::Output() const {
-  if (exp) {
-    std::pair<bool, int> result = (*exp)->Output();
+bool StmtWithReturnAST::OutputStep(AstStack& stack) const {
+  if (stack.Top().state == 0 && exp)
+    return stack.Call(1, exp);
 
-    if (result.first) {
-      str += "\tret ";
-      str += std::to_string(result.second);
-      str += "\n";
-    } else {
-      str += "\tret %";
-      str += std::to_string(cnt - 1);
-      str += "\n";
-    }
-  } else {
-    str += "\tret\n";
-  }
+  if (exp)
+    ir_builder->Return(Val(stack.result, cnt - 1));
+  else
+    ir_builder->Return(nullptr);
 
   is_block_end[cur_block] = true;
 
-  return std::make_pair(false, 0);
+  return stack.Return(std::make_pair(false, 0));
 }
 
-void ExpAST::Dump() const {
-  std::cout << "ExpAST { ";
-  lOrExp->Dump();
+bool ExpAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "ExpAST { ";
+    return stack.Call(1, lOrExp);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> ExpAST::Output() const {
-  return lOrExp->Output();
+bool ExpAST::OutputStep(AstStack& stack) const {
+  return stack.Tail(lOrExp);
 }
 
-void LValAST::Dump() const {
+bool LValAST::DumpStep(AstStack& stack) const {
   std::cout << "LValAST { ";
-  std::cout << ident;
+  std::cout << interner.Name(ident);
   std::cout << " } ";
+  return true;
 }
 
-std::pair<bool, int> LValAST::Output() const {
-  auto result = fetchSymbol(ident);
-  if (std::get<0>(result) == CONSTANT)
-    return std::pair<bool, int>(true, std::get<1>(result));
-  else if (std::get<0>(result) == VARIABLE) {
-    str += "\t%";
-    str += std::to_string(cnt);
-    cnt++;
-    str += " = load @";
-    str += ident;
-    str += "_";
-    str += std::to_string(std::get<2>(result));
-    str += "\n";
-  } else {
+bool LValAST::OutputStep(AstStack& stack) const {
+  var_t var = VarKey(ident, symbol->block);
+  if (symbol->type == CONSTANT)
+    return stack.Return(std::pair<bool, int>(true, symbol->value.val));
+  else if (symbol->type == VARIABLE && ssa_mode && symbol->block != 0)
+    return stack.Return(SSAUse(var));
+  else if (symbol->type == VARIABLE)
+    Def(ir_builder->Load(Variable(var)));
+  else
     assert(false);
-  }
-  return std::pair<bool, int>(false, 0);
+  return stack.Return(std::pair<bool, int>(false, 0));
 }
 
-void PrimaryExpWithBrAST::Dump() const {
-  std::cout << "PrimaryExpWithBrAST { ";
-  exp->Dump();
+bool PrimaryExpWithBrAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "PrimaryExpWithBrAST { ";
+    return stack.Call(1, exp);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> PrimaryExpWithBrAST::Output() const {
-  return exp->Output();
+bool PrimaryExpWithBrAST::OutputStep(AstStack& stack) const {
+  return stack.Tail(exp);
 }
 
-void PrimaryExpWithLValAST::Dump() const {
-  std::cout << "PrimaryExpWithLValAST { ";
-  lVal->Dump();
+bool PrimaryExpWithLValAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "PrimaryExpWithLValAST { ";
+    return stack.Call(1, lVal);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> PrimaryExpWithLValAST::Output() const {
-  return lVal->Output();
+bool PrimaryExpWithLValAST::OutputStep(AstStack& stack) const {
+  return stack.Tail(lVal);
 }
 
-void PrimaryExpWithNumAST::Dump() const {
+bool PrimaryExpWithNumAST::DumpStep(AstStack& stack) const {
   std::cout << "PrimaryExpWithNumAST { ";
   std::cout << number;
   std::cout << " } ";
+  return true;
 }
 
-std::pair<bool, int> PrimaryExpWithNumAST::Output() const {
-  return std::pair<bool, int>(true, number);
+bool PrimaryExpWithNumAST::OutputStep(AstStack& stack) const {
+  return stack.Return(std::pair<bool, int>(true, number));
 }
 
-void UnaryExpAST::Dump() const {
-  std::cout << "UnaryExpAST { ";
-  primaryExp->Dump();
+bool UnaryExpAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "UnaryExpAST { ";
+    return stack.Call(1, primaryExp);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> UnaryExpAST::Output() const {
-  return primaryExp->Output();
+bool UnaryExpAST::OutputStep(AstStack& stack) const {
+  return stack.Tail(primaryExp);
 }
 
-void UnaryExpWithFuncAST::Dump() const {
-  std::cout << "UnaryExpWithFuncAST { ";
-  std::cout << "Ident { " << ident << " } ";
-  if (params)
-    (*params)->Dump();
+bool UnaryExpWithFuncAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "UnaryExpWithFuncAST { ";
+    std::cout << "Ident { " << interner.Name(ident) << " } ";
+    if (params)
+      return stack.Call(1, params);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> UnaryExpWithFuncAST::Output() const {
-  std::vector<std::pair<bool, int>> list;
+bool UnaryExpWithFuncAST::OutputStep(AstStack& stack) const {
+  auto& frame = stack.Top();
 
-  if (params) {
-    list = ((FuncRParamsAST*)(*params).get())->prepare();
-  }
+  // 准备参数, 依次求值, frame.values 为已求出的实参
+  if (frame.state != 0)
+    frame.values.push_back(Val(stack.result, cnt - 1));
+  if (params && frame.index < ((FuncRParamsAST*)params)->paramList.size())
+    return stack.Call(1, ((FuncRParamsAST*)params)->paramList[frame.index++]);
 
-  auto result = fetchSymbol(ident);
+  auto call = ir_builder->Call(callees.at(ident), frame.values);
 
-  switch (std::get<3>(result)) {
-    case VOID: {
-      str += "\tcall @";
+  switch (symbol->value.type) {
+    case VOID:
       break;
-    }
-    case INT: {
-      str += "\t%";
-      str += std::to_string(cnt);
-      cnt++;
-      str += " = call @";
+    case INT:
+      Def(call);
       break;
-    }
     default:
       assert(false);
       break;
   }
 
-  str += ident;
-  str += "(";
+  return stack.Return(std::make_pair(false, 0));
+}
 
-  // 准备参数
-  if (params) {
-    for (int i = 0; i < list.size(); i++) {
-      if (list[i].first) {
-        str += std::to_string(list[i].second);
-      } else {
-        str += "%";
-        str += std::to_string(list[i].second);
-      }
-      if (i != list.size() - 1)
-        str += ", ";
-    }
+bool UnaryExpWithOpAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "UnaryExpWithOpAST { ";
+    std::cout << "UnaryOpAST { " << unaryOp << " } ";
+    return stack.Call(1, unaryExp);
   }
+  std::cout << "} ";
+  return true;
+}
 
-  str += ")\n";
+bool UnaryExpWithOpAST::OutputStep(AstStack& stack) const {
+  if (stack.Top().state == 0)
+    return stack.Call(1, unaryExp);
 
-  return std::make_pair(false, 0);
-}
+  std::pair<bool, int> result = stack.result;
 
-void UnaryExpWithOpAST::Dump() const {
-  std::cout << "UnaryExpWithOpAST { ";
-  std::cout << "UnaryOpAST { " << unaryOp << " } ";
-  unaryExp->Dump();
-  std::cout << "} ";
-}
+  if (result.first && unaryOp == '+')
+    return stack.Return(std::pair<bool, int>(true, result.second));
 
-std::pair<bool, int> UnaryExpWithOpAST::Output() const {
-  std::pair<bool, int> result = unaryExp->Output();
-
-  if (result.first) {
-    if (unaryOp == '!') {
-      str += "\t%";
-      str += std::to_string(cnt);
-      str += " = eq ";
-      str += std::to_string(result.second);
-      str += ", 0\n";
-      cnt++;
-    } else if (unaryOp == '-') {
-      str += "\t%";
-      str += std::to_string(cnt);
-      str += " = sub 0, ";
-      str += std::to_string(result.second);
-      str += "\n";
-      cnt++;
-    } else if (unaryOp == '+') {
-      return std::pair<bool, int>(true, result.second);
-    }
-  } else {
-    if (unaryOp == '!') {
-      str += "\t%";
-      str += std::to_string(cnt);
-      str += " = eq %";
-      str += std::to_string(cnt - 1);
-      str += ", 0\n";
-      cnt++;
-    } else if (unaryOp == '-') {
-      str += "\t%";
-      str += std::to_string(cnt);
-      str += " = sub 0, %";
-      str += std::to_string(cnt - 1);
-      str += "\n";
-      cnt++;
-    }
-  }
+  auto zero = ir_builder->Integer(0);
+  if (unaryOp == '!')
+    Def(ir_builder->Binary(KOOPA_RBO_EQ, Val(result, cnt - 1), zero));
+  else if (unaryOp == '-')
+    Def(ir_builder->Binary(KOOPA_RBO_SUB, zero, Val(result, cnt - 1)));
 
-  return std::pair<bool, int>(false, 0);
+  return stack.Return(std::pair<bool, int>(false, 0));
 }
 
-void FuncRParamsAST::Dump() const {
-  std::cout << "FuncRParamsAST { ";
-  for (auto& param : paramList) {
-    param->Dump();
-  }
+bool FuncRParamsAST::DumpStep(AstStack& stack) const {
+  auto& frame = stack.Top();
+  if (frame.state == 0)
+    std::cout << "FuncRParamsAST { ";
+  if (frame.index < paramList.size())
+    return stack.Call(1, paramList[frame.index++]);
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> FuncRParamsAST::Output() const {
-  return std::make_pair(false, 0);
+bool FuncRParamsAST::OutputStep(AstStack& stack) const {
+  // 实参由 UnaryExpWithFuncAST 逐个求值
+  return stack.Return(std::make_pair(false, 0));
 }
 
-std::vector<std::pair<bool, int>> FuncRParamsAST::prepare() {
-  std::vector<std::pair<bool, int>> vec;
-  for (auto& param : paramList) {
-    auto result = param->Output();
-    int cur = cnt - 1;
-    if (result.first) {
-      vec.push_back(std::make_pair(true, result.second));
+// 按左结合的嵌套形式输出运算链, 与逐层二元节点的输出相同
+// frame.index 为已开始输出的操作数个数
+template <typename Op>
+static bool DumpChain(AstStack& stack, const ast_chain_t<Op>& chain, const char* name, const char* op_name) {
+  auto& frame = stack.Top();
+  if (frame.state == 0) {
+    for (uint32_t i = 1; i < chain.len; i++)
+      std::cout << name << " { ";
+  } else if (frame.index > 1) {
+    std::cout << "} ";
+  }
+  if (frame.index == chain.len)
+    return true;
+  if (frame.index > 0)
+    std::cout << op_name << " { " << chain.ops[frame.index - 1] << " } ";
+  return stack.Call(1, chain.operands[frame.index++]);
+}
+
+// 从左到右依次计算运算链, dic 将运算符映射为 Koopa 的二元运算
+// frame.index 为已开始计算的操作数个数, frame.result 与 frame.num 为左操作数及其 %cnt
+template <typename Op, typename Dic>
+static bool OutputChain(AstStack& stack, const ast_chain_t<Op>& chain, const Dic& dic) {
+  auto& frame = stack.Top();
+  if (frame.state != 0) {
+    if (frame.index == 1) {
+      frame.result = stack.result;
     } else {
-      vec.push_back(std::make_pair(false, cur));
+      int cnt_r = cnt - 1;
+      Def(ir_builder->Binary(dic.at(chain.ops[frame.index - 2]), Val(frame.result, frame.num), Val(stack.result, cnt_r)));
+      frame.result = std::pair<bool, int>(false, 0);
     }
+    frame.num = cnt - 1;
   }
-  return vec;
+  if (frame.index < chain.len)
+    return stack.Call(1, chain.operands[frame.index++]);
+  return stack.Return(frame.result);
 }
 
-void MulExpAST::Dump() const {
-  std::cout << "MulExpAST { ";
-  unaryExp->Dump();
+bool MulExpAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "MulExpAST { ";
+    return stack.Call(1, unaryExp);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> MulExpAST::Output() const {
-  return unaryExp->Output();
+bool MulExpAST::OutputStep(AstStack& stack) const {
+  return stack.Tail(unaryExp);
 }
 
-void MulExpWithOpAST::Dump() const {
-  std::cout << "MulExpWithOpAST { ";
-  mulExp->Dump();
-  std::cout << "MulExpOpAST { " << mulOp << " } ";
-  unaryExp->Dump();
-  std::cout << "} ";
+bool MulExpWithOpAST::DumpStep(AstStack& stack) const {
+  return DumpChain(stack, chain, "MulExpWithOpAST", "MulExpOpAST");
 }
 
-std::pair<bool, int> MulExpWithOpAST::Output() const {
-  std::pair<bool, int> result_l = mulExp->Output();
-  int cnt_l = cnt - 1;
-
-  std::pair<bool, int> result_r = unaryExp->Output();
-  int cnt_r = cnt - 1;
-
-  std::unordered_map<char, std::string> dic = {
-      {'*', "mul"},
-      {'/', "div"},
-      {'%', "mod"},
+bool MulExpWithOpAST::OutputStep(AstStack& stack) const {
+  static const std::unordered_map<char, koopa_raw_binary_op_t> dic = {
+      {'*', KOOPA_RBO_MUL},
+      {'/', KOOPA_RBO_DIV},
+      {'%', KOOPA_RBO_MOD},
   };
 
-  if (result_l.first && result_r.first) {
-    str += "\t%";
-    str += std::to_string(cnt);
-    str += " = ";
-    str += dic[mulOp];
-    str += " ";
-    str += std::to_string(result_l.second);
-    str += ", ";
-    str += std::to_string(result_r.second);
-    str += "\n";
-    cnt++;
-
-  } else if (result_l.first) {
-    str += "\t%";
-    str += std::to_string(cnt);
-    str += " = ";
-    str += dic[mulOp];
-    str += " ";
-    str += std::to_string(result_l.second);
-    str += ", %";
-    str += std::to_string(cnt_r);
-    str += "\n";
-    cnt++;
-
-  } else if (result_r.first) {
-    str += "\t%";
-    str += std::to_string(cnt);
-    str += " = ";
-    str += dic[mulOp];
-    str += " %";
-    str += std::to_string(cnt_l);
-    str += ", ";
-    str += std::to_string(result_r.second);
-    str += "\n";
-    cnt++;
-
-  } else {
-    str += "\t%";
-    str += std::to_string(cnt);
-    str += " = ";
-    str += dic[mulOp];
-    str += " %";
-    str += std::to_string(cnt_l);
-    str += ", %";
-    str += std::to_string(cnt_r);
-    str += "\n";
-    cnt++;
-  }
-
-  return std::pair<bool, int>(false, 0);
+  return OutputChain(stack, chain, dic);
 }
 
-void AddExpAST::Dump() const {
-  std::cout << "AddExpAST { ";
-  mulExp->Dump();
+bool AddExpAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "AddExpAST { ";
+    return stack.Call(1, mulExp);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> AddExpAST::Output() const {
-  return mulExp->Output();
+bool AddExpAST::OutputStep(AstStack& stack) const {
+  return stack.Tail(mulExp);
 }
 
-void AddExpWithOpAST::Dump() const {
-  std::cout << "AddExpWithOpAST { ";
-  addExp->Dump();
-  std::cout << "AddExpOpAST { " << addOp << " } ";
-  mulExp->Dump();
-  std::cout << "} ";
+bool AddExpWithOpAST::DumpStep(AstStack& stack) const {
+  return DumpChain(stack, chain, "AddExpWithOpAST", "AddExpOpAST");
 }
 
-std::pair<bool, int> AddExpWithOpAST::Output() const {
-  std::pair<bool, int> result_l = addExp->Output();
-  int cnt_l = cnt - 1;
-
-  std::pair<bool, int> result_r = mulExp->Output();
-  int cnt_r = cnt - 1;
-
-  std::unordered_map<char, std::string> dic = {
-      {'+', "add"},
-      {'-', "sub"},
+bool AddExpWithOpAST::OutputStep(AstStack& stack) const {
+  static const std::unordered_map<char, koopa_raw_binary_op_t> dic = {
+      {'+', KOOPA_RBO_ADD},
+      {'-', KOOPA_RBO_SUB},
   };
 
-  if (result_l.first && result_r.first) {
-    str += "\t%";
-    str += std::to_string(cnt);
-    str += " = ";
-    str += dic[addOp];
-    str += " ";
-    str += std::to_string(result_l.second);
-    str += ", ";
-    str += std::to_string(result_r.second);
-    str += "\n";
-    cnt++;
-
-  } else if (result_l.first) {
-    str += "\t%";
-    str += std::to_string(cnt);
-    str += " = ";
-    str += dic[addOp];
-    str += " ";
-    str += std::to_string(result_l.second);
-    str += ", %";
-    str += std::to_string(cnt_r);
-    str += "\n";
-    cnt++;
-
-  } else if (result_r.first) {
-    str += "\t%";
-    str += std::to_string(cnt);
-    str += " = ";
-    str += dic[addOp];
-    str += " %";
-    str += std::to_string(cnt_l);
-    str += ", ";
-    str += std::to_string(result_r.second);
-    str += "\n";
-    cnt++;
-
-  } else {
-    str += "\t%";
-    str += std::to_string(cnt);
-    str += " = ";
-    str += dic[addOp];
-    str += " %";
-    str += std::to_string(cnt_l);
-    str += ", %";
-    str += std::to_string(cnt_r);
-    str += "\n";
-    cnt++;
-  }
-
-  return std::pair<bool, int>(false, 0);
+  return OutputChain(stack, chain, dic);
 }
 
-void RelExpAST::Dump() const {
-  std::cout << "RelExpAST { ";
-  addExp->Dump();
+bool RelExpAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "RelExpAST { ";
+    return stack.Call(1, addExp);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> RelExpAST::Output() const {
-  return addExp->Output();
+bool RelExpAST::OutputStep(AstStack& stack) const {
+  return stack.Tail(addExp);
 }
 
-void RelExpWithOpAST::Dump() const {
-  std::cout << "RelExpWithOpAST { ";
-  relExp->Dump();
-  std::cout << "RelExpOpAST { " << relOp << " } ";
-  addExp->Dump();
-  std::cout << "} ";
+bool RelExpWithOpAST::DumpStep(AstStack& stack) const {
+  return DumpChain(stack, chain, "RelExpWithOpAST", "RelExpOpAST");
 }
 
-std::pair<bool, int> RelExpWithOpAST::Output() const {
-  std::pair<bool, int> result_l = relExp->Output();
-  int cnt_l = cnt - 1;
-
-  std::pair<bool, int> result_r = addExp->Output();
-  int cnt_r = cnt - 1;
-
-  std::unordered_map<std::string, std::string> dic = {
-      {"<", "lt"},
-      {">", "gt"},
-      {"<=", "le"},
-      {">=", "ge"},
+bool RelExpWithOpAST::OutputStep(AstStack& stack) const {
+  static const std::unordered_map<std::string, koopa_raw_binary_op_t> dic = {
+      {"<", KOOPA_RBO_LT},
+      {">", KOOPA_RBO_GT},
+      {"<=", KOOPA_RBO_LE},
+      {">=", KOOPA_RBO_GE},
   };
 
-  if (result_l.first && result_r.first) {
-    str += "\t%";
-    str += std::to_string(cnt);
-    str += " = ";
-    str += dic[relOp];
-    str += " ";
-    str += std::to_string(result_l.second);
-    str += ", ";
-    str += std::to_string(result_r.second);
-    str += "\n";
-    cnt++;
-
-  } else if (result_l.first) {
-    str += "\t%";
-    str += std::to_string(cnt);
-    str += " = ";
-    str += dic[relOp];
-    str += " ";
-    str += std::to_string(result_l.second);
-    str += ", %";
-    str += std::to_string(cnt_r);
-    str += "\n";
-    cnt++;
-
-  } else if (result_r.first) {
-    str += "\t%";
-    str += std::to_string(cnt);
-    str += " = ";
-    str += dic[relOp];
-    str += " %";
-    str += std::to_string(cnt_l);
-    str += ", ";
-    str += std::to_string(result_r.second);
-    str += "\n";
-    cnt++;
-
-  } else {
-    str += "\t%";
-    str += std::to_string(cnt);
-    str += " = ";
-    str += dic[relOp];
-    str += " %";
-    str += std::to_string(cnt_l);
-    str += ", %";
-    str += std::to_string(cnt_r);
-    str += "\n";
-    cnt++;
-  }
-
-  return std::pair<bool, int>(false, 0);
+  return OutputChain(stack, chain, dic);
 }
 
-void EqExpAST::Dump() const {
-  std::cout << "EqExpAST { ";
-  relExp->Dump();
+bool EqExpAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "EqExpAST { ";
+    return stack.Call(1, relExp);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> EqExpAST::Output() const {
-  return relExp->Output();
+bool EqExpAST::OutputStep(AstStack& stack) const {
+  return stack.Tail(relExp);
 }
 
-void EqExpWithOpAST::Dump() const {
-  std::cout << "EqExpWithOpAST { ";
-  eqExp->Dump();
-  std::cout << "EqExpOpAST { " << eqOp << " } ";
-  relExp->Dump();
-  std::cout << "} ";
+bool EqExpWithOpAST::DumpStep(AstStack& stack) const {
+  return DumpChain(stack, chain, "EqExpWithOpAST", "EqExpOpAST");
 }
 
-std::pair<bool, int> EqExpWithOpAST::Output() const {
-  std::pair<bool, int> result_l = eqExp->Output();
-  int cnt_l = cnt - 1;
-
-  std::pair<bool, int> result_r = relExp->Output();
-  int cnt_r = cnt - 1;
-
-  std::unordered_map<std::string, std::string> dic = {
-      {"==", "eq"},
-      {"!=", "ne"},
+bool EqExpWithOpAST::OutputStep(AstStack& stack) const {
+  static const std::unordered_map<std::string, koopa_raw_binary_op_t> dic = {
+      {"==", KOOPA_RBO_EQ},
+      {"!=", KOOPA_RBO_NOT_EQ},
   };
 
-  if (result_l.first && result_r.first) {
-    str += "\t%";
-    str += std::to_string(cnt);
-    str += " = ";
-    str += dic[eqOp];
-    str += " ";
-    str += std::to_string(result_l.second);
-    str += ", ";
-    str += std::to_string(result_r.second);
-    str += "\n";
-    cnt++;
-
-  } else if (result_l.first) {
-    str += "\t%";
-    str += std::to_string(cnt);
-    str += " = ";
-    str += dic[eqOp];
-    str += " ";
-    str += std::to_string(result_l.second);
-    str += ", %";
-    str += std::to_string(cnt_r);
-    str += "\n";
-    cnt++;
-
-  } else if (result_r.first) {
-    str += "\t%";
-    str += std::to_string(cnt);
-    str += " = ";
-    str += dic[eqOp];
-    str += " %";
-    str += std::to_string(cnt_l);
-    str += ", ";
-    str += std::to_string(result_r.second);
-    str += "\n";
-    cnt++;
-
-  } else {
-    str += "\t%";
-    str += std::to_string(cnt);
-    str += " = ";
-    str += dic[eqOp];
-    str += " %";
-    str += std::to_string(cnt_l);
-    str += ", %";
-    str += std::to_string(cnt_r);
-    str += "\n";
-    cnt++;
-  }
-
-  return std::pair<bool, int>(false, 0);
+  return OutputChain(stack, chain, dic);
 }
 
-void LAndExpAST::Dump() const {
-  std::cout << "LAndExpAST { ";
-  eqExp->Dump();
+bool LAndExpAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "LAndExpAST { ";
+    return stack.Call(1, eqExp);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> LAndExpAST::Output() const {
-  return eqExp->Output();
+bool LAndExpAST::OutputStep(AstStack& stack) const {
+  return stack.Tail(eqExp);
 }
 
 /// @brief Convert non-0/1 input to 0/1
@@ -1373,488 +1458,254 @@ bool filter(int input) {
     return true;
   }
 
-  str += "\t%";
-  str += std::to_string(cnt);
-  str += " = ";
-  str += "ne";
-  str += " ";
-  str += std::to_string(input);
-  str += ", 0\n";
-  cnt++;
+  Def(ir_builder->Binary(KOOPA_RBO_NOT_EQ, ir_builder->Integer(input), ir_builder->Integer(0)));
 
   return false;
 }
 
-void LAndExpWithOpAST::Dump() const {
-  std::cout << "EqExpWithOpAST { ";
-  lAndExp->Dump();
-  std::cout << "EqExpOpAST { " << lAndOp << " } ";
-  eqExp->Dump();
-  std::cout << "} ";
-}
+// 短路求值的逻辑运算链 ((e0 op e1) op e2) ..., init 为短路时的结果, cond_op 与 0 比较得到是否计算右操作数
+// ssa_mode 下 %result_N 作为变量处理, 在 end 基本块汇合
+// 与逐层嵌套的二元节点生成相同的 IR: 先由外向内准备各层的 %result_N, 再从最内层开始求值
+// 第 i 个运算符的 if 编号为 frame.num - i, frame.values[i] 为非 ssa_mode 下其 %result_N 的位置
+// frame.index 为已完成的运算符个数, stack.result 为当前的左操作数
+static bool OutputLogicChain(AstStack& stack, const ast_chain_t<const char*>& chain, int init, koopa_raw_binary_op_t cond_op) {
+  auto& frame = stack.Top();
+  uint32_t n = chain.len - 1;
+
+  if (frame.state == 0) {
+    frame.values.resize(n);
+    for (uint32_t i = n; i-- > 0;) {
+      // SSA 形式下初值在发出分支的块中定义, 见下方
+      if (!ssa_mode) {
+        frame.values[i] = ir_builder->Alloc(VarName(VarKey(result_sym, if_cnt + 1)));
+        ir_builder->Store(ir_builder->Integer(init), frame.values[i]);
+      }
 
-std::pair<bool, int> LAndExpWithOpAST::Output() const {
-  str += "\t%result_";
-  str += std::to_string(if_cnt + 1);
-  str += " = alloc i32";
-  str += "\n";
-  str += "\tstore 0, %result_";
-  str += std::to_string(if_cnt + 1);
-  str += "\n";
-
-  if_cnt++;
-  int cur_if = if_cnt;
-
-  auto result_l = lAndExp->Output();
-  int cnt_l = cnt - 1;
-
-  if (result_l.first) {
-    str += "\t%";
-    str += std::to_string(cnt);
-    cnt++;
-    str += " = ne ";
-    str += std::to_string(result_l.second);
-    str += ", 0\n";
-  } else {
-    str += "\t%";
-    str += std::to_string(cnt);
-    cnt++;
-    str += " = ne %";
-    str += std::to_string(cnt_l);
-    str += ", 0\n";
-  }
-
-  str += "\tbr %";
-  str += std::to_string(cnt - 1);
-  str += ", %then";
-  str += "_";
-  str += std::to_string(cur_if);
-  str += ", %end";
-  str += "_";
-  str += std::to_string(cur_if);
-  str += "\n";
-
-  str += "%then";
-  str += "_";
-  str += std::to_string(cur_if);
-  str += ":\n";
-
-  auto result_r = eqExp->Output();
-  int cnt_r = cnt - 1;
-
-  if (result_r.first) {
-    str += "\t%";
-    str += std::to_string(cnt);
-    cnt++;
-    str += " = ne ";
-    str += std::to_string(result_r.second);
-    str += ", 0\n";
-  } else {
-    str += "\t%";
-    str += std::to_string(cnt);
-    cnt++;
-    str += " = ne %";
-    str += std::to_string(cnt_r);
-    str += ", 0\n";
-  }
-
-  str += "\tstore %";
-  str += std::to_string(cnt - 1);
-  str += ", %result_";
-  str += std::to_string(cur_if);
-  str += "\n";
-
-  str += "\tjump %end";
-  str += "_";
-  str += std::to_string(cur_if);
-  str += "\n";
-
-  str += "%end";
-  str += "_";
-  str += std::to_string(cur_if);
-  str += ":\n";
-
-  str += "\t%";
-  str += std::to_string(cnt);
-  cnt++;
-  str += " = load %result_";
-  str += std::to_string(cur_if);
-  str += "\n";
+      if_cnt++;
+    }
+    frame.num = if_cnt;
 
-  return std::make_pair(false, 0);
+    return stack.Call(1, chain.operands[0]);
+  }
+
+  auto zero = ir_builder->Integer(0);
+
+  if (frame.state == 2) {
+    // 第 frame.index 个运算符的右操作数已求出
+    uint32_t i = frame.index;
+    int cur_if = frame.num - i;
+    var_t result_var = VarKey(result_sym, cur_if);
+    std::string suffix = "_" + std::to_string(cur_if);
+
+    Def(ir_builder->Binary(KOOPA_RBO_NOT_EQ, Val(stack.result, cnt - 1), zero));
+
+    if (ssa_mode)
+      SSADef(result_var, std::pair<bool, int>(false, 0));
+    else
+      ir_builder->Store(values[cnt - 1], frame.values[i]);
+
+    EmitJump("%end" + suffix);
+
+    EmitLabel("%end" + suffix);
+
+    if (ssa_mode) {
+      stack.result = SSAUse(result_var);
+    } else {
+      Def(ir_builder->Load(frame.values[i]));
+      stack.result = std::make_pair(false, 0);
+    }
+    frame.index++;
+  }
+
+  if (frame.index == n)
+    return true;
+
+  int cur_if = frame.num - frame.index;
+  auto cond = Def(ir_builder->Binary(cond_op, Val(stack.result, cnt - 1), zero));
+
+  // 初值只在发出分支的块中定义, 结果变量不会跨越整条链存活, 链长为 n 时 phi 数为 O(n)
+  if (ssa_mode)
+    SSADef(VarKey(result_sym, cur_if), std::pair<bool, int>(true, init));
+
+  std::string suffix = "_" + std::to_string(cur_if);
+  EmitBranch(cond, "%then" + suffix, "%end" + suffix);
+
+  EmitLabel("%then" + suffix);
+
+  return stack.Call(2, chain.operands[frame.index + 1]);
 }
 
-void LOrExpAST::Dump() const {
-  std::cout << "LOrExpAST { ";
-  lAndExp->Dump();
-  std::cout << "} ";
+bool LAndExpWithOpAST::DumpStep(AstStack& stack) const {
+  return DumpChain(stack, chain, "EqExpWithOpAST", "EqExpOpAST");
 }
 
-std::pair<bool, int> LOrExpAST::Output() const {
-  return lAndExp->Output();
+bool LAndExpWithOpAST::OutputStep(AstStack& stack) const {
+  return OutputLogicChain(stack, chain, 0, KOOPA_RBO_NOT_EQ);
 }
 
-void LOrExpWithOpAST::Dump() const {
-  std::cout << "LOrExpWithOpAST { ";
-  lOrExp->Dump();
-  std::cout << "LOrExpOpAST { " << lOrOp << " } ";
-  lAndExp->Dump();
+bool LOrExpAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "LOrExpAST { ";
+    return stack.Call(1, lAndExp);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> LOrExpWithOpAST::Output() const {
-  str += "\t%result_";
-  str += std::to_string(if_cnt + 1);
-  str += " = alloc i32";
-  str += "\n";
-  str += "\tstore 1, %result_";
-  str += std::to_string(if_cnt + 1);
-  str += "\n";
-
-  if_cnt++;
-  int cur_if = if_cnt;
-
-  auto result_l = lOrExp->Output();
-  int cnt_l = cnt - 1;
-
-  if (result_l.first) {
-    str += "\t%";
-    str += std::to_string(cnt);
-    cnt++;
-    str += " = eq ";
-    str += std::to_string(result_l.second);
-    str += ", 0\n";
-  } else {
-    str += "\t%";
-    str += std::to_string(cnt);
-    cnt++;
-    str += " = eq %";
-    str += std::to_string(cnt_l);
-    str += ", 0\n";
-  }
-
-  str += "\tbr %";
-  str += std::to_string(cnt - 1);
-  str += ", %then";
-  str += "_";
-  str += std::to_string(cur_if);
-  str += ", %end";
-  str += "_";
-  str += std::to_string(cur_if);
-  str += "\n";
-
-  str += "%then";
-  str += "_";
-  str += std::to_string(cur_if);
-  str += ":\n";
-
-  auto result_r = lAndExp->Output();
-  int cnt_r = cnt - 1;
-
-  if (result_r.first) {
-    str += "\t%";
-    str += std::to_string(cnt);
-    cnt++;
-    str += " = ne ";
-    str += std::to_string(result_r.second);
-    str += ", 0\n";
-  } else {
-    str += "\t%";
-    str += std::to_string(cnt);
-    cnt++;
-    str += " = ne %";
-    str += std::to_string(cnt_r);
-    str += ", 0\n";
-  }
-
-  str += "\tstore %";
-  str += std::to_string(cnt - 1);
-  str += ", %result_";
-  str += std::to_string(cur_if);
-  str += "\n";
-
-  str += "\tjump %end";
-  str += "_";
-  str += std::to_string(cur_if);
-  str += "\n";
-
-  str += "%end";
-  str += "_";
-  str += std::to_string(cur_if);
-  str += ":\n";
-
-  str += "\t%";
-  str += std::to_string(cnt);
-  cnt++;
-  str += " = load %result_";
-  str += std::to_string(cur_if);
-  str += "\n";
+bool LOrExpAST::OutputStep(AstStack& stack) const {
+  return stack.Tail(lAndExp);
+}
+
+bool LOrExpWithOpAST::DumpStep(AstStack& stack) const {
+  return DumpChain(stack, chain, "LOrExpWithOpAST", "LOrExpOpAST");
+}
 
-  return std::make_pair(false, 0);
+bool LOrExpWithOpAST::OutputStep(AstStack& stack) const {
+  return OutputLogicChain(stack, chain, 1, KOOPA_RBO_EQ);
 }
 
-void ConstExpAST::Dump() const {
-  std::cout << "ConstExpAST { ";
-  exp->Dump();
+bool ConstExpAST::DumpStep(AstStack& stack) const {
+  if (stack.Top().state == 0) {
+    std::cout << "ConstExpAST { ";
+    return stack.Call(1, exp);
+  }
   std::cout << "} ";
+  return true;
 }
 
-std::pair<bool, int> ConstExpAST::Output() const {
-  return exp->Output();
-}
-
-int search(const ConstExpAST* constExp) {
-  return search((ExpAST*)constExp->exp.get());
-}
-
-int search(const ExpAST* exp) {
-  auto lOrExp = exp->lOrExp.get();
-  if (typeid(*lOrExp) == typeid(LOrExpAST))
-    return search((LOrExpAST*)lOrExp);
-  else if (typeid(*lOrExp) == typeid(LOrExpWithOpAST))
-    return search((LOrExpWithOpAST*)lOrExp);
-  return 0;
-}
-
-int search(const LOrExpAST* lOrExp) {
-  auto lAndExp = lOrExp->lAndExp.get();
-  if (typeid(*lAndExp) == typeid(LAndExpAST))
-    return search((LAndExpAST*)lAndExp);
-  else if (typeid(*lAndExp) == typeid(LAndExpWithOpAST))
-    return search((LAndExpWithOpAST*)lAndExp);
-  return 0;
-}
-
-int search(const LOrExpWithOpAST* lOrExp) {
-  int lhs = 0;
-  auto exp_l = lOrExp->lOrExp.get();
-  if (typeid(*exp_l) == typeid(LOrExpAST))
-    lhs = search((LOrExpAST*)exp_l);
-  else if (typeid(*exp_l) == typeid(LOrExpWithOpAST))
-    lhs = search((LOrExpWithOpAST*)exp_l);
-
-  int rhs = 0;
-  auto exp_r = lOrExp->lAndExp.get();
-  if (typeid(*exp_r) == typeid(LAndExpAST))
-    rhs = search((LAndExpAST*)exp_r);
-  else if (typeid(*exp_r) == typeid(LAndExpWithOpAST))
-    rhs = search((LAndExpWithOpAST*)exp_r);
-
-  return lhs || rhs;
-}
-
-int search(const LAndExpAST* lAndExp) {
-  auto eqExp = lAndExp->eqExp.get();
-  if (typeid(*eqExp) == typeid(EqExpAST))
-    return search((EqExpAST*)eqExp);
-  else if (typeid(*eqExp) == typeid(EqExpWithOpAST))
-    return search((EqExpWithOpAST*)eqExp);
-  return 0;
-}
-
-int search(const LAndExpWithOpAST* lAndExp) {
-  int lhs = 0;
-  auto exp_l = lAndExp->lAndExp.get();
-  if (typeid(*exp_l) == typeid(LAndExpAST))
-    lhs = search((LAndExpAST*)exp_l);
-  else if (typeid(*exp_l) == typeid(LAndExpWithOpAST))
-    lhs = search((LAndExpWithOpAST*)exp_l);
-
-  int rhs = 0;
-  auto exp_r = lAndExp->eqExp.get();
-  if (typeid(*exp_r) == typeid(EqExpAST))
-    rhs = search((EqExpAST*)exp_r);
-  else if (typeid(*exp_r) == typeid(EqExpWithOpAST))
-    rhs = search((EqExpWithOpAST*)exp_r);
-
-  return lhs && rhs;
-}
-
-int search(const EqExpAST* eqExp) {
-  auto relExp = eqExp->relExp.get();
-  if (typeid(*relExp) == typeid(RelExpAST))
-    return search((RelExpAST*)relExp);
-  else if (typeid(*relExp) == typeid(RelExpWithOpAST))
-    return search((RelExpWithOpAST*)relExp);
-  return 0;
-}
-
-int search(const EqExpWithOpAST* eqExp) {
-  int lhs = 0;
-  auto exp_l = eqExp->eqExp.get();
-  if (typeid(*exp_l) == typeid(EqExpAST))
-    lhs = search((EqExpAST*)exp_l);
-  else if (typeid(*exp_l) == typeid(EqExpWithOpAST))
-    lhs = search((EqExpWithOpAST*)exp_l);
-
-  int rhs = 0;
-  auto exp_r = eqExp->relExp.get();
-  if (typeid(*exp_r) == typeid(RelExpAST))
-    rhs = search((RelExpAST*)exp_r);
-  else if (typeid(*exp_r) == typeid(RelExpWithOpAST))
-    rhs = search((RelExpWithOpAST*)exp_r);
-
-  if (eqExp->eqOp == "==")
-    return lhs == rhs;
-  else if (eqExp->eqOp == "!=")
-    return lhs != rhs;
-  else
-    assert(false);
+bool ConstExpAST::OutputStep(AstStack& stack) const {
+  return stack.Return(std::pair<bool, int>(true, search(this)));
+}
 
-  return 0;
-}
-
-int search(const RelExpAST* relExp) {
-  auto addExp = relExp->addExp.get();
-  if (typeid(*addExp) == typeid(AddExpAST))
-    return search((AddExpAST*)addExp);
-  else if (typeid(*addExp) == typeid(AddExpWithOpAST))
-    return search((AddExpWithOpAST*)addExp);
-  return 0;
-}
-
-int search(const RelExpWithOpAST* relExp) {
-  int lhs = 0;
-  auto exp_l = relExp->relExp.get();
-  if (typeid(*exp_l) == typeid(RelExpAST))
-    lhs = search((RelExpAST*)exp_l);
-  else if (typeid(*exp_l) == typeid(RelExpWithOpAST))
-    lhs = search((RelExpWithOpAST*)exp_l);
-
-  int rhs = 0;
-  auto exp_r = relExp->addExp.get();
-  if (typeid(*exp_r) == typeid(AddExpAST))
-    rhs = search((AddExpAST*)exp_r);
-  else if (typeid(*exp_r) == typeid(AddExpWithOpAST))
-    rhs = search((AddExpWithOpAST*)exp_r);
-
-  if (relExp->relOp == "<")
-    return lhs < rhs;
-  else if (relExp->relOp == ">")
-    return lhs > rhs;
-  else if (relExp->relOp == "<=")
-    return lhs <= rhs;
-  else if (relExp->relOp == ">=")
-    return lhs >= rhs;
-  else
-    assert(false);
+// 常量表达式求值器, 通过 VisitAst 按节点类别分派, 在 AstStack 上后序求值
+// 每个节点完成时以 Return 给出自身的值, 父节点恢复后从 stack.result 读取
+struct ConstEvaluator {
+  AstStack& stack;
 
-  return 0;
-}
-
-int search(const AddExpAST* addExp) {
-  auto mulExp = addExp->mulExp.get();
-  if (typeid(*mulExp) == typeid(MulExpAST))
-    return search((MulExpAST*)mulExp);
-  else if (typeid(*mulExp) == typeid(MulExpWithOpAST))
-    return search((MulExpWithOpAST*)mulExp);
-  return 0;
-}
-
-int search(const AddExpWithOpAST* addExp) {
-  int lhs = 0;
-  auto exp_l = addExp->addExp.get();
-  if (typeid(*exp_l) == typeid(AddExpAST))
-    lhs = search((AddExpAST*)exp_l);
-  else if (typeid(*exp_l) == typeid(AddExpWithOpAST))
-    lhs = search((AddExpWithOpAST*)exp_l);
-
-  int rhs = 0;
-  auto exp_r = addExp->mulExp.get();
-  if (typeid(*exp_r) == typeid(MulExpAST))
-    rhs = search((MulExpAST*)exp_r);
-  else if (typeid(*exp_r) == typeid(MulExpWithOpAST))
-    rhs = search((MulExpWithOpAST*)exp_r);
-
-  if (addExp->addOp == '+')
-    return lhs + rhs;
-  else if (addExp->addOp == '-')
-    return lhs - rhs;
-  else
-    assert(false);
+  int Value() const { return stack.result.second; }
+  bool Return(int value) { return stack.Return(std::pair<bool, int>(true, value)); }
 
-  return 0;
-}
-
-int search(const MulExpAST* mulExp) {
-  auto unaryExp = mulExp->unaryExp.get();
-  if (typeid(*unaryExp) == typeid(UnaryExpAST))
-    return search((UnaryExpAST*)unaryExp);
-  else if (typeid(*unaryExp) == typeid(UnaryExpWithOpAST))
-    return search((UnaryExpWithOpAST*)unaryExp);
-  return 0;
-}
-
-int search(const MulExpWithOpAST* mulExp) {
-  int lhs = 0;
-  auto exp_l = mulExp->mulExp.get();
-  if (typeid(*exp_l) == typeid(MulExpAST))
-    lhs = search((MulExpAST*)exp_l);
-  else if (typeid(*exp_l) == typeid(MulExpWithOpAST))
-    lhs = search((MulExpWithOpAST*)exp_l);
-
-  int rhs = 0;
-  auto exp_r = mulExp->unaryExp.get();
-  if (typeid(*exp_r) == typeid(UnaryExpAST))
-    rhs = search((UnaryExpAST*)exp_r);
-  else if (typeid(*exp_r) == typeid(UnaryExpWithOpAST))
-    rhs = search((UnaryExpWithOpAST*)exp_r);
-
-  if (mulExp->mulOp == '*')
-    return lhs * rhs;
-  else if (mulExp->mulOp == '/')
-    return lhs / rhs;
-  else if (mulExp->mulOp == '%')
-    return lhs % rhs;
-  else
-    assert(false);
+  // 从左到右依次计算运算链, frame.index 为已开始计算的操作数个数, frame.num 为左操作数的值
+  template <typename Op, typename Apply>
+  bool EvalChain(const ast_chain_t<Op>& chain, Apply apply) {
+    auto& frame = stack.Top();
+    if (frame.state != 0)
+      frame.num = frame.index == 1 ? Value() : apply(chain.ops[frame.index - 2], frame.num, Value());
+    if (frame.index < chain.len)
+      return stack.Call(1, chain.operands[frame.index++]);
+    return Return(frame.num);
+  }
 
-  return 0;
-}
+  bool operator()(const ConstExpAST* constExp) {
+    // 常量表达式的值只求一次, 后续使用 (IR 生成等) 直接读取
+    if (constExp->evaluated)
+      return Return(constExp->value);
+    if (stack.Top().state == 0)
+      return stack.Call(1, constExp->exp);
+    constExp->value = Value();
+    constExp->evaluated = true;
+    return Return(constExp->value);
+  }
+  bool operator()(const ExpAST* exp) { return stack.Tail(exp->lOrExp); }
+  bool operator()(const LOrExpAST* lOrExp) { return stack.Tail(lOrExp->lAndExp); }
+  bool operator()(const LAndExpAST* lAndExp) { return stack.Tail(lAndExp->eqExp); }
+  bool operator()(const EqExpAST* eqExp) { return stack.Tail(eqExp->relExp); }
+  bool operator()(const RelExpAST* relExp) { return stack.Tail(relExp->addExp); }
+  bool operator()(const AddExpAST* addExp) { return stack.Tail(addExp->mulExp); }
+  bool operator()(const MulExpAST* mulExp) { return stack.Tail(mulExp->unaryExp); }
+  bool operator()(const UnaryExpAST* unaryExp) { return stack.Tail(unaryExp->primaryExp); }
+  bool operator()(const PrimaryExpWithBrAST* primaryExp) { return stack.Tail(primaryExp->exp); }
+  bool operator()(const PrimaryExpWithLValAST* primaryExp) { return stack.Tail(primaryExp->lVal); }
+  bool operator()(const PrimaryExpWithNumAST* primaryExp) { return Return(primaryExp->number); }
+
+  bool operator()(const LValAST* lVal) {
+    assert(lVal->symbol->type == CONSTANT);
+    return Return(lVal->symbol->value.val);
+  }
 
-int search(const UnaryExpAST* unaryExp) {
-  auto primaryExp = unaryExp->primaryExp.get();
-  if (typeid(*primaryExp) == typeid(PrimaryExpWithBrAST))
-    return search((PrimaryExpWithBrAST*)primaryExp);
-  else if (typeid(*primaryExp) == typeid(PrimaryExpWithLValAST))
-    return search((PrimaryExpWithLValAST*)primaryExp);
-  else if (typeid(*primaryExp) == typeid(PrimaryExpWithNumAST))
-    return search((PrimaryExpWithNumAST*)primaryExp);
-  return 0;
-}
+  bool operator()(const LOrExpWithOpAST* lOrExp) {
+    return EvalChain(lOrExp->chain, [](const char*, int lhs, int rhs) { return lhs || rhs; });
+  }
 
-int search(const UnaryExpWithOpAST* unaryExp) {
-  auto exp = unaryExp->unaryExp.get();
-  int number = search((UnaryExpAST*)exp);
+  bool operator()(const LAndExpWithOpAST* lAndExp) {
+    return EvalChain(lAndExp->chain, [](const char*, int lhs, int rhs) { return lhs && rhs; });
+  }
 
-  if (unaryExp->unaryOp == '+')
-    return number;
-  else if (unaryExp->unaryOp == '-')
-    return -number;
-  else if (unaryExp->unaryOp == '!')
-    return !number;
-  else
-    assert(false);
+  bool operator()(const EqExpWithOpAST* eqExp) {
+    return EvalChain(eqExp->chain, [](const char* op, int lhs, int rhs) {
+      if (!strcmp(op, "=="))
+        return lhs == rhs;
+      else if (!strcmp(op, "!="))
+        return lhs != rhs;
+      assert(false);
+      return false;
+    });
+  }
 
-  return 0;
-}
+  bool operator()(const RelExpWithOpAST* relExp) {
+    return EvalChain(relExp->chain, [](const char* op, int lhs, int rhs) {
+      if (!strcmp(op, "<"))
+        return lhs < rhs;
+      else if (!strcmp(op, ">"))
+        return lhs > rhs;
+      else if (!strcmp(op, "<="))
+        return lhs <= rhs;
+      else if (!strcmp(op, ">="))
+        return lhs >= rhs;
+      assert(false);
+      return false;
+    });
+  }
 
-int search(const PrimaryExpWithBrAST* primaryExp) {
-  return search((ExpAST*)primaryExp->exp.get());
-}
+  bool operator()(const AddExpWithOpAST* addExp) {
+    return EvalChain(addExp->chain, [](char op, int lhs, int rhs) {
+      if (op == '+')
+        return lhs + rhs;
+      else if (op == '-')
+        return lhs - rhs;
+      assert(false);
+      return 0;
+    });
+  }
 
-int search(const PrimaryExpWithLValAST* primaryExp) {
-  return search((LValAST*)primaryExp->lVal.get());
-}
+  bool operator()(const MulExpWithOpAST* mulExp) {
+    return EvalChain(mulExp->chain, [](char op, int lhs, int rhs) {
+      if (op == '*')
+        return lhs * rhs;
+      else if (op == '/')
+        return lhs / rhs;
+      else if (op == '%')
+        return lhs % rhs;
+      assert(false);
+      return 0;
+    });
+  }
 
-int search(const PrimaryExpWithNumAST* primaryExp) {
-  return primaryExp->number;
-}
+  bool operator()(const UnaryExpWithOpAST* unaryExp) {
+    if (stack.Top().state == 0)
+      return stack.Call(1, unaryExp->unaryExp);
+    int number = Value();
+    if (unaryExp->unaryOp == '+')
+      return Return(number);
+    else if (unaryExp->unaryOp == '-')
+      return Return(-number);
+    else if (unaryExp->unaryOp == '!')
+      return Return(!number);
+    assert(false);
+    return true;
+  }
 
-int search(const LValAST* lVal) {
-  auto result = fetchSymbol(lVal->ident);
-  if (std::get<0>(result) == CONSTANT)
-    return std::get<1>(result);
-  assert(false);
-  return 0;
-}
\ No newline at end of file
+  // 其余节点 (如函数调用) 不能出现在常量表达式中
+  template <typename T>
+  bool operator()(const T*) {
+    assert(false);
+    return true;
+  }
+};
+
+int search(const BaseAST* exp) {
+  AstStack stack(exp);
+  ConstEvaluator evaluator{stack};
+  stack.Run([&](BaseAST* node) { return VisitAst(node, evaluator); });
+  return stack.result.second;
+}
@@ -1,434 +1,879 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
+#include "intern.hpp"
+#include "irbuilder.hpp"
 #include "koopa.h"
 
-extern std::string str;
+// AST 生成的 IR 写入该 builder, 每个线程一个
+extern thread_local IRBuilder* ir_builder;
+// 生成 IR 时直接构造 SSA 形式, 局部变量不经过 alloc/load/store
+extern bool ssa_mode;
+
+class BaseAST;
+
+// AST 节点的内存池
+// 节点在其中连续分配, 不单独释放, 也不调用析构函数, 由 Clear 整体释放
+// 因此节点中不能包含需要析构的成员, 子节点列表同样存放在内存池中, 标识符以驻留后的编号保存
+class AstArena {
+ public:
+  AstArena() = default;
+  AstArena(const AstArena&) = delete;
+  AstArena& operator=(const AstArena&) = delete;
+  ~AstArena() { Clear(); }
+
+  void* Alloc(size_t size);
+  // 释放所有节点
+  void Clear();
+  // 释放所有节点, 保留一个内存块供之后的节点复用
+  void Reset();
+  // 交换两个内存池中的节点, 用于将已分配的节点整体交给另一个线程
+  void Swap(AstArena& other);
+
+ private:
+  std::vector<char*> chunks;
+  size_t used = 0;
+  size_t capacity = 0;
+};
+
+// 每个线程有自己的 ast_arena, 流水线编译时语法分析与 IR 生成在不同线程中分配互不影响
+extern thread_local AstArena ast_arena;
+
+// 子节点列表, 存放在 ast_arena 中
+typedef struct {
+  BaseAST** items;
+  uint32_t len;
+
+  BaseAST** begin() const { return items; }
+  BaseAST** end() const { return items + len; }
+  size_t size() const { return len; }
+  BaseAST* operator[](size_t i) const { return items[i]; }
+} ast_list_t;
+
+// 将 first 与 rest 依次复制到 ast_arena 中, first 为空时只复制 rest
+ast_list_t AstList(BaseAST* first, const std::vector<BaseAST*>& rest);
+
+// 同一优先级的左结合运算链: operands[0] ops[0] operands[1] ... ops[len - 2] operands[len - 1]
+// 语法分析时逐个追加, 存放在 ast_arena 中, 容量不足时按两倍重新分配
+template <typename Op>
+struct ast_chain_t {
+  BaseAST** operands = nullptr;
+  Op* ops = nullptr;
+  uint32_t len = 0;
+  uint32_t cap = 0;
+
+  // 追加第一个操作数
+  void Push(BaseAST* operand) {
+    if (len == cap)
+      Grow();
+    operands[len++] = operand;
+  }
+
+  // 追加运算符及其右操作数
+  void Push(Op op, BaseAST* operand) {
+    if (len == cap)
+      Grow();
+    ops[len - 1] = op;
+    operands[len++] = operand;
+  }
+
+  void Grow() {
+    uint32_t new_cap = cap ? cap * 2 : 2;
+    auto new_operands = static_cast<BaseAST**>(ast_arena.Alloc(new_cap * sizeof(BaseAST*)));
+    auto new_ops = static_cast<Op*>(ast_arena.Alloc(new_cap * sizeof(Op)));
+    std::copy(operands, operands + len, new_operands);
+    if (len > 0)
+      std::copy(ops, ops + len - 1, new_ops);
+    operands = new_operands;
+    ops = new_ops;
+    cap = new_cap;
+  }
+};
+
+// 遍历 AST 时一个节点的栈帧
+typedef struct {
+  BaseAST* node;
+  // 恢复点, 节点第一次执行时为 0
+  int state;
+  // 节点在等待子节点期间需要保留的局部变量
+  uint32_t index;
+  int num;
+  bool flag;
+  std::pair<bool, int> result;
+  std::vector<koopa_raw_value_t> values;
+} ast_frame_t;
+
+// 遍历 AST 的显式栈, 代替 C++ 调用栈, 嵌套深度只受堆内存限制
+// 节点的步进函数每次从栈顶栈帧的 state 处继续执行: 返回 true 表示节点已完成, 出栈;
+// 需要子节点时由 Call 记录恢复点并压入子节点, 返回 false, 子节点完成后再次执行该节点
+class AstStack {
+ public:
+  explicit AstStack(const BaseAST* root) { Push(root); }
+
+  ast_frame_t& Top() { return frames.back(); }
+
+  // 反复执行栈顶节点的步进函数, 直到栈空
+  template <typename Step>
+  void Run(Step step) {
+    while (!frames.empty())
+      if (step(frames.back().node))
+        frames.pop_back();
+  }
+
+  // 记录当前节点的恢复点并压入子节点, 之后不能再使用当前栈帧的引用
+  bool Call(int state, const BaseAST* child) {
+    frames.back().state = state;
+    Push(child);
+    return false;
+  }
+
+  // 当前节点余下的工作只是遍历 child 并以其结果为自身结果时, 由 child 代替当前栈帧
+  bool Tail(const BaseAST* child) {
+    frames.pop_back();
+    Push(child);
+    return false;
+  }
+
+  // 设置结果并完成当前节点
+  bool Return(std::pair<bool, int> value) {
+    result = value;
+    return true;
+  }
+
+  // 最近完成的节点的结果, 用于 Output 与常量求值
+  std::pair<bool, int> result;
+
+ private:
+  std::vector<ast_frame_t> frames;
+
+  void Push(const BaseAST* node) {
+    frames.push_back(ast_frame_t{const_cast<BaseAST*>(node), 0, 0, 0, false, {false, 0}, {}});
+  }
+};
+
+// AST 节点的类别, 每个节点类对应一个, 用于不经过 RTTI 的分派
+enum class ast_kind_t : uint8_t {
+  COMP_UNIT,
+  COMP_UNIT_SUB_WITH_DECL,
+  COMP_UNIT_SUB_WITH_FUNC,
+  DECL_WITH_CONST,
+  DECL_WITH_VAR,
+  CONST_DECL,
+  CONST_DEF,
+  CONST_INIT_VAL,
+  VAR_DECL,
+  VAR_DEF,
+  VAR_DEF_WITH_ASSIGN,
+  INIT_VAL,
+  FUNC_DEF,
+  FUNC_F_PARAMS,
+  FUNC_F_PARAM,
+  BLOCK,
+  BLOCK_ITEM_WITH_DECL,
+  BLOCK_ITEM_WITH_STMT,
+  STMT_WITH_ASSIGN,
+  STMT_WITH_EXP,
+  STMT_WITH_BLOCK,
+  STMT_WITH_IF,
+  STMT_WITH_WHILE,
+  STMT_WITH_BREAK,
+  STMT_WITH_CONTINUE,
+  STMT_WITH_RETURN,
+  EXP,
+  L_VAL,
+  PRIMARY_EXP_WITH_BR,
+  PRIMARY_EXP_WITH_L_VAL,
+  PRIMARY_EXP_WITH_NUM,
+  UNARY_EXP,
+  UNARY_EXP_WITH_FUNC,
+  UNARY_EXP_WITH_OP,
+  FUNC_R_PARAMS,
+  MUL_EXP,
+  MUL_EXP_WITH_OP,
+  ADD_EXP,
+  ADD_EXP_WITH_OP,
+  REL_EXP,
+  REL_EXP_WITH_OP,
+  EQ_EXP,
+  EQ_EXP_WITH_OP,
+  L_AND_EXP,
+  L_AND_EXP_WITH_OP,
+  L_OR_EXP,
+  L_OR_EXP_WITH_OP,
+  CONST_EXP,
+};
+
+// 名字解析得到的符号, 定义见 resolve.hpp
+struct stored_object;
 
 // 所有 AST 的基类
+// 节点由 ast_arena 分配, 子节点以指针链接, 不拥有子节点
 class BaseAST {
  public:
+  // 节点类别, 由子类构造时设置
+  const ast_kind_t kind;
+
+  explicit BaseAST(ast_kind_t kind) : kind(kind) {}
   virtual ~BaseAST() = default;
 
+  static void* operator new(size_t size) { return ast_arena.Alloc(size); }
+  static void operator delete(void*) {}
+
   // Print AST Structures
-  virtual void Dump() const = 0;
+  void Dump() const;
+  // Resolve names, 在 Output 之前进行
+  void Resolve();
   // Output Koopa IR
-  virtual std::pair<bool, int> Output() const = 0;
+  std::pair<bool, int> Output() const;
+
+  // 以上遍历都在 AstStack 上进行, 每个节点实现对应的步进函数
+  virtual bool DumpStep(AstStack& stack) const = 0;
+  virtual bool ResolveStep(AstStack& stack) = 0;
+  virtual bool OutputStep(AstStack& stack) const = 0;
 };
 
 class CompUnitAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> sub;
+  CompUnitAST() : BaseAST(ast_kind_t::COMP_UNIT) {}
+  BaseAST* sub;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class CompUnitSubWithDeclAST : public BaseAST {
  public:
-  std::optional<std::unique_ptr<BaseAST>> compUnit;
-  std::unique_ptr<BaseAST> decl;
+  CompUnitSubWithDeclAST() : BaseAST(ast_kind_t::COMP_UNIT_SUB_WITH_DECL) {}
+  BaseAST* compUnit = nullptr;
+  BaseAST* decl;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class CompUnitSubWithFuncAST : public BaseAST {
  public:
-  std::optional<std::unique_ptr<BaseAST>> compUnit;
-  std::unique_ptr<BaseAST> func_def;
+  CompUnitSubWithFuncAST() : BaseAST(ast_kind_t::COMP_UNIT_SUB_WITH_FUNC) {}
+  BaseAST* compUnit = nullptr;
+  BaseAST* func_def;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class DeclWithConstAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> constDecl;
+  DeclWithConstAST() : BaseAST(ast_kind_t::DECL_WITH_CONST) {}
+  BaseAST* constDecl;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class DeclWithVarAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> varDecl;
+  DeclWithVarAST() : BaseAST(ast_kind_t::DECL_WITH_VAR) {}
+  BaseAST* varDecl;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class ConstDeclAST : public BaseAST {
  public:
-  std::string bType;
-  std::vector<std::unique_ptr<BaseAST>> constDefList;
+  ConstDeclAST() : BaseAST(ast_kind_t::CONST_DECL) {}
+  const char* bType;
+  ast_list_t constDefList;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class ConstDefAST : public BaseAST {
  public:
-  std::string ident;
-  std::unique_ptr<BaseAST> constInitVal;
+  ConstDefAST() : BaseAST(ast_kind_t::CONST_DEF) {}
+  symbol_t ident;
+  BaseAST* constInitVal;
+  // 声明的符号
+  stored_object* symbol = nullptr;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class ConstInitValAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> constExp;
+  ConstInitValAST() : BaseAST(ast_kind_t::CONST_INIT_VAL) {}
+  BaseAST* constExp;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class VarDeclAST : public BaseAST {
  public:
-  std::string bType;
-  std::vector<std::unique_ptr<BaseAST>> varDefList;
+  VarDeclAST() : BaseAST(ast_kind_t::VAR_DECL) {}
+  const char* bType;
+  ast_list_t varDefList;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class VarDefAST : public BaseAST {
  public:
-  std::string ident;
+  VarDefAST() : BaseAST(ast_kind_t::VAR_DEF) {}
+  symbol_t ident;
+  // 声明的符号
+  stored_object* symbol = nullptr;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class VarDefWithAssignAST : public BaseAST {
  public:
-  std::string ident;
-  std::unique_ptr<BaseAST> initVal;
+  VarDefWithAssignAST() : BaseAST(ast_kind_t::VAR_DEF_WITH_ASSIGN) {}
+  symbol_t ident;
+  BaseAST* initVal;
+  // 声明的符号
+  stored_object* symbol = nullptr;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class InitValAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> exp;
+  InitValAST() : BaseAST(ast_kind_t::INIT_VAL) {}
+  BaseAST* exp;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class FuncDefAST : public BaseAST {
  public:
-  std::string funcType;
-  std::string ident;
-  std::optional<std::unique_ptr<BaseAST>> params;
-  std::unique_ptr<BaseAST> block;
+  FuncDefAST() : BaseAST(ast_kind_t::FUNC_DEF) {}
+  const char* funcType;
+  symbol_t ident;
+  BaseAST* params = nullptr;
+  BaseAST* block;
+  // 声明的符号
+  stored_object* symbol = nullptr;
+  // 以下由名字解析求出: 函数自身 (参数所在) 的块编号, 函数中第一个 if 与 while 的编号
+  int blockId = 0;
+  int firstIf = 0;
+  int firstWhile = 0;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class FuncFParamsAST : public BaseAST {
  public:
-  std::vector<std::unique_ptr<BaseAST>> paramList;
+  FuncFParamsAST() : BaseAST(ast_kind_t::FUNC_F_PARAMS) {}
+  ast_list_t paramList;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 
   void declare();
 };
 
 class FuncFParamAST : public BaseAST {
  public:
-  std::string bType;
-  std::string ident;
+  FuncFParamAST() : BaseAST(ast_kind_t::FUNC_F_PARAM) {}
+  const char* bType;
+  symbol_t ident;
+  // 声明的符号
+  stored_object* symbol = nullptr;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 
-  void declare();
+  void declare(koopa_raw_value_t param);
 };
 
 class BlockAST : public BaseAST {
  public:
-  std::vector<std::unique_ptr<BaseAST>> blockItemList;
+  BlockAST() : BaseAST(ast_kind_t::BLOCK) {}
+  ast_list_t blockItemList;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class BlockItemWithDeclAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> decl;
+  BlockItemWithDeclAST() : BaseAST(ast_kind_t::BLOCK_ITEM_WITH_DECL) {}
+  BaseAST* decl;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class BlockItemWithStmtAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> stmt;
+  BlockItemWithStmtAST() : BaseAST(ast_kind_t::BLOCK_ITEM_WITH_STMT) {}
+  BaseAST* stmt;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class StmtWithAssignAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> lVal;
-  std::unique_ptr<BaseAST> exp;
+  StmtWithAssignAST() : BaseAST(ast_kind_t::STMT_WITH_ASSIGN) {}
+  BaseAST* lVal;
+  BaseAST* exp;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class StmtWithExpAST : public BaseAST {
  public:
-  std::optional<std::unique_ptr<BaseAST>> exp;
+  StmtWithExpAST() : BaseAST(ast_kind_t::STMT_WITH_EXP) {}
+  BaseAST* exp = nullptr;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class StmtWithBlockAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> block;
+  StmtWithBlockAST() : BaseAST(ast_kind_t::STMT_WITH_BLOCK) {}
+  BaseAST* block;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class StmtWithIfAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> exp;
-  std::unique_ptr<BaseAST> if_stmt;
-  std::optional<std::unique_ptr<BaseAST>> else_stmt;
+  StmtWithIfAST() : BaseAST(ast_kind_t::STMT_WITH_IF) {}
+  BaseAST* exp;
+  BaseAST* if_stmt;
+  BaseAST* else_stmt = nullptr;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class StmtWithWhileAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> exp;
-  std::unique_ptr<BaseAST> stmt;
+  StmtWithWhileAST() : BaseAST(ast_kind_t::STMT_WITH_WHILE) {}
+  BaseAST* exp;
+  BaseAST* stmt;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class StmtWithBreakAST : public BaseAST {
  public:
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  StmtWithBreakAST() : BaseAST(ast_kind_t::STMT_WITH_BREAK) {}
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class StmtWithContinueAST : public BaseAST {
  public:
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  StmtWithContinueAST() : BaseAST(ast_kind_t::STMT_WITH_CONTINUE) {}
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class StmtWithReturnAST : public BaseAST {
  public:
-  std::optional<std::unique_ptr<BaseAST>> exp;
+  StmtWithReturnAST() : BaseAST(ast_kind_t::STMT_WITH_RETURN) {}
+  BaseAST* exp = nullptr;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class ExpAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> lOrExp;
+  ExpAST() : BaseAST(ast_kind_t::EXP) {}
+  BaseAST* lOrExp;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class LValAST : public BaseAST {
  public:
-  std::string ident;
+  LValAST() : BaseAST(ast_kind_t::L_VAL) {}
+  symbol_t ident;
+  // 名字解析得到的符号
+  stored_object* symbol = nullptr;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class PrimaryExpWithBrAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> exp;
+  PrimaryExpWithBrAST() : BaseAST(ast_kind_t::PRIMARY_EXP_WITH_BR) {}
+  BaseAST* exp;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class PrimaryExpWithLValAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> lVal;
+  PrimaryExpWithLValAST() : BaseAST(ast_kind_t::PRIMARY_EXP_WITH_L_VAL) {}
+  BaseAST* lVal;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class PrimaryExpWithNumAST : public BaseAST {
  public:
+  PrimaryExpWithNumAST() : BaseAST(ast_kind_t::PRIMARY_EXP_WITH_NUM) {}
   int number;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class UnaryExpAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> primaryExp;
+  UnaryExpAST() : BaseAST(ast_kind_t::UNARY_EXP) {}
+  BaseAST* primaryExp;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class UnaryExpWithFuncAST : public BaseAST {
  public:
-  std::string ident;
-  std::optional<std::unique_ptr<BaseAST>> params;
+  UnaryExpWithFuncAST() : BaseAST(ast_kind_t::UNARY_EXP_WITH_FUNC) {}
+  symbol_t ident;
+  BaseAST* params = nullptr;
+  // 名字解析得到的符号
+  stored_object* symbol = nullptr;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class UnaryExpWithOpAST : public BaseAST {
  public:
+  UnaryExpWithOpAST() : BaseAST(ast_kind_t::UNARY_EXP_WITH_OP) {}
   char unaryOp;
-  std::unique_ptr<BaseAST> unaryExp;
+  BaseAST* unaryExp;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class FuncRParamsAST : public BaseAST {
  public:
-  std::vector<std::unique_ptr<BaseAST>> paramList;
+  FuncRParamsAST() : BaseAST(ast_kind_t::FUNC_R_PARAMS) {}
+  ast_list_t paramList;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
-  std::vector<std::pair<bool, int>> prepare();
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class MulExpAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> unaryExp;
+  MulExpAST() : BaseAST(ast_kind_t::MUL_EXP) {}
+  BaseAST* unaryExp;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class MulExpWithOpAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> mulExp;
-  char mulOp;
-  std::unique_ptr<BaseAST> unaryExp;
+  MulExpWithOpAST() : BaseAST(ast_kind_t::MUL_EXP_WITH_OP) {}
+  // 第一个操作数为 MulExpAST, 其余为 UnaryExp
+  ast_chain_t<char> chain;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class AddExpAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> mulExp;
+  AddExpAST() : BaseAST(ast_kind_t::ADD_EXP) {}
+  BaseAST* mulExp;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class AddExpWithOpAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> addExp;
-  char addOp;
-  std::unique_ptr<BaseAST> mulExp;
+  AddExpWithOpAST() : BaseAST(ast_kind_t::ADD_EXP_WITH_OP) {}
+  // 第一个操作数为 AddExpAST, 其余为 MulExp
+  ast_chain_t<char> chain;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class RelExpAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> addExp;
+  RelExpAST() : BaseAST(ast_kind_t::REL_EXP) {}
+  BaseAST* addExp;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class RelExpWithOpAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> relExp;
-  std::string relOp;
-  std::unique_ptr<BaseAST> addExp;
+  RelExpWithOpAST() : BaseAST(ast_kind_t::REL_EXP_WITH_OP) {}
+  // 第一个操作数为 RelExpAST, 其余为 AddExp
+  ast_chain_t<const char*> chain;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class EqExpAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> relExp;
+  EqExpAST() : BaseAST(ast_kind_t::EQ_EXP) {}
+  BaseAST* relExp;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class EqExpWithOpAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> eqExp;
-  std::string eqOp;
-  std::unique_ptr<BaseAST> relExp;
+  EqExpWithOpAST() : BaseAST(ast_kind_t::EQ_EXP_WITH_OP) {}
+  // 第一个操作数为 EqExpAST, 其余为 RelExp
+  ast_chain_t<const char*> chain;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class LAndExpAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> eqExp;
+  LAndExpAST() : BaseAST(ast_kind_t::L_AND_EXP) {}
+  BaseAST* eqExp;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class LAndExpWithOpAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> lAndExp;
-  std::string lAndOp;
-  std::unique_ptr<BaseAST> eqExp;
+  LAndExpWithOpAST() : BaseAST(ast_kind_t::L_AND_EXP_WITH_OP) {}
+  // 第一个操作数为 LAndExpAST, 其余为 EqExp
+  ast_chain_t<const char*> chain;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class LOrExpAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> lAndExp;
+  LOrExpAST() : BaseAST(ast_kind_t::L_OR_EXP) {}
+  BaseAST* lAndExp;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class LOrExpWithOpAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> lOrExp;
-  std::string lOrOp;
-  std::unique_ptr<BaseAST> lAndExp;
+  LOrExpWithOpAST() : BaseAST(ast_kind_t::L_OR_EXP_WITH_OP) {}
+  // 第一个操作数为 LOrExpAST, 其余为 LAndExp
+  ast_chain_t<const char*> chain;
 
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
 };
 
 class ConstExpAST : public BaseAST {
  public:
-  std::unique_ptr<BaseAST> exp;
-
-  void Dump() const override;
-  std::pair<bool, int> Output() const override;
-};
\ No newline at end of file
+  ConstExpAST() : BaseAST(ast_kind_t::CONST_EXP) {}
+  BaseAST* exp;
+  // 常量值, 第一次求值后缓存, 之后直接使用
+  mutable bool evaluated = false;
+  mutable int value = 0;
+
+  bool DumpStep(AstStack& stack) const override;
+  bool ResolveStep(AstStack& stack) override;
+  bool OutputStep(AstStack& stack) const override;
+};
+// 按节点类别分派: 以具体的节点类型调用 visitor, 各 operator() 可以直接内联
+// visitor 需为每种节点类型提供 operator(), 可用模板重载处理其余类型
+template <typename Visitor>
+auto VisitAst(const BaseAST* node, Visitor& visitor) {
+  switch (node->kind) {
+    case ast_kind_t::COMP_UNIT:
+      return visitor(static_cast<const CompUnitAST*>(node));
+    case ast_kind_t::COMP_UNIT_SUB_WITH_DECL:
+      return visitor(static_cast<const CompUnitSubWithDeclAST*>(node));
+    case ast_kind_t::COMP_UNIT_SUB_WITH_FUNC:
+      return visitor(static_cast<const CompUnitSubWithFuncAST*>(node));
+    case ast_kind_t::DECL_WITH_CONST:
+      return visitor(static_cast<const DeclWithConstAST*>(node));
+    case ast_kind_t::DECL_WITH_VAR:
+      return visitor(static_cast<const DeclWithVarAST*>(node));
+    case ast_kind_t::CONST_DECL:
+      return visitor(static_cast<const ConstDeclAST*>(node));
+    case ast_kind_t::CONST_DEF:
+      return visitor(static_cast<const ConstDefAST*>(node));
+    case ast_kind_t::CONST_INIT_VAL:
+      return visitor(static_cast<const ConstInitValAST*>(node));
+    case ast_kind_t::VAR_DECL:
+      return visitor(static_cast<const VarDeclAST*>(node));
+    case ast_kind_t::VAR_DEF:
+      return visitor(static_cast<const VarDefAST*>(node));
+    case ast_kind_t::VAR_DEF_WITH_ASSIGN:
+      return visitor(static_cast<const VarDefWithAssignAST*>(node));
+    case ast_kind_t::INIT_VAL:
+      return visitor(static_cast<const InitValAST*>(node));
+    case ast_kind_t::FUNC_DEF:
+      return visitor(static_cast<const FuncDefAST*>(node));
+    case ast_kind_t::FUNC_F_PARAMS:
+      return visitor(static_cast<const FuncFParamsAST*>(node));
+    case ast_kind_t::FUNC_F_PARAM:
+      return visitor(static_cast<const FuncFParamAST*>(node));
+    case ast_kind_t::BLOCK:
+      return visitor(static_cast<const BlockAST*>(node));
+    case ast_kind_t::BLOCK_ITEM_WITH_DECL:
+      return visitor(static_cast<const BlockItemWithDeclAST*>(node));
+    case ast_kind_t::BLOCK_ITEM_WITH_STMT:
+      return visitor(static_cast<const BlockItemWithStmtAST*>(node));
+    case ast_kind_t::STMT_WITH_ASSIGN:
+      return visitor(static_cast<const StmtWithAssignAST*>(node));
+    case ast_kind_t::STMT_WITH_EXP:
+      return visitor(static_cast<const StmtWithExpAST*>(node));
+    case ast_kind_t::STMT_WITH_BLOCK:
+      return visitor(static_cast<const StmtWithBlockAST*>(node));
+    case ast_kind_t::STMT_WITH_IF:
+      return visitor(static_cast<const StmtWithIfAST*>(node));
+    case ast_kind_t::STMT_WITH_WHILE:
+      return visitor(static_cast<const StmtWithWhileAST*>(node));
+    case ast_kind_t::STMT_WITH_BREAK:
+      return visitor(static_cast<const StmtWithBreakAST*>(node));
+    case ast_kind_t::STMT_WITH_CONTINUE:
+      return visitor(static_cast<const StmtWithContinueAST*>(node));
+    case ast_kind_t::STMT_WITH_RETURN:
+      return visitor(static_cast<const StmtWithReturnAST*>(node));
+    case ast_kind_t::EXP:
+      return visitor(static_cast<const ExpAST*>(node));
+    case ast_kind_t::L_VAL:
+      return visitor(static_cast<const LValAST*>(node));
+    case ast_kind_t::PRIMARY_EXP_WITH_BR:
+      return visitor(static_cast<const PrimaryExpWithBrAST*>(node));
+    case ast_kind_t::PRIMARY_EXP_WITH_L_VAL:
+      return visitor(static_cast<const PrimaryExpWithLValAST*>(node));
+    case ast_kind_t::PRIMARY_EXP_WITH_NUM:
+      return visitor(static_cast<const PrimaryExpWithNumAST*>(node));
+    case ast_kind_t::UNARY_EXP:
+      return visitor(static_cast<const UnaryExpAST*>(node));
+    case ast_kind_t::UNARY_EXP_WITH_FUNC:
+      return visitor(static_cast<const UnaryExpWithFuncAST*>(node));
+    case ast_kind_t::UNARY_EXP_WITH_OP:
+      return visitor(static_cast<const UnaryExpWithOpAST*>(node));
+    case ast_kind_t::FUNC_R_PARAMS:
+      return visitor(static_cast<const FuncRParamsAST*>(node));
+    case ast_kind_t::MUL_EXP:
+      return visitor(static_cast<const MulExpAST*>(node));
+    case ast_kind_t::MUL_EXP_WITH_OP:
+      return visitor(static_cast<const MulExpWithOpAST*>(node));
+    case ast_kind_t::ADD_EXP:
+      return visitor(static_cast<const AddExpAST*>(node));
+    case ast_kind_t::ADD_EXP_WITH_OP:
+      return visitor(static_cast<const AddExpWithOpAST*>(node));
+    case ast_kind_t::REL_EXP:
+      return visitor(static_cast<const RelExpAST*>(node));
+    case ast_kind_t::REL_EXP_WITH_OP:
+      return visitor(static_cast<const RelExpWithOpAST*>(node));
+    case ast_kind_t::EQ_EXP:
+      return visitor(static_cast<const EqExpAST*>(node));
+    case ast_kind_t::EQ_EXP_WITH_OP:
+      return visitor(static_cast<const EqExpWithOpAST*>(node));
+    case ast_kind_t::L_AND_EXP:
+      return visitor(static_cast<const LAndExpAST*>(node));
+    case ast_kind_t::L_AND_EXP_WITH_OP:
+      return visitor(static_cast<const LAndExpWithOpAST*>(node));
+    case ast_kind_t::L_OR_EXP:
+      return visitor(static_cast<const LOrExpAST*>(node));
+    case ast_kind_t::L_OR_EXP_WITH_OP:
+      return visitor(static_cast<const LOrExpWithOpAST*>(node));
+    default:
+      assert(node->kind == ast_kind_t::CONST_EXP);
+      return visitor(static_cast<const ConstExpAST*>(node));
+  }
+}
+
+// 常量表达式求值, ConstExpAST 的值会被缓存
+int search(const BaseAST* exp);
+
+// 流式编译时逐个生成顶层声明与函数定义的 IR, 代替 CompUnitAST 的遍历
+// 先调用一次 OutputBegin 声明库函数, 之后按源程序顺序对每个单元调用 OutputUnit
+void OutputBegin();
+void OutputUnit(const BaseAST* item);
+
+// 并行生成 CompUnitAST 的 IR, 代替 Output: 先按顺序生成全局变量与所有函数的声明,
+// 再由 arenas.size() 个线程 (包括调用线程) 并行生成各函数体, 第 i 个线程的函数体分配在 arenas[i] 中.
+// 结果与 Output 相同, 同样由 ir_builder->Finish() 取得; arenas 须保留到 raw program 不再使用
+void OutputParallel(const BaseAST* comp_unit, std::vector<RawArena>& arenas);
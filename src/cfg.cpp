@@ -0,0 +1,109 @@
+#include "cfg.hpp"
+
+using namespace std;
+
+koopa_raw_value_t ValueAt(const koopa_raw_slice_t& slice, uint32_t i) {
+  return reinterpret_cast<koopa_raw_value_t>(slice.buffer[i]);
+}
+
+vector<koopa_raw_basic_block_t> Successors(const koopa_raw_basic_block_t bb) {
+  if (bb->insts.len == 0)
+    return {};
+  auto last = ValueAt(bb->insts, bb->insts.len - 1);
+  if (last->kind.tag == KOOPA_RVT_BRANCH)
+    return {last->kind.data.branch.true_bb, last->kind.data.branch.false_bb};
+  if (last->kind.tag == KOOPA_RVT_JUMP)
+    return {last->kind.data.jump.target};
+  return {};
+}
+
+vector<int> ReversePostorder(const vector<vector<int>>& succ) {
+  int n = succ.size();
+  vector<int> order;
+  if (n == 0)
+    return order;
+  // 显式栈模拟深度优先搜索, 避免深层递归
+  vector<bool> visited(n, false);
+  vector<pair<int, size_t>> stack = {{0, 0}};
+  visited[0] = true;
+  while (!stack.empty()) {
+    auto& [b, i] = stack.back();
+    if (i < succ[b].size()) {
+      int s = succ[b][i++];
+      if (!visited[s]) {
+        visited[s] = true;
+        stack.push_back({s, 0});
+      }
+    } else {
+      order.push_back(b);
+      stack.pop_back();
+    }
+  }
+  return vector<int>(order.rbegin(), order.rend());
+}
+
+// Cooper-Harvey-Kennedy 迭代算法
+vector<int> ImmediateDominators(const vector<vector<int>>& succ) {
+  int n = succ.size();
+  vector<int> idom(n, -1);
+  if (n == 0)
+    return idom;
+  vector<int> order = ReversePostorder(succ);
+  vector<int> rpo_index(n, -1);
+  for (size_t i = 0; i < order.size(); i++)
+    rpo_index[order[i]] = i;
+  vector<vector<int>> pred(n);
+  for (int i = 0; i < n; i++)
+    for (int s : succ[i])
+      pred[s].push_back(i);
+
+  auto intersect = [&](int a, int b) {
+    while (a != b) {
+      while (rpo_index[a] > rpo_index[b]) a = idom[a];
+      while (rpo_index[b] > rpo_index[a]) b = idom[b];
+    }
+    return a;
+  };
+
+  idom[0] = 0;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 1; i < order.size(); i++) {
+      int b = order[i];
+      int new_idom = -1;
+      for (int p : pred[b]) {
+        if (idom[p] == -1)
+          continue;
+        new_idom = new_idom == -1 ? p : intersect(p, new_idom);
+      }
+      if (idom[b] != new_idom) {
+        idom[b] = new_idom;
+        changed = true;
+      }
+    }
+  }
+  return idom;
+}
+
+vector<vector<int>> DominanceFrontiers(const vector<vector<int>>& succ, const vector<int>& idom) {
+  int n = succ.size();
+  vector<vector<int>> pred(n), df(n);
+  for (int i = 0; i < n; i++)
+    if (idom[i] != -1)
+      for (int s : succ[i])
+        pred[s].push_back(i);
+  for (int b = 0; b < n; b++) {
+    if (pred[b].size() < 2)
+      continue;
+    for (int p : pred[b]) {
+      int runner = p;
+      while (runner != idom[b]) {
+        if (df[runner].empty() || df[runner].back() != b)
+          df[runner].push_back(b);
+        runner = idom[runner];
+      }
+    }
+  }
+  return df;
+}
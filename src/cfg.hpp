@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+
+#include "koopa.h"
+
+koopa_raw_value_t ValueAt(const koopa_raw_slice_t& slice, uint32_t i);
+
+// 基本块的后继
+std::vector<koopa_raw_basic_block_t> Successors(const koopa_raw_basic_block_t bb);
+
+// 以下基本块均以下标表示, 0 为入口, succ[i] 为 i 的后继
+
+// 逆后序, 不含不可达的基本块
+std::vector<int> ReversePostorder(const std::vector<std::vector<int>>& succ);
+
+// 直接支配者, 入口的直接支配者为自身, 不可达的基本块为 -1
+std::vector<int> ImmediateDominators(const std::vector<std::vector<int>>& succ);
+
+// 支配边界
+std::vector<std::vector<int>> DominanceFrontiers(const std::vector<std::vector<int>>& succ, const std::vector<int>& idom);
@@ -0,0 +1,510 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <set>
+
+#include "regalloc.hpp"
+
+using namespace std;
+
+// 迭代合并的图着色寄存器分配 (George & Appel, Iterated Register Coalescing)
+// 图中前 K 个结点为预着色的物理寄存器, 其余结点为需要分配位置的值
+// 溢出的值经由 t0 ~ t2 读写, 因此无需改写程序重新分配
+
+// 可着色的寄存器, 按优先顺序排列: 先使用无需保存的 caller-saved 寄存器
+static const vector<reg_t> colors = {T3, T4, T5, T6, A0, A1, A2, A3, A4, A5, A6, A7,
+                                     S0, S1, S2, S3, S4, S5, S6, S7, S8, S9, S10, S11};
+static const int K = colors.size();
+// a0 在 colors 中的下标
+static const int COLOR_A0 = 4;
+// caller-saved 寄存器为 colors 的前 12 个
+static const int CALLER_SAVED = 12;
+
+// 计算每个基本块的循环嵌套深度
+static vector<int> LoopDepth(const liveness_t& live) {
+  int n = live.blocks.size();
+  vector<int> idom = ImmediateDominators(live.succ);
+  vector<vector<int>> pred(n);
+  for (int i = 0; i < n; i++)
+    for (int s : live.succ[i])
+      pred[s].push_back(i);
+
+  auto dominates = [&](int a, int b) {
+    while (true) {
+      if (a == b) return true;
+      if (b == 0) return false;
+      b = idom[b];
+    }
+  };
+
+  // 回边 u -> h 确定以 h 为头的自然循环, 同一头的循环合并计算
+  vector<int> depth(n, 0);
+  for (int h = 0; h < n; h++) {
+    if (idom[h] == -1)
+      continue;
+    vector<bool> body(n, false);
+    vector<int> worklist;
+    for (int u : pred[h])
+      if (idom[u] != -1 && dominates(h, u) && !body[u]) {
+        body[u] = true;
+        worklist.push_back(u);
+      }
+    if (worklist.empty())
+      continue;
+    body[h] = true;
+    while (!worklist.empty()) {
+      int b = worklist.back();
+      worklist.pop_back();
+      for (int p : pred[b])
+        if (!body[p] && idom[p] != -1) {
+          body[p] = true;
+          worklist.push_back(p);
+        }
+    }
+    for (int b = 0; b < n; b++)
+      if (body[b])
+        depth[b]++;
+  }
+  return depth;
+}
+
+namespace {
+
+// 结点所在的集合
+typedef enum {
+  PRECOLORED,
+  INITIAL,
+  SIMPLIFY,
+  FREEZE,
+  SPILL,
+  SPILLED,
+  COALESCED,
+  COLORED,
+  SELECT,
+} node_state_t;
+
+// 传送指令所在的集合
+typedef enum {
+  WORKLIST,
+  ACTIVE,
+  COALESCED_MOVE,
+  CONSTRAINED,
+  FROZEN,
+} move_state_t;
+
+class InterferenceGraph {
+ public:
+  vector<koopa_raw_value_t> values;
+  unordered_map<koopa_raw_value_t, int> node;
+
+  vector<node_state_t> state;
+  vector<vector<int>> adj_list;
+  set<pair<int, int>> adj_set;
+  vector<int> degree;
+  vector<int> alias;
+  vector<int> color;
+  vector<double> cost;
+  vector<int> select_stack;
+  set<int> simplify_worklist, freeze_worklist, spill_worklist;
+
+  vector<pair<int, int>> moves;
+  vector<move_state_t> move_state;
+  vector<vector<int>> move_list;
+  vector<int> worklist_moves;
+
+  InterferenceGraph() {
+    for (int i = 0; i < K; i++)
+      NewNode(nullptr, PRECOLORED);
+  }
+
+  int NewNode(koopa_raw_value_t value, node_state_t s) {
+    int id = state.size();
+    values.push_back(value);
+    state.push_back(s);
+    adj_list.emplace_back();
+    degree.push_back(s == PRECOLORED ? INT32_MAX : 0);
+    alias.push_back(id);
+    color.push_back(s == PRECOLORED ? id : -1);
+    cost.push_back(0);
+    move_list.emplace_back();
+    if (value != nullptr)
+      node[value] = id;
+    return id;
+  }
+
+  int Node(koopa_raw_value_t value) {
+    auto it = node.find(value);
+    return it == node.end() ? NewNode(value, INITIAL) : it->second;
+  }
+
+  void AddEdge(int u, int v) {
+    if (u == v || adj_set.count({u, v}))
+      return;
+    adj_set.insert({u, v});
+    adj_set.insert({v, u});
+    if (state[u] != PRECOLORED) {
+      adj_list[u].push_back(v);
+      degree[u]++;
+    }
+    if (state[v] != PRECOLORED) {
+      adj_list[v].push_back(u);
+      degree[v]++;
+    }
+  }
+
+  void AddMove(int dst, int src) {
+    int m = moves.size();
+    moves.push_back({dst, src});
+    move_state.push_back(WORKLIST);
+    move_list[dst].push_back(m);
+    move_list[src].push_back(m);
+    worklist_moves.push_back(m);
+  }
+
+  vector<int> Adjacent(int n) {
+    vector<int> result;
+    for (int m : adj_list[n])
+      if (state[m] != SELECT && state[m] != COALESCED)
+        result.push_back(m);
+    return result;
+  }
+
+  vector<int> NodeMoves(int n) {
+    vector<int> result;
+    for (int m : move_list[n])
+      if (move_state[m] == ACTIVE || move_state[m] == WORKLIST)
+        result.push_back(m);
+    return result;
+  }
+
+  bool MoveRelated(int n) {
+    return !NodeMoves(n).empty();
+  }
+
+  void SetState(int n, node_state_t s) {
+    if (state[n] == SIMPLIFY) simplify_worklist.erase(n);
+    if (state[n] == FREEZE) freeze_worklist.erase(n);
+    if (state[n] == SPILL) spill_worklist.erase(n);
+    state[n] = s;
+    if (s == SIMPLIFY) simplify_worklist.insert(n);
+    if (s == FREEZE) freeze_worklist.insert(n);
+    if (s == SPILL) spill_worklist.insert(n);
+  }
+
+  void MakeWorklist() {
+    for (int n = K; n < int(state.size()); n++) {
+      if (degree[n] >= K)
+        SetState(n, SPILL);
+      else if (MoveRelated(n))
+        SetState(n, FREEZE);
+      else
+        SetState(n, SIMPLIFY);
+    }
+  }
+
+  void EnableMoves(int n) {
+    for (int m : NodeMoves(n))
+      if (move_state[m] == ACTIVE) {
+        move_state[m] = WORKLIST;
+        worklist_moves.push_back(m);
+      }
+  }
+
+  void DecrementDegree(int m) {
+    if (state[m] == PRECOLORED)
+      return;
+    int d = degree[m]--;
+    if (d == K) {
+      EnableMoves(m);
+      for (int n : Adjacent(m))
+        EnableMoves(n);
+      SetState(m, MoveRelated(m) ? FREEZE : SIMPLIFY);
+    }
+  }
+
+  void Simplify() {
+    int n = *simplify_worklist.begin();
+    SetState(n, SELECT);
+    select_stack.push_back(n);
+    for (int m : Adjacent(n))
+      DecrementDegree(m);
+  }
+
+  int GetAlias(int n) {
+    while (state[n] == COALESCED)
+      n = alias[n];
+    return n;
+  }
+
+  void AddWorkList(int u) {
+    if (state[u] != PRECOLORED && !MoveRelated(u) && degree[u] < K)
+      SetState(u, SIMPLIFY);
+  }
+
+  bool OK(int t, int r) {
+    return degree[t] < K || state[t] == PRECOLORED || adj_set.count({t, r});
+  }
+
+  // Briggs 保守合并条件
+  bool Conservative(int u, int v) {
+    set<int> nodes;
+    for (int n : Adjacent(u)) nodes.insert(n);
+    for (int n : Adjacent(v)) nodes.insert(n);
+    int k = 0;
+    for (int n : nodes)
+      if (degree[n] >= K)
+        k++;
+    return k < K;
+  }
+
+  void Combine(int u, int v) {
+    SetState(v, COALESCED);
+    alias[v] = u;
+    for (int m : move_list[v])
+      move_list[u].push_back(m);
+    cost[u] += cost[v];
+    EnableMoves(v);
+    for (int t : Adjacent(v)) {
+      AddEdge(t, u);
+      DecrementDegree(t);
+    }
+    if (degree[u] >= K && state[u] == FREEZE)
+      SetState(u, SPILL);
+  }
+
+  void Coalesce() {
+    int m = worklist_moves.back();
+    worklist_moves.pop_back();
+    if (move_state[m] != WORKLIST)
+      return;
+    int x = GetAlias(moves[m].first);
+    int y = GetAlias(moves[m].second);
+    int u = x, v = y;
+    if (state[y] == PRECOLORED)
+      u = y, v = x;
+
+    if (u == v) {
+      move_state[m] = COALESCED_MOVE;
+      AddWorkList(u);
+    } else if (state[v] == PRECOLORED || adj_set.count({u, v})) {
+      move_state[m] = CONSTRAINED;
+      AddWorkList(u);
+      AddWorkList(v);
+    } else {
+      bool can_combine;
+      if (state[u] == PRECOLORED) {
+        can_combine = true;
+        for (int t : Adjacent(v))
+          if (!OK(t, u))
+            can_combine = false;
+      } else {
+        can_combine = Conservative(u, v);
+      }
+      if (can_combine) {
+        move_state[m] = COALESCED_MOVE;
+        Combine(u, v);
+        AddWorkList(u);
+      } else {
+        move_state[m] = ACTIVE;
+      }
+    }
+  }
+
+  void FreezeMoves(int u) {
+    for (int m : NodeMoves(u)) {
+      int x = moves[m].first, y = moves[m].second;
+      int v = GetAlias(y) == GetAlias(u) ? GetAlias(x) : GetAlias(y);
+      move_state[m] = FROZEN;
+      if (state[v] == FREEZE && NodeMoves(v).empty())
+        SetState(v, SIMPLIFY);
+    }
+  }
+
+  void Freeze() {
+    int u = *freeze_worklist.begin();
+    SetState(u, SIMPLIFY);
+    FreezeMoves(u);
+  }
+
+  // 选择代价与度数之比最小的结点作为潜在溢出
+  void SelectSpill() {
+    int best = -1;
+    for (int n : spill_worklist)
+      if (best == -1 || cost[n] / degree[n] < cost[best] / degree[best])
+        best = n;
+    SetState(best, SIMPLIFY);
+    FreezeMoves(best);
+  }
+
+  // 值跨越调用时避免使用 caller-saved 寄存器
+  void AssignColors() {
+    while (!select_stack.empty()) {
+      int n = select_stack.back();
+      select_stack.pop_back();
+      vector<bool> ok(K, true);
+      for (int w : adj_list[n]) {
+        int a = GetAlias(w);
+        if (state[a] == COLORED || state[a] == PRECOLORED)
+          ok[color[a]] = false;
+      }
+      int c = find(ok.begin(), ok.end(), true) - ok.begin();
+      if (c == K) {
+        state[n] = SPILLED;
+      } else {
+        state[n] = COLORED;
+        color[n] = c;
+      }
+    }
+    for (int n = K; n < int(state.size()); n++)
+      if (state[n] == COALESCED) {
+        int a = GetAlias(n);
+        if (state[a] == SPILLED)
+          state[n] = SPILLED;
+        else
+          color[n] = color[a];
+      }
+  }
+
+  void Run() {
+    MakeWorklist();
+    while (true) {
+      if (!simplify_worklist.empty())
+        Simplify();
+      else if (!worklist_moves.empty())
+        Coalesce();
+      else if (!freeze_worklist.empty())
+        Freeze();
+      else if (!spill_worklist.empty())
+        SelectSpill();
+      else
+        break;
+    }
+    AssignColors();
+  }
+};
+
+}  // namespace
+
+reg_alloc_t GraphColoring(const koopa_raw_function_t& func) {
+  liveness_t live = AnalyzeLiveness(func);
+  vector<int> depth = LoopDepth(live);
+  InterferenceGraph graph;
+
+  // 超出 8 个的参数固定在调用者栈帧中, 不参与分配
+  auto fixed = [&](koopa_raw_value_t value) {
+    return value->kind.tag == KOOPA_RVT_FUNC_ARG_REF && value->kind.data.func_arg_ref.index >= 8;
+  };
+  auto node = [&](koopa_raw_value_t value) {
+    return graph.Node(value);
+  };
+
+  for (uint32_t i = 0; i < func->params.len; i++) {
+    auto param = ValueAt(func->params, i);
+    if (!fixed(param))
+      node(param);
+  }
+
+  // 自基本块末尾逆序扫描, 定义点与此处活跃的值互相冲突
+  for (size_t b = 0; b < live.blocks.size(); b++) {
+    auto bb = live.blocks[b];
+    double weight = pow(10.0, min(depth[b], 8));
+    set<int> live_now;
+    for (auto value : live.live_out[b])
+      if (!fixed(value))
+        live_now.insert(node(value));
+
+    auto define = [&](int d) {
+      live_now.erase(d);
+      for (int l : live_now)
+        graph.AddEdge(d, l);
+      graph.cost[d] += weight;
+    };
+    auto use = [&](koopa_raw_value_t value) {
+      if (fixed(value))
+        return;
+      int u = node(value);
+      live_now.insert(u);
+      graph.cost[u] += weight;
+    };
+
+    for (int j = int(bb->insts.len) - 1; j >= 0; j--) {
+      auto inst = ValueAt(bb->insts, j);
+      const auto& kind = inst->kind;
+      if (NeedsLocation(inst))
+        define(node(inst));
+
+      if (kind.tag == KOOPA_RVT_CALL) {
+        // 返回值由 a0 传出
+        if (NeedsLocation(inst))
+          graph.AddMove(node(inst), COLOR_A0);
+        // 跨越调用的值与所有 caller-saved 寄存器冲突
+        for (int l : live_now)
+          for (int r = 0; r < CALLER_SAVED; r++)
+            graph.AddEdge(l, r);
+        // 前 8 个参数由 a 寄存器传入
+        for (uint32_t i = 0; i < kind.data.call.args.len && i < 8; i++) {
+          auto arg = ValueAt(kind.data.call.args, i);
+          if (NeedsLocation(arg) && !fixed(arg))
+            graph.AddMove(COLOR_A0 + i, node(arg));
+        }
+      } else if (kind.tag == KOOPA_RVT_JUMP || kind.tag == KOOPA_RVT_BRANCH) {
+        // 实参传给目标基本块的参数
+        auto edge = [&](koopa_raw_basic_block_t target, const koopa_raw_slice_t& args) {
+          for (uint32_t i = 0; i < args.len; i++)
+            if (NeedsLocation(ValueAt(args, i)) && !fixed(ValueAt(args, i)))
+              graph.AddMove(node(ValueAt(target->params, i)), node(ValueAt(args, i)));
+        };
+        if (kind.tag == KOOPA_RVT_JUMP) {
+          edge(kind.data.jump.target, kind.data.jump.args);
+        } else {
+          edge(kind.data.branch.true_bb, kind.data.branch.true_args);
+          edge(kind.data.branch.false_bb, kind.data.branch.false_args);
+        }
+      } else if (kind.tag == KOOPA_RVT_RETURN && kind.data.ret.value != nullptr) {
+        auto value = kind.data.ret.value;
+        if (NeedsLocation(value) && !fixed(value))
+          graph.AddMove(COLOR_A0, node(value));
+      }
+
+      for (auto op : Operands(inst))
+        use(op);
+    }
+
+    // 基本块参数 / 函数参数在块首由并行 mv 同时定义, 即使未被使用也互相冲突
+    vector<int> params;
+    for (uint32_t j = 0; j < bb->params.len; j++)
+      params.push_back(node(ValueAt(bb->params, j)));
+    if (b == 0)
+      for (uint32_t j = 0; j < func->params.len; j++)
+        if (!fixed(ValueAt(func->params, j)))
+          params.push_back(node(ValueAt(func->params, j)));
+    for (int p : params) {
+      for (int l : live_now)
+        graph.AddEdge(p, l);
+      for (int q : params)
+        graph.AddEdge(p, q);
+    }
+  }
+
+  // 参数由 a 寄存器传入
+  for (uint32_t i = 0; i < func->params.len && i < 8; i++)
+    graph.AddMove(node(ValueAt(func->params, i)), COLOR_A0 + i);
+
+  graph.Run();
+
+  reg_alloc_t alloc;
+  vector<bool> used(K, false);
+  for (int n = K; n < int(graph.state.size()); n++) {
+    if (graph.state[n] == SPILLED) {
+      alloc.spilled.push_back(graph.values[n]);
+    } else {
+      assert(graph.color[n] >= 0);
+      alloc.reg[graph.values[n]] = colors[graph.color[n]];
+      used[graph.color[n]] = true;
+    }
+  }
+  for (int r = CALLER_SAVED; r < K; r++)
+    if (used[r])
+      alloc.callee_saved.push_back(colors[r]);
+  return alloc;
+}
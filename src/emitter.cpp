@@ -0,0 +1,123 @@
+#include <cassert>
+
+#include "emitter.hpp"
+#include "location.hpp"
+
+using namespace std;
+
+static const char* const op_names[] = {
+    "add", "sub", "mul", "div", "rem",
+    "and", "or", "xor",
+    "sll", "srl", "sra",
+    "slt", "sgt",
+    "mv", "seqz", "snez",
+    "addi",
+    "li",
+    "lw", "sw",
+    "la",
+    "beqz", "bnez",
+    "j", "call",
+    "ret",
+};
+
+void AsmEmitter::Put(label_t label) {
+  out << label.name;
+  if (label.index >= 0)
+    out << label.index;
+}
+
+void AsmEmitter::Reg(mreg_t reg) {
+  assert(reg < 32);
+  out << reg_names[reg];
+}
+
+void AsmEmitter::Global(label_t label, bool zero, int32_t value) {
+  out << "\t.data\n\t.globl ";
+  Put(label);
+  out << '\n';
+  Put(label);
+  out << ":\n";
+  if (zero)
+    out << "\t.zero 4\n\n";
+  else
+    out << "\t.word " << value << "\n\n";
+}
+
+void AsmEmitter::Inst(const MFunction& func, const minst_t& inst) {
+  out << '\t' << op_names[int(inst.op)];
+  switch (inst.op) {
+    case mop_t::MV:
+    case mop_t::SEQZ:
+    case mop_t::SNEZ:
+      out << ' ';
+      Reg(inst.rd);
+      out << ", ";
+      Reg(inst.rs1);
+      break;
+    case mop_t::ADDI:
+      out << ' ';
+      Reg(inst.rd);
+      out << ", ";
+      Reg(inst.rs1);
+      out << ", " << inst.imm;
+      break;
+    case mop_t::LI:
+      out << ' ';
+      Reg(inst.rd);
+      out << ", " << inst.imm;
+      break;
+    case mop_t::LW:
+    case mop_t::SW:
+      out << ' ';
+      Reg(inst.op == mop_t::LW ? inst.rd : inst.rs2);
+      out << ", " << inst.imm << '(';
+      Reg(inst.rs1);
+      out << ')';
+      break;
+    case mop_t::LA:
+      out << ' ';
+      Reg(inst.rd);
+      out << ", ";
+      Put(func.LabelAt(inst.imm));
+      break;
+    case mop_t::BEQZ:
+    case mop_t::BNEZ:
+      out << ' ';
+      Reg(inst.rs1);
+      out << ", ";
+      Put(func.LabelAt(inst.imm));
+      break;
+    case mop_t::J:
+    case mop_t::CALL:
+      out << ' ';
+      Put(func.LabelAt(inst.imm));
+      break;
+    case mop_t::RET:
+      // 每个返回后空一行
+      out << '\n';
+      break;
+    default:
+      out << ' ';
+      Reg(inst.rd);
+      out << ", ";
+      Reg(inst.rs1);
+      out << ", ";
+      Reg(inst.rs2);
+      break;
+  }
+  out << '\n';
+}
+
+void AsmEmitter::Function(const MFunction& func) {
+  out << "\t.text\n\t.globl " << func.Name() << '\n' << func.Name() << ":\n";
+  const auto& blocks = func.Blocks();
+  const auto& insts = func.Insts();
+  for (size_t i = 0; i < blocks.size(); i++) {
+    if (blocks[i].label >= 0) {
+      Put(func.LabelAt(blocks[i].label));
+      out << ":\n";
+    }
+    for (uint32_t j = blocks[i].begin; j < func.BlockEnd(i); j++)
+      Inst(func, insts[j]);
+  }
+}
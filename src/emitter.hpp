@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+#include "mir.hpp"
+#include "writer.hpp"
+
+// 以 RISC-V 汇编文本输出机器指令, 汇编的文本格式只在这里出现
+// 直接写入 Writer, 不构造临时字符串
+class AsmEmitter {
+ public:
+  explicit AsmEmitter(Writer& out) : out(out) {}
+
+  // 全局变量, zero 为真时零初始化, 否则初值为 value
+  void Global(label_t label, bool zero, int32_t value);
+  // 函数, 其中只能出现物理寄存器
+  void Function(const MFunction& func);
+
+ private:
+  Writer& out;
+
+  void Put(label_t label);
+  void Reg(mreg_t reg);
+  void Inst(const MFunction& func, const minst_t& inst);
+};
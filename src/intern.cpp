@@ -0,0 +1,51 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "intern.hpp"
+
+using namespace std;
+
+Interner interner;
+
+// 每次向系统申请的内存块大小
+static const size_t INTERN_CHUNK_SIZE = 64 * 1024;
+
+Interner::~Interner() {
+  for (char* chunk : chunks)
+    free(chunk);
+  for (auto segment : segments)
+    free(segment);
+}
+
+symbol_t Interner::Intern(const char* s, size_t len) {
+  auto it = ids.find(string_view(s, len));
+  if (it != ids.end())
+    return it->second;
+
+  // 名字连续存放在内存块中, 表中的 string_view 指向这里, 地址不会改变
+  char* name;
+  if (len + 1 > INTERN_CHUNK_SIZE) {
+    name = static_cast<char*>(malloc(len + 1));
+    chunks.insert(chunks.end() - (chunks.empty() ? 0 : 1), name);
+  } else {
+    if (used + len + 1 > capacity) {
+      chunks.push_back(static_cast<char*>(malloc(INTERN_CHUNK_SIZE)));
+      used = 0;
+      capacity = INTERN_CHUNK_SIZE;
+    }
+    name = chunks.back() + used;
+    used += len + 1;
+  }
+  memcpy(name, s, len);
+  name[len] = '\0';
+
+  symbol_t sym = count;
+  size_t v = count + NAMES_BASE;
+  int k = 63 - __builtin_clzll(v) - NAMES_BASE_BITS;
+  if (segments[k] == nullptr)
+    segments[k] = static_cast<const char**>(malloc((NAMES_BASE << k) * sizeof(const char*)));
+  segments[k][v - (NAMES_BASE << k)] = name;
+  count++;
+  ids.emplace(string_view(name, len), sym);
+  return sym;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// 标识符的编号
+typedef uint32_t symbol_t;
+
+// 字符串驻留表: 相同的字符串只保存一份, 以编号表示, 之后只需比较编号
+// 由 lexer 填入, 名字的内存在整个编译过程中有效
+// 只能由一个线程调用 Intern; 其他线程可以同时对已经传给它们的编号调用 Name
+class Interner {
+ public:
+  Interner() = default;
+  Interner(const Interner&) = delete;
+  Interner& operator=(const Interner&) = delete;
+  ~Interner();
+
+  symbol_t Intern(const char* s, size_t len);
+  symbol_t Intern(const std::string& s) { return Intern(s.data(), s.size()); }
+  // 以 '\0' 结尾的名字
+  const char* Name(symbol_t sym) const {
+    size_t v = size_t(sym) + NAMES_BASE;
+    int k = 63 - __builtin_clzll(v) - NAMES_BASE_BITS;
+    return segments[k][v - (NAMES_BASE << k)];
+  }
+  size_t size() const { return count; }
+
+ private:
+  // 名字按编号分段存放, 第 k 段可容纳 NAMES_BASE << k 个名字
+  // 已分配的段不会移动, 追加名字时不影响其他线程读取已有的名字
+  static const int NAMES_BASE_BITS = 8;
+  static const size_t NAMES_BASE = size_t(1) << NAMES_BASE_BITS;
+
+  std::unordered_map<std::string_view, symbol_t> ids;
+  const char** segments[64 - NAMES_BASE_BITS] = {};
+  size_t count = 0;
+  std::vector<char*> chunks;
+  size_t used = 0;
+  size_t capacity = 0;
+};
+
+extern Interner interner;
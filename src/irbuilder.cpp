@@ -0,0 +1,193 @@
+#include <cassert>
+
+#include "irbuilder.hpp"
+
+using namespace std;
+
+void IRBuilder::SetBodyArena(RawArena* body) {
+  this->body = body;
+  // 缓存的常量可能位于之前的函数体内存池中
+  integers.clear();
+}
+
+koopa_raw_value_t IRBuilder::GlobalAlloc(const string& name, koopa_raw_value_t init) {
+  if (init == nullptr)
+    init = arena.NewValue(arena.Int32(), nullptr, KOOPA_RVT_ZERO_INIT);
+  auto data = arena.NewValue(arena.Pointer(arena.Int32()), arena.Name(name), KOOPA_RVT_GLOBAL_ALLOC);
+  data->kind.data.global_alloc.init = init;
+  globals.push_back(data);
+  return data;
+}
+
+koopa_raw_function_t IRBuilder::Declare(const string& name, const vector<koopa_raw_type_t>& params, koopa_raw_type_t ret) {
+  auto decl = arena.New<koopa_raw_function_data_t>();
+  decl->ty = arena.Function(params, ret);
+  decl->name = arena.Name(name);
+  decl->params = arena.Slice({}, KOOPA_RSIK_VALUE);
+  decl->bbs = arena.Slice({}, KOOPA_RSIK_BASIC_BLOCK);
+  func_list.push_back(decl);
+  return decl;
+}
+
+koopa_raw_function_data_t* IRBuilder::BeginFunction(const string& name, const vector<koopa_raw_type_t>& params, koopa_raw_type_t ret) {
+  auto decl = Declare(name, params, ret);
+  BeginFunction(decl);
+  return func;
+}
+
+void IRBuilder::BeginFunction(koopa_raw_function_t decl) {
+  func = const_cast<koopa_raw_function_data_t*>(decl);
+  // 常量只在函数内共享, 与各函数分别由不同的 builder 生成时相同
+  integers.clear();
+  params.clear();
+  blocks.clear();
+  block_names.clear();
+  block_index.clear();
+  current = 0;
+}
+
+koopa_raw_value_t IRBuilder::AddParam(const string& name) {
+  auto& arena = BodyArena();
+  auto param = arena.NewValue(arena.Int32(), arena.Name(name), KOOPA_RVT_FUNC_ARG_REF);
+  param->kind.data.func_arg_ref.index = params.size();
+  params.push_back(param);
+  return param;
+}
+
+void IRBuilder::EndFunction() {
+  // 函数类型在声明时已确定, 其他线程可能正在读取, 这里不再修改
+  assert(params.size() == func->ty->data.function.params.len);
+  auto& body = BodyArena();
+  func->params = body.Slice(vector<const void*>(params.begin(), params.end()), KOOPA_RSIK_VALUE);
+
+  vector<const void*> bbs;
+  for (auto& block : blocks) {
+    for (size_t i = 0; i < block.params.size(); i++)
+      const_cast<koopa_raw_value_data_t*>(block.params[i])->kind.data.block_arg_ref.index = i;
+    block.bb->params = body.Slice(vector<const void*>(block.params.begin(), block.params.end()), KOOPA_RSIK_VALUE);
+    block.bb->insts = body.Slice(vector<const void*>(block.insts.begin(), block.insts.end()), KOOPA_RSIK_VALUE);
+    bbs.push_back(block.bb);
+  }
+  func->bbs = body.Slice(bbs, KOOPA_RSIK_BASIC_BLOCK);
+  func = nullptr;
+}
+
+koopa_raw_basic_block_data_t* IRBuilder::Block(const string& name) {
+  auto& bb = block_names[name];
+  if (bb == nullptr) {
+    auto& arena = BodyArena();
+    bb = arena.New<koopa_raw_basic_block_data_t>();
+    bb->name = arena.Name(name);
+    bb->used_by = arena.Slice({}, KOOPA_RSIK_VALUE);
+  }
+  return bb;
+}
+
+void IRBuilder::SetBlock(koopa_raw_basic_block_data_t* bb) {
+  assert(!block_index.count(bb));
+  block_index[bb] = blocks.size();
+  current = blocks.size();
+  blocks.push_back(block_t{bb, {}, {}});
+}
+
+koopa_raw_value_data_t* IRBuilder::NewBlockParam(const string& name) {
+  auto& arena = BodyArena();
+  return arena.NewValue(arena.Int32(), arena.Name(name), KOOPA_RVT_BLOCK_ARG_REF);
+}
+
+koopa_raw_value_t IRBuilder::Integer(int32_t value) {
+  // 相同的常量只构建一次, 便于按指针比较
+  auto& integer = integers[value];
+  if (integer == nullptr)
+    integer = BodyArena().Integer(value);
+  return integer;
+}
+
+koopa_raw_value_data_t* IRBuilder::Insert(koopa_raw_type_t ty, koopa_raw_value_tag_t tag) {
+  auto data = BodyArena().NewValue(ty, nullptr, tag);
+  blocks[current].insts.push_back(data);
+  return data;
+}
+
+koopa_raw_value_t IRBuilder::Alloc(const string& name) {
+  auto data = Insert(arena.Pointer(arena.Int32()), KOOPA_RVT_ALLOC);
+  data->name = BodyArena().Name(name);
+  return data;
+}
+
+koopa_raw_value_t IRBuilder::Load(koopa_raw_value_t src) {
+  auto data = Insert(src->ty->data.pointer.base, KOOPA_RVT_LOAD);
+  data->kind.data.load.src = src;
+  return data;
+}
+
+koopa_raw_value_t IRBuilder::Store(koopa_raw_value_t value, koopa_raw_value_t dest) {
+  auto data = Insert(arena.Unit(), KOOPA_RVT_STORE);
+  data->kind.data.store.value = value;
+  data->kind.data.store.dest = dest;
+  return data;
+}
+
+koopa_raw_value_t IRBuilder::Binary(koopa_raw_binary_op_t op, koopa_raw_value_t lhs, koopa_raw_value_t rhs) {
+  auto data = Insert(arena.Int32(), KOOPA_RVT_BINARY);
+  data->kind.data.binary.op = op;
+  data->kind.data.binary.lhs = lhs;
+  data->kind.data.binary.rhs = rhs;
+  return data;
+}
+
+koopa_raw_value_data_t* IRBuilder::Branch(koopa_raw_value_t cond, koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) {
+  auto data = Insert(arena.Unit(), KOOPA_RVT_BRANCH);
+  data->kind.data.branch.cond = cond;
+  data->kind.data.branch.true_bb = true_bb;
+  data->kind.data.branch.false_bb = false_bb;
+  data->kind.data.branch.true_args = BodyArena().Slice({}, KOOPA_RSIK_VALUE);
+  data->kind.data.branch.false_args = BodyArena().Slice({}, KOOPA_RSIK_VALUE);
+  return data;
+}
+
+koopa_raw_value_data_t* IRBuilder::Jump(koopa_raw_basic_block_t target) {
+  auto data = Insert(arena.Unit(), KOOPA_RVT_JUMP);
+  data->kind.data.jump.target = target;
+  data->kind.data.jump.args = BodyArena().Slice({}, KOOPA_RSIK_VALUE);
+  return data;
+}
+
+koopa_raw_value_t IRBuilder::Call(koopa_raw_function_t callee, const vector<koopa_raw_value_t>& args) {
+  auto data = Insert(callee->ty->data.function.ret, KOOPA_RVT_CALL);
+  data->kind.data.call.callee = callee;
+  data->kind.data.call.args = BodyArena().Slice(vector<const void*>(args.begin(), args.end()), KOOPA_RSIK_VALUE);
+  return data;
+}
+
+koopa_raw_value_t IRBuilder::Return(koopa_raw_value_t value) {
+  auto data = Insert(arena.Unit(), KOOPA_RVT_RETURN);
+  data->kind.data.ret.value = value;
+  return data;
+}
+
+void IRBuilder::ReplaceUses(const unordered_map<koopa_raw_value_t, koopa_raw_value_t>& replace) {
+  if (replace.empty())
+    return;
+  auto resolve = [&](koopa_raw_value_t& value) {
+    auto it = replace.find(value);
+    while (it != replace.end()) {
+      value = it->second;
+      it = replace.find(value);
+    }
+  };
+  for (auto& block : blocks)
+    for (auto inst : block.insts)
+      ForEachOperandRef(const_cast<koopa_raw_value_data_t*>(inst), resolve);
+}
+
+koopa_raw_program_t IRBuilder::Finish() {
+  auto& arena = BodyArena();
+  koopa_raw_program_t program;
+  program.values = arena.Slice(globals, KOOPA_RSIK_VALUE);
+  program.funcs = arena.Slice(func_list, KOOPA_RSIK_FUNCTION);
+  RebuildUses(program, arena);
+  globals.clear();
+  func_list.clear();
+  return program;
+}
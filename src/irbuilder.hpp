@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "koopa.h"
+#include "rawbuilder.hpp"
+
+// 在内存池中逐条指令地构建 raw program
+// 基本块的参数与指令先记录在 vector 中, 函数结束时再写入 slice; used_by 在 Finish 时统一计算
+class IRBuilder {
+ public:
+  explicit IRBuilder(RawArena& arena) : arena(arena) {}
+
+  RawArena& Arena() { return arena; }
+  // 函数体 (参数, 基本块, 指令与常量) 所在的内存池, 未设置时与 Arena() 相同
+  RawArena& BodyArena() { return body ? *body : arena; }
+  // 流式编译时每个函数体使用单独的内存池, 函数输出后即可整体释放
+  // 函数对象本身及其类型仍在 Arena() 中, 之后的调用可以引用
+  void SetBodyArena(RawArena* body);
+
+  // 全局变量, init 为 nullptr 时零初始化
+  koopa_raw_value_t GlobalAlloc(const std::string& name, koopa_raw_value_t init);
+
+  // 函数声明
+  koopa_raw_function_t Declare(const std::string& name, const std::vector<koopa_raw_type_t>& params, koopa_raw_type_t ret);
+  // 开始定义函数, 参数由 AddParam 依次添加, 类型须与 params 一致
+  koopa_raw_function_data_t* BeginFunction(const std::string& name, const std::vector<koopa_raw_type_t>& params, koopa_raw_type_t ret);
+  // 为已由 Declare 声明的函数 (可能来自另一个 IRBuilder) 定义函数体, 不再加入本 builder 的函数列表
+  void BeginFunction(koopa_raw_function_t decl);
+  koopa_raw_value_t AddParam(const std::string& name);
+  koopa_raw_value_t Param(size_t i) const { return params[i]; }
+  // 结束当前函数, 将参数, 基本块与指令写入 slice
+  void EndFunction();
+
+  // 当前函数中名为 name 的基本块, 不存在时创建
+  koopa_raw_basic_block_data_t* Block(const std::string& name);
+  // 将基本块加入当前函数末尾, 之后的指令插入其中
+  void SetBlock(koopa_raw_basic_block_data_t* bb);
+  koopa_raw_basic_block_data_t* CurrentBlock() const { return blocks[current].bb; }
+  // 基本块参数, 函数结束前可任意修改
+  std::vector<koopa_raw_value_t>& BlockParams(koopa_raw_basic_block_t bb) { return blocks[block_index.at(bb)].params; }
+  koopa_raw_value_data_t* NewBlockParam(const std::string& name);
+
+  koopa_raw_value_t Integer(int32_t value);
+  koopa_raw_value_t Alloc(const std::string& name);
+  koopa_raw_value_t Load(koopa_raw_value_t src);
+  koopa_raw_value_t Store(koopa_raw_value_t value, koopa_raw_value_t dest);
+  koopa_raw_value_t Binary(koopa_raw_binary_op_t op, koopa_raw_value_t lhs, koopa_raw_value_t rhs);
+  koopa_raw_value_data_t* Branch(koopa_raw_value_t cond, koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb);
+  koopa_raw_value_data_t* Jump(koopa_raw_basic_block_t target);
+  koopa_raw_value_t Call(koopa_raw_function_t callee, const std::vector<koopa_raw_value_t>& args);
+  koopa_raw_value_t Return(koopa_raw_value_t value);
+
+  // 将当前函数所有指令中的操作数按 replace 替换 (可链式替换)
+  void ReplaceUses(const std::unordered_map<koopa_raw_value_t, koopa_raw_value_t>& replace);
+
+  // 生成上次 Finish 之后添加的全局变量与函数构成的 raw program, 并计算所有 used_by
+  koopa_raw_program_t Finish();
+
+ private:
+  typedef struct {
+    koopa_raw_basic_block_data_t* bb;
+    std::vector<koopa_raw_value_t> params;
+    std::vector<koopa_raw_value_t> insts;
+  } block_t;
+
+  RawArena& arena;
+  RawArena* body = nullptr;
+  std::vector<const void*> globals;
+  std::vector<const void*> func_list;
+  std::unordered_map<int32_t, koopa_raw_value_t> integers;
+
+  // 当前函数
+  koopa_raw_function_data_t* func = nullptr;
+  std::vector<koopa_raw_value_t> params;
+  std::vector<block_t> blocks;
+  std::unordered_map<std::string, koopa_raw_basic_block_data_t*> block_names;
+  std::unordered_map<koopa_raw_basic_block_t, size_t> block_index;
+  size_t current = 0;
+
+  koopa_raw_value_data_t* Insert(koopa_raw_type_t ty, koopa_raw_value_tag_t tag);
+};
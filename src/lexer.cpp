@@ -0,0 +1,337 @@
+#ifdef HAND_LEXER
+
+// 手写的 lexer, 以 make HAND_LEXER=1 构建时代替 Flex 生成的 lexer
+// 直接在 SourceFile 提供的内存上扫描, 空白符, 注释与标识符以 SIMD 按 16/32 字节一块跳过,
+// 关键字由编译期构造的完美哈希表识别
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#define LEXER_SIMD
+#endif
+
+// 因为 lexer 会用到 Bison 中关于 token 的定义
+#include "sysy.tab.hpp"
+
+#include "intern.hpp"
+#include "parser.hpp"
+
+using namespace std;
+
+// lexer 的状态, 每次解析一个, 由 ScannerCreate 创建
+typedef struct {
+  // 当前扫描位置, 输入以至少两个 '\0' 结尾
+  char* cur;
+  // 与 Flex 相同, token 之后的字符临时改为 '\0' 使 text 以 '\0' 结尾, 下次调用时恢复
+  char* hold_pos;
+  char hold_char;
+  // 当前 token 的文本
+  char* text;
+  // 不能映射的输入读入这里
+  vector<char> stream_buf;
+} scanner_t;
+
+// 字符类别表
+enum {
+  CHAR_SPACE = 1,
+  CHAR_IDENT_START = 2,
+  CHAR_IDENT = 4,
+  CHAR_DIGIT = 8,
+  CHAR_HEX = 16,
+};
+
+constexpr array<uint8_t, 256> BuildCharClass() {
+  array<uint8_t, 256> table{};
+  table[' '] = table['\t'] = table['\n'] = table['\r'] = CHAR_SPACE;
+  for (int c = 'a'; c <= 'z'; c++) {
+    table[c] = CHAR_IDENT_START | CHAR_IDENT;
+    table[c - 'a' + 'A'] = CHAR_IDENT_START | CHAR_IDENT;
+  }
+  table['_'] = CHAR_IDENT_START | CHAR_IDENT;
+  for (int c = '0'; c <= '9'; c++)
+    table[c] = CHAR_IDENT | CHAR_DIGIT | CHAR_HEX;
+  for (int c = 'a'; c <= 'f'; c++) {
+    table[c] |= CHAR_HEX;
+    table[c - 'a' + 'A'] |= CHAR_HEX;
+  }
+  return table;
+}
+
+static constexpr array<uint8_t, 256> char_class = BuildCharClass();
+
+static inline bool Is(char c, uint8_t cls) {
+  return char_class[uint8_t(c)] & cls;
+}
+
+// 关键字的完美哈希: 对全部关键字, 长度与首尾字符的组合落在互不相同的槽中
+typedef struct {
+  const char* name;
+  size_t len;
+  yy::parser::token_kind_type token;
+} keyword_t;
+
+static constexpr keyword_t keywords[] = {
+    {"const", 5, yy::parser::token::CONST},
+    {"int", 3, yy::parser::token::INT},
+    {"void", 4, yy::parser::token::VOID},
+    {"if", 2, yy::parser::token::IF},
+    {"else", 4, yy::parser::token::ELSE},
+    {"while", 5, yy::parser::token::WHILE},
+    {"break", 5, yy::parser::token::BREAK},
+    {"continue", 8, yy::parser::token::CONTINUE},
+    {"return", 6, yy::parser::token::RETURN},
+};
+
+constexpr size_t KeywordHash(const char* s, size_t len) {
+  return (2 * len + uint8_t(s[0]) + 3 * uint8_t(s[len - 1])) & 15;
+}
+
+constexpr array<keyword_t, 16> BuildKeywordTable() {
+  array<keyword_t, 16> table{};
+  for (const auto& keyword : keywords)
+    table[KeywordHash(keyword.name, keyword.len)] = keyword;
+  return table;
+}
+
+static constexpr array<keyword_t, 16> keyword_table = BuildKeywordTable();
+
+constexpr bool KeywordHashIsPerfect() {
+  for (const auto& keyword : keywords)
+    if (keyword_table[KeywordHash(keyword.name, keyword.len)].name != keyword.name)
+      return false;
+  return true;
+}
+
+static_assert(KeywordHashIsPerfect(), "keyword hash has collisions");
+
+// 是关键字时返回其 token, 否则返回 YYEOF
+static inline yy::parser::token_kind_type Keyword(const char* s, size_t len) {
+  const keyword_t& keyword = keyword_table[KeywordHash(s, len)];
+  if (keyword.len == len && !memcmp(keyword.name, s, len))
+    return keyword.token;
+  return yy::parser::token::YYEOF;
+}
+
+#ifdef LEXER_SIMD
+
+#ifdef __AVX2__
+typedef __m256i block_t;
+static const size_t kStride = 32;
+static const uint32_t kFullMask = 0xffffffff;
+
+static inline block_t Load(const char* p) { return _mm256_load_si256(reinterpret_cast<const block_t*>(p)); }
+static inline block_t Splat(char c) { return _mm256_set1_epi8(c); }
+static inline block_t Eq(block_t b, char c) { return _mm256_cmpeq_epi8(b, Splat(c)); }
+static inline block_t Gt(block_t b, char c) { return _mm256_cmpgt_epi8(b, Splat(c)); }
+static inline block_t Lt(block_t b, char c) { return _mm256_cmpgt_epi8(Splat(c), b); }
+static inline block_t Or(block_t a, block_t b) { return _mm256_or_si256(a, b); }
+static inline block_t And(block_t a, block_t b) { return _mm256_and_si256(a, b); }
+static inline uint32_t Mask(block_t b) { return _mm256_movemask_epi8(b); }
+#else
+typedef __m128i block_t;
+static const size_t kStride = 16;
+static const uint32_t kFullMask = 0xffff;
+
+static inline block_t Load(const char* p) { return _mm_load_si128(reinterpret_cast<const block_t*>(p)); }
+static inline block_t Splat(char c) { return _mm_set1_epi8(c); }
+static inline block_t Eq(block_t b, char c) { return _mm_cmpeq_epi8(b, Splat(c)); }
+static inline block_t Gt(block_t b, char c) { return _mm_cmpgt_epi8(b, Splat(c)); }
+static inline block_t Lt(block_t b, char c) { return _mm_cmplt_epi8(b, Splat(c)); }
+static inline block_t Or(block_t a, block_t b) { return _mm_or_si128(a, b); }
+static inline block_t And(block_t a, block_t b) { return _mm_and_si128(a, b); }
+static inline uint32_t Mask(block_t b) { return _mm_movemask_epi8(b); }
+#endif
+
+// 从 p 开始找第一个命中的字节, stop 返回一块中各字节是否命中的掩码, 且必须在 '\0' 处命中
+// 读取按 kStride 对齐, 对齐的块不会跨页, 因此读到 p 之前或输入末尾之后也不会越界访问
+template <typename Stop>
+static inline char* Find(char* p, Stop stop) {
+  size_t off = reinterpret_cast<uintptr_t>(p) % kStride;
+  char* block = p - off;
+  uint32_t mask = stop(Load(block)) & (kFullMask << off);
+  while (!mask) {
+    block += kStride;
+    mask = stop(Load(block));
+  }
+  return block + __builtin_ctz(mask);
+}
+
+static inline uint32_t NotSpace(block_t b) {
+  return ~Mask(Or(Or(Eq(b, ' '), Eq(b, '\t')), Or(Eq(b, '\n'), Eq(b, '\r')))) & kFullMask;
+}
+
+static inline uint32_t LineEnd(block_t b) {
+  return Mask(Or(Eq(b, '\n'), Eq(b, '\0')));
+}
+
+static inline uint32_t StarOrEnd(block_t b) {
+  return Mask(Or(Eq(b, '*'), Eq(b, '\0')));
+}
+
+// 字母转为小写后与数字, 下划线分别按范围比较
+// 有符号比较中 0x80 以上的字节为负数, 不会落入任何范围
+static inline uint32_t NotIdent(block_t b) {
+  block_t lower = Or(b, Splat(0x20));
+  block_t alpha = And(Gt(lower, 'a' - 1), Lt(lower, 'z' + 1));
+  block_t digit = And(Gt(b, '0' - 1), Lt(b, '9' + 1));
+  return ~Mask(Or(Or(alpha, digit), Eq(b, '_'))) & kFullMask;
+}
+
+static inline char* SkipSpace(char* p) { return Find(p, NotSpace); }
+static inline char* SkipLine(char* p) { return Find(p, LineEnd); }
+static inline char* FindStar(char* p) { return Find(p, StarOrEnd); }
+static inline char* IdentEnd(char* p) { return Find(p, NotIdent); }
+
+#else
+
+static inline char* SkipSpace(char* p) {
+  while (Is(*p, CHAR_SPACE))
+    p++;
+  return p;
+}
+
+static inline char* SkipLine(char* p) {
+  while (*p && *p != '\n')
+    p++;
+  return p;
+}
+
+static inline char* FindStar(char* p) {
+  while (*p && *p != '*')
+    p++;
+  return p;
+}
+
+static inline char* IdentEnd(char* p) {
+  while (Is(*p, CHAR_IDENT))
+    p++;
+  return p;
+}
+
+#endif
+
+// 跳过块注释的内容, p 位于 "/*" 之后, 返回 "*/" 之后的位置, 没有结束时返回输入末尾
+static char* SkipBlockComment(char* p) {
+  for (;;) {
+    p = FindStar(p);
+    if (!*p)
+      return p;
+    if (p[1] == '/')
+      return p + 2;
+    p++;
+  }
+}
+
+// 与 Flex 规则一致: 十进制 [1-9][0-9]*, 八进制 0[0-7]*, 十六进制 0[xX][0-9a-fA-F]+
+static char* Number(char* p, int32_t& value) {
+  uint32_t v = 0;
+  if (*p != '0') {
+    while (Is(*p, CHAR_DIGIT))
+      v = v * 10 + (*p++ - '0');
+  } else if ((p[1] == 'x' || p[1] == 'X') && Is(p[2], CHAR_HEX)) {
+    for (p += 2; Is(*p, CHAR_HEX); p++)
+      v = v * 16 + (Is(*p, CHAR_DIGIT) ? *p - '0' : (*p | 0x20) - 'a' + 10);
+  } else {
+    for (p++; *p >= '0' && *p <= '7'; p++)
+      v = v * 8 + (*p - '0');
+  }
+  value = v;
+  return p;
+}
+
+void* ScannerCreate(const SourceFile& source) {
+  auto scanner = new scanner_t();
+  if (source.Data()) {
+    scanner->cur = source.Data();
+    return scanner;
+  }
+
+  // 不能映射的输入按块读入内存, 末尾补两个 '\0'
+  auto& buf = scanner->stream_buf;
+  const size_t kChunk = 1 << 16;
+  size_t size = 0;
+  for (;;) {
+    buf.resize(size + kChunk);
+    size_t n = fread(buf.data() + size, 1, kChunk, source.Stream());
+    size += n;
+    if (n < kChunk)
+      break;
+  }
+  buf.resize(size);
+  buf.resize(size + 2, '\0');
+  scanner->cur = buf.data();
+  return scanner;
+}
+
+void ScannerDestroy(void* scanner) {
+  delete static_cast<scanner_t*>(scanner);
+}
+
+const char* ScannerText(void* scanner) {
+  auto text = static_cast<scanner_t*>(scanner)->text;
+  return text ? text : "";
+}
+
+// 与不带 yylineno 选项的 Flex lexer 相同, 不记录行号
+int ScannerLine(void*) {
+  return 1;
+}
+
+// 结束位于 [start, end) 的 token
+static void EndToken(scanner_t* s, char* start, char* end) {
+  s->hold_pos = end;
+  s->hold_char = *end;
+  *end = '\0';
+  s->text = start;
+  s->cur = end;
+}
+
+yy::parser::symbol_type yylex(parse_context_t& ctx) {
+  auto s = static_cast<scanner_t*>(ctx.scanner);
+  if (s->hold_pos) {
+    *s->hold_pos = s->hold_char;
+    s->hold_pos = nullptr;
+  }
+
+  // 跳过空白符和注释
+  char* cur = s->cur;
+  for (;;) {
+    cur = SkipSpace(cur);
+    if (cur[0] != '/')
+      break;
+    if (cur[1] == '/')
+      cur = SkipLine(cur + 2);
+    else if (cur[1] == '*')
+      cur = SkipBlockComment(cur + 2);
+    else
+      break;
+  }
+
+  char* start = cur;
+  if (!*cur) {
+    s->cur = s->text = cur;
+    return yy::parser::make_YYEOF();
+  } else if (Is(*cur, CHAR_IDENT_START)) {
+    cur = IdentEnd(cur + 1);
+    size_t len = cur - start;
+    auto keyword = Keyword(start, len);
+    EndToken(s, start, cur);
+    if (keyword != yy::parser::token::YYEOF)
+      return yy::parser::symbol_type(keyword);
+    return yy::parser::make_IDENT(interner.Intern(start, len));
+  } else if (Is(*cur, CHAR_DIGIT)) {
+    int32_t value;
+    cur = Number(cur, value);
+    EndToken(s, start, cur);
+    return yy::parser::make_INT_CONST(value);
+  }
+  EndToken(s, start, cur + 1);
+  return yy::parser::symbol_type(*start);
+}
+
+#endif
@@ -0,0 +1,68 @@
+#include <cassert>
+
+#include "location.hpp"
+
+using namespace std;
+
+const char* const reg_names[32] = {
+    "x0", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+    "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+    "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+    "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6",
+};
+
+void ValueIndex::Reset(size_t expected) {
+  size_t capacity = 16;
+  while (capacity < expected * 2)
+    capacity <<= 1;
+  keys.assign(capacity, nullptr);
+  indices.assign(capacity, 0);
+  mask = capacity - 1;
+  count = 0;
+}
+
+// 线性探测, 找到值所在或应插入的槽
+size_t ValueIndex::Slot(koopa_raw_value_t value) const {
+  uintptr_t h = reinterpret_cast<uintptr_t>(value);
+  h = (h >> 4) * 0x9E3779B97F4A7C15ull;
+  size_t slot = (h >> 16) & mask;
+  while (keys[slot] != nullptr && keys[slot] != value)
+    slot = (slot + 1) & mask;
+  return slot;
+}
+
+void ValueIndex::Grow() {
+  vector<koopa_raw_value_t> old_keys = move(keys);
+  vector<uint32_t> old_indices = move(indices);
+  keys.assign(old_keys.size() * 2, nullptr);
+  indices.assign(old_keys.size() * 2, 0);
+  mask = keys.size() - 1;
+  for (size_t i = 0; i < old_keys.size(); i++)
+    if (old_keys[i] != nullptr) {
+      size_t slot = Slot(old_keys[i]);
+      keys[slot] = old_keys[i];
+      indices[slot] = old_indices[i];
+    }
+}
+
+uint32_t ValueIndex::Insert(koopa_raw_value_t value) {
+  if (keys.empty())
+    Reset(0);
+  size_t slot = Slot(value);
+  if (keys[slot] == value)
+    return indices[slot];
+  if ((count + 1) * 2 > keys.size()) {
+    Grow();
+    slot = Slot(value);
+  }
+  keys[slot] = value;
+  indices[slot] = count;
+  return count++;
+}
+
+uint32_t ValueIndex::operator[](koopa_raw_value_t value) const {
+  assert(!keys.empty());
+  size_t slot = Slot(value);
+  assert(keys[slot] == value);
+  return indices[slot];
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "koopa.h"
+
+// RISC-V 寄存器, 取值即 x0 ~ x31 的编号
+typedef uint8_t reg_t;
+
+enum : reg_t {
+  ZERO = 0, RA = 1, SP = 2,
+  T0 = 5, T1 = 6, T2 = 7,
+  S0 = 8, S1 = 9,
+  A0 = 10, A1 = 11, A2 = 12, A3 = 13, A4 = 14, A5 = 15, A6 = 16, A7 = 17,
+  S2 = 18, S3 = 19, S4 = 20, S5 = 21, S6 = 22, S7 = 23, S8 = 24, S9 = 25, S10 = 26, S11 = 27,
+  T3 = 28, T4 = 29, T5 = 30, T6 = 31,
+};
+
+extern const char* const reg_names[32];
+
+// 是否是 callee-saved 寄存器
+inline bool IsCalleeSaved(reg_t reg) {
+  return reg == S0 || reg == S1 || (reg >= S2 && reg <= S11);
+}
+
+// 值所在的位置
+typedef struct {
+  enum : uint8_t {
+    NONE,
+    // 寄存器 reg
+    REG,
+    // 栈上 data(sp)
+    STACK,
+    // 全局变量 var_<data>
+    GLOBAL,
+    // 立即数 data
+    IMM,
+  } kind;
+  reg_t reg;
+  int32_t data;
+} location_t;
+
+// 为函数内的值分配稠密下标, 以指针为键的开放寻址表
+class ValueIndex {
+ public:
+  // 清空并按预计的值数量预留空间
+  void Reset(size_t expected);
+  // 返回值的下标, 尚未编号时分配新的下标
+  uint32_t Insert(koopa_raw_value_t value);
+  // 返回已编号的值的下标
+  uint32_t operator[](koopa_raw_value_t value) const;
+  size_t size() const { return count; }
+
+ private:
+  size_t Slot(koopa_raw_value_t value) const;
+  void Grow();
+
+  std::vector<koopa_raw_value_t> keys;
+  std::vector<uint32_t> indices;
+  size_t mask = 0;
+  uint32_t count = 0;
+};
@@ -1,43 +1,90 @@
 #include <cassert>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <fcntl.h>
 #include <iostream>
 #include <memory>
 #include <string>
-
-// std::string str;
+#include <unistd.h>
+#include <vector>
 
 #include "ast.hpp"
+#include "irbuilder.hpp"
+#include "parser.hpp"
+#include "pass.hpp"
+#include "printer.hpp"
+#include "rawbuilder.hpp"
+#include "regalloc.hpp"
+#include "source.hpp"
+#include "stream.hpp"
 #include "visit.hpp"
 
 using namespace std;
 
-string str;
-
-// 声明 lexer 的输入, 以及 parser 函数
-// 为什么不引用 sysy.tab.hpp 呢? 因为首先里面没有 yyin 的定义
-// 其次, 因为这个文件不是我们自己写的, 而是被 Bison 生成出来的
-// 你的代码编辑器/IDE 很可能找不到这个文件, 然后会给你报错 (虽然编译不会出错)
-// 看起来会很烦人, 于是干脆采用这种看起来 dirty 但实际很有效的手段
-extern FILE* yyin;
-extern int yyparse(unique_ptr<BaseAST>& ast);
-
 int main(int argc, const char* argv[]) {
   // 解析命令行参数. 测试脚本/评测平台要求你的编译器能接收如下参数:
-  // compiler 模式 输入文件 -o 输出文件
-  assert(argc == 5);
+  // compiler 模式 输入文件 -o 输出文件 [-O0|-O1|-O2] [-stream|-pipeline] [-jN]
+  assert(argc >= 5);
   auto mode = argv[1];
   auto input = argv[2];
   auto output = argv[4];
 
-  // 打开输入文件, 并且指定 lexer 在解析的时候读取这个文件
-  yyin = fopen(input, "r");
-  assert(yyin);
+  // 优化等级: -O0 不做优化, -O1 (默认) 生成 IR 时直接构造 SSA 并运行 BuildPipeline 中的优化,
+  // -O2 另外使用图着色寄存器分配
+  // -stream: 逐个函数地生成并输出, 不保留整个程序的 AST 与 IR, 见 stream.hpp
+  // -pipeline: 同 -stream, 但语法分析, IR 生成与后端在三个线程中流水进行
+  // -jN: 用 N 个线程并行生成各函数的 IR 与汇编, 输出与单线程相同
+  int opt_level = 1;
+  bool streaming = false;
+  bool pipelined = false;
+  int jobs = 1;
+  for (int i = 5; i < argc; i++) {
+    auto opt = argv[i];
+    if (!strcmp(opt, "-stream")) {
+      streaming = true;
+      continue;
+    }
+    if (!strcmp(opt, "-pipeline")) {
+      pipelined = true;
+      continue;
+    }
+    if (opt[0] == '-' && opt[1] == 'j') {
+      jobs = atoi(opt + 2);
+      assert(jobs >= 1);
+      continue;
+    }
+    assert(opt[0] == '-' && opt[1] == 'O' && opt[2] >= '0' && opt[2] <= '2' && opt[3] == '\0');
+    opt_level = opt[2] - '0';
+  }
+  if (opt_level >= 1)
+    ssa_mode = true;
+  if (opt_level >= 2)
+    reg_alloc_mode = GRAPH_COLORING;
+  codegen_jobs = jobs;
+
+  // 打开输入文件 ("-" 为标准输入)
+  SourceFile source;
+  bool opened = source.Open(input);
+  assert(opened);
+
+  if ((streaming || pipelined) && (!strcmp(mode, "-koopa") || !strcmp(mode, "-riscv"))) {
+    int fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(fd >= 0);
+    {
+      Writer out(fd);
+      bool riscv = !strcmp(mode, "-riscv");
+      bool ok = pipelined ? CompilePipelined(source, riscv, opt_level, out) : CompileStreaming(source, riscv, opt_level, out);
+      assert(ok);
+    }
+    close(fd);
+    return 0;
+  }
 
-  // 调用 parser 函数, parser 函数会进一步调用 lexer 解析输入文件的
-  unique_ptr<BaseAST> ast;
-  auto ret = yyparse(ast);
-  assert(!ret);
+  // 调用 parser 函数, parser 函数会进一步调用 lexer 解析输入文件
+  // AST 节点都分配在 ast_arena 中
+  BaseAST* ast = Parse(source);
+  assert(ast);
 
   if (!strcmp(mode, "-ast")) {
     freopen(output, "w", stdout);
@@ -47,41 +94,41 @@ int main(int argc, const char* argv[]) {
 
     fclose(stdout);
 
-  } else if (!strcmp(mode, "-koopa")) {
-    freopen(output, "w", stdout);
-    ast->Output();
-
-    cout << str;
-    cout << endl;
-
-    fclose(stdout);
-
-  } else if (!strcmp(mode, "-riscv")) {
-    freopen(output, "w", stdout);
-    ast->Output();
-
-    char ir_string[str.length()];
-    strcpy(ir_string, str.c_str());
-
-    // 解析字符串 str, 得到 Koopa IR 程序
-    koopa_program_t program;
-    koopa_error_code_t koopa_ret = koopa_parse_from_string(ir_string, &program);
-    assert(koopa_ret == KOOPA_EC_SUCCESS);  // 确保解析时没有出错
-    // 创建一个 raw program builder, 用来构建 raw program
-    koopa_raw_program_builder_t builder = koopa_new_raw_program_builder();
-    // 将 Koopa IR 程序转换为 raw program
-    koopa_raw_program_t raw = koopa_build_raw_program(builder, program);
-    // 释放 Koopa IR 程序占用的内存
-    koopa_delete_program(program);
-
-    Visit(raw);
-
-    // 处理完成, 释放 raw program builder 占用的内存
-    // 注意, raw program 中所有的指针指向的内存均为 raw program builder 的内存
-    // 所以不要在 raw program 处理完毕之前释放 builder
-    koopa_delete_raw_program_builder(builder);
-
-    fclose(stdout);
+  } else if (!strcmp(mode, "-koopa") || !strcmp(mode, "-riscv")) {
+    // 输出经 Writer 分块直接写入文件描述符, 不经过 stdout
+    int fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(fd >= 0);
+
+    // 由 AST 直接在内存池中构建 raw program
+    RawArena arena;
+    IRBuilder builder(arena);
+    ir_builder = &builder;
+    // 并行生成 IR 时每个线程的函数体所在的内存池
+    vector<RawArena> body_arenas(jobs > 1 ? jobs : 0);
+    // 先解析名字, 将标识符的使用绑定到声明, 再生成 IR
+    ast->Resolve();
+    if (jobs > 1)
+      OutputParallel(ast, body_arenas);
+    else
+      ast->Output();
+    koopa_raw_program_t raw = builder.Finish();
+    // IR 生成后不再需要 AST, 整体释放
+    ast = nullptr;
+    ast_arena.Clear();
+
+    PassManager passes(arena);
+    BuildPipeline(passes, opt_level);
+    passes.Run(raw);
+
+    {
+      Writer out(fd);
+      if (!strcmp(mode, "-koopa"))
+        PrintKoopa(raw, out);
+      else
+        Visit(raw, out);
+    }
+
+    close(fd);
   }
 
   return 0;
@@ -0,0 +1,368 @@
+#include <cassert>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cfg.hpp"
+#include "mem2reg.hpp"
+
+using namespace std;
+
+namespace {
+
+// 提升过程中可修改的基本块
+typedef struct {
+  koopa_raw_basic_block_data_t* bb;
+  vector<koopa_raw_value_t> params;
+  // 参数对应的 alloc 下标, 原有参数为 -1
+  vector<int> param_alloc;
+  vector<koopa_raw_value_t> insts;
+  // 出边的目标 (jump 的目标, 或 branch 的 true/false 目标) 及传递的参数
+  vector<int> targets;
+  vector<vector<koopa_raw_value_t>> args;
+} block_t;
+
+class Promoter {
+ public:
+  Promoter(koopa_raw_function_data_t* func, PassManager& pm) : func(func), pm(pm), arena(pm.Arena()) {}
+
+  bool Run() {
+    Build();
+    Collect();
+    if (!allocs.empty()) {
+      PlaceParams();
+      Rename();
+      changed = true;
+    }
+    // 前端即时构造 SSA 时也可能留下平凡或无用的参数, 一并清理
+    RemoveTrivialParams();
+    RemoveDeadParams();
+    if (changed)
+      Write();
+    return changed;
+  }
+
+ private:
+  koopa_raw_function_data_t* func;
+  PassManager& pm;
+  RawArena& arena;
+  vector<block_t> blocks;
+  // 入边: (前驱, 前驱的第几条出边)
+  vector<vector<pair<int, size_t>>> preds;
+  // 支配树上的子结点
+  vector<vector<int>> children;
+  unordered_map<koopa_raw_basic_block_t, int> index;
+  // 可提升的 alloc 及其下标
+  vector<koopa_raw_value_t> allocs;
+  unordered_map<koopa_raw_value_t, int> alloc_id;
+  // 被删除的值 (load / 平凡的基本块参数) 到替代值的映射
+  unordered_map<koopa_raw_value_t, koopa_raw_value_t> replace;
+  int param_cnt = 0;
+  bool changed = false;
+
+  koopa_raw_value_t Resolve(koopa_raw_value_t value) {
+    auto it = replace.find(value);
+    while (it != replace.end()) {
+      value = it->second;
+      it = replace.find(value);
+    }
+    return value;
+  }
+
+  // 由控制流图建立可修改的基本块, 要求所有基本块均可达
+  void Build() {
+    const auto& cfg = pm.CFG(func);
+    index = cfg.index;
+    for (auto bb : cfg.blocks) {
+      block_t block;
+      block.bb = const_cast<koopa_raw_basic_block_data_t*>(bb);
+      for (uint32_t j = 0; j < bb->params.len; j++) {
+        block.params.push_back(ValueAt(bb->params, j));
+        block.param_alloc.push_back(-1);
+      }
+      for (uint32_t j = 0; j < bb->insts.len; j++)
+        block.insts.push_back(ValueAt(bb->insts, j));
+      blocks.push_back(block);
+    }
+
+    preds.resize(blocks.size());
+    for (size_t i = 0; i < blocks.size(); i++) {
+      auto& block = blocks[i];
+      if (block.insts.empty())
+        continue;
+      const auto& kind = block.insts.back()->kind;
+      auto add_edge = [&](koopa_raw_basic_block_t target, const koopa_raw_slice_t& args) {
+        block.targets.push_back(index[target]);
+        block.args.emplace_back();
+        for (uint32_t j = 0; j < args.len; j++)
+          block.args.back().push_back(ValueAt(args, j));
+        preds[index[target]].push_back({i, block.targets.size() - 1});
+      };
+      if (kind.tag == KOOPA_RVT_JUMP) {
+        add_edge(kind.data.jump.target, kind.data.jump.args);
+      } else if (kind.tag == KOOPA_RVT_BRANCH) {
+        add_edge(kind.data.branch.true_bb, kind.data.branch.true_args);
+        add_edge(kind.data.branch.false_bb, kind.data.branch.false_args);
+      }
+    }
+  }
+
+  // 找出只作为 load 的源 / store 的目标出现的 alloc i32
+  void Collect() {
+    unordered_map<koopa_raw_value_t, bool> escaped;
+    for (auto& block : blocks)
+      for (auto inst : block.insts)
+        if (inst->kind.tag == KOOPA_RVT_ALLOC && inst->ty->data.pointer.base->tag == KOOPA_RTT_INT32)
+          escaped[inst] = false;
+
+    for (auto& block : blocks)
+      for (auto inst : block.insts) {
+        if (inst->kind.tag == KOOPA_RVT_LOAD)
+          continue;
+        if (inst->kind.tag == KOOPA_RVT_STORE) {
+          auto it = escaped.find(inst->kind.data.store.value);
+          if (it != escaped.end())
+            it->second = true;
+          continue;
+        }
+        ForEachOperandRef(const_cast<koopa_raw_value_data_t*>(inst), [&](koopa_raw_value_t& op) {
+          auto it = escaped.find(op);
+          if (it != escaped.end())
+            it->second = true;
+        });
+      }
+
+    for (auto& block : blocks)
+      for (auto inst : block.insts)
+        if (inst->kind.tag == KOOPA_RVT_ALLOC && escaped.count(inst) && !escaped[inst]) {
+          alloc_id[inst] = allocs.size();
+          allocs.push_back(inst);
+        }
+  }
+
+  // 在定义所在基本块的迭代支配边界上放置基本块参数
+  void PlaceParams() {
+    const auto& idom = pm.Dominators(func);
+    const auto& df = pm.DominanceFrontiers(func);
+
+    vector<vector<int>> def_blocks(allocs.size());
+    for (size_t b = 0; b < blocks.size(); b++)
+      for (auto inst : blocks[b].insts)
+        if (inst->kind.tag == KOOPA_RVT_STORE) {
+          auto it = alloc_id.find(inst->kind.data.store.dest);
+          if (it != alloc_id.end() && (def_blocks[it->second].empty() || def_blocks[it->second].back() != int(b)))
+            def_blocks[it->second].push_back(b);
+        }
+
+    for (size_t a = 0; a < allocs.size(); a++) {
+      vector<bool> has_param(blocks.size(), false), queued(blocks.size(), false);
+      vector<int> worklist = def_blocks[a];
+      for (int b : worklist)
+        queued[b] = true;
+      while (!worklist.empty()) {
+        int b = worklist.back();
+        worklist.pop_back();
+        for (int d : df[b]) {
+          if (has_param[d] || d == 0)
+            continue;
+          has_param[d] = true;
+          AddParam(d, a);
+          if (!queued[d]) {
+            queued[d] = true;
+            worklist.push_back(d);
+          }
+        }
+      }
+    }
+
+    children.assign(blocks.size(), {});
+    for (size_t b = 1; b < blocks.size(); b++) {
+      assert(idom[b] != -1);
+      children[idom[b]].push_back(b);
+    }
+  }
+
+  void AddParam(int b, int a) {
+    auto alloc = allocs[a];
+    string name = alloc->name != nullptr ? string(alloc->name + 1) : string("phi");
+    name = "%" + name + "_" + to_string(param_cnt++);
+    auto param = arena.NewValue(alloc->ty->data.pointer.base, arena.Name(name), KOOPA_RVT_BLOCK_ARG_REF);
+    blocks[b].params.push_back(param);
+    blocks[b].param_alloc.push_back(a);
+  }
+
+  // 沿支配树先序遍历, 维护每个变量的当前值
+  void Rename() {
+    koopa_raw_value_t zero = arena.Integer(0);
+    vector<vector<koopa_raw_value_t>> current(allocs.size(), vector<koopa_raw_value_t>{zero});
+
+    // 栈中元素: 基本块, 是否已处理; 处理时记录压栈的变量, 离开时弹出
+    vector<vector<int>> pushed(blocks.size());
+    vector<pair<int, bool>> stack = {{0, false}};
+    while (!stack.empty()) {
+      auto [b, done] = stack.back();
+      stack.pop_back();
+      if (done) {
+        for (int a : pushed[b])
+          current[a].pop_back();
+        continue;
+      }
+      stack.push_back({b, true});
+
+      auto& block = blocks[b];
+      for (size_t i = 0; i < block.params.size(); i++)
+        if (block.param_alloc[i] != -1) {
+          current[block.param_alloc[i]].push_back(block.params[i]);
+          pushed[b].push_back(block.param_alloc[i]);
+        }
+
+      vector<koopa_raw_value_t> insts;
+      for (auto inst : block.insts) {
+        const auto& kind = inst->kind;
+        if (kind.tag == KOOPA_RVT_ALLOC && alloc_id.count(inst))
+          continue;
+        if (kind.tag == KOOPA_RVT_LOAD && alloc_id.count(kind.data.load.src)) {
+          replace[inst] = current[alloc_id[kind.data.load.src]].back();
+          continue;
+        }
+        if (kind.tag == KOOPA_RVT_STORE && alloc_id.count(kind.data.store.dest)) {
+          int a = alloc_id[kind.data.store.dest];
+          current[a].push_back(Resolve(kind.data.store.value));
+          pushed[b].push_back(a);
+          continue;
+        }
+        ForEachOperandRef(const_cast<koopa_raw_value_data_t*>(inst), [&](koopa_raw_value_t& op) {
+          op = Resolve(op);
+        });
+        insts.push_back(inst);
+      }
+      block.insts = insts;
+
+      for (size_t e = 0; e < block.targets.size(); e++) {
+        auto& target = blocks[block.targets[e]];
+        for (auto& arg : block.args[e])
+          arg = Resolve(arg);
+        for (size_t i = 0; i < target.params.size(); i++)
+          if (target.param_alloc[i] != -1)
+            block.args[e].push_back(current[target.param_alloc[i]].back());
+      }
+
+      for (auto it = children[b].rbegin(); it != children[b].rend(); it++)
+        stack.push_back({*it, false});
+    }
+  }
+
+  // 删除第 b 个基本块的第 i 个参数, 以及所有入边上对应的实参
+  void RemoveParam(int b, size_t i) {
+    for (auto [p, e] : preds[b])
+      blocks[p].args[e].erase(blocks[p].args[e].begin() + i);
+    blocks[b].params.erase(blocks[b].params.begin() + i);
+    blocks[b].param_alloc.erase(blocks[b].param_alloc.begin() + i);
+    changed = true;
+  }
+
+  // 所有入边传入的值 (除自身外) 都相同的参数可直接替换为该值
+  void RemoveTrivialParams() {
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (size_t b = 0; b < blocks.size(); b++)
+        for (size_t i = blocks[b].params.size(); i-- > 0;) {
+          auto param = blocks[b].params[i];
+          koopa_raw_value_t same = nullptr;
+          bool trivial = true;
+          for (auto [p, e] : preds[b]) {
+            auto arg = Resolve(blocks[p].args[e][i]);
+            if (arg == param || arg == same)
+              continue;
+            if (same != nullptr)
+              trivial = false;
+            same = arg;
+          }
+          if (!trivial || same == nullptr)
+            continue;
+          replace[param] = same;
+          RemoveParam(b, i);
+          changed = true;
+        }
+    }
+  }
+
+  // 删除只被传给其他无用参数的参数
+  void RemoveDeadParams() {
+    unordered_map<koopa_raw_value_t, pair<int, size_t>> position;
+    for (size_t b = 0; b < blocks.size(); b++)
+      for (size_t i = 0; i < blocks[b].params.size(); i++)
+        position[blocks[b].params[i]] = {b, i};
+
+    unordered_map<koopa_raw_value_t, bool> live;
+    vector<koopa_raw_value_t> worklist;
+    auto mark = [&](koopa_raw_value_t value) {
+      value = Resolve(value);
+      if (position.count(value) && !live[value]) {
+        live[value] = true;
+        worklist.push_back(value);
+      }
+    };
+    for (auto& block : blocks) {
+      for (auto inst : block.insts)
+        ForEachOperandRef(const_cast<koopa_raw_value_data_t*>(inst), [&](koopa_raw_value_t& op) {
+          if (inst->kind.tag != KOOPA_RVT_JUMP && inst->kind.tag != KOOPA_RVT_BRANCH)
+            mark(op);
+          else if (inst->kind.tag == KOOPA_RVT_BRANCH && op == inst->kind.data.branch.cond)
+            mark(op);
+        });
+    }
+    while (!worklist.empty()) {
+      auto [b, i] = position[worklist.back()];
+      worklist.pop_back();
+      for (auto [p, e] : preds[b])
+        mark(blocks[p].args[e][i]);
+    }
+
+    for (size_t b = 0; b < blocks.size(); b++)
+      for (size_t i = blocks[b].params.size(); i-- > 0;)
+        if (!live[blocks[b].params[i]])
+          RemoveParam(b, i);
+  }
+
+  // 写回函数的基本块
+  void Write() {
+    vector<const void*> bbs;
+    for (auto& block : blocks) {
+      auto bb = block.bb;
+      for (size_t i = 0; i < block.params.size(); i++)
+        const_cast<koopa_raw_value_data_t*>(block.params[i])->kind.data.block_arg_ref.index = i;
+      bb->params = arena.Slice(vector<const void*>(block.params.begin(), block.params.end()), KOOPA_RSIK_VALUE);
+
+      for (auto inst : block.insts)
+        ForEachOperandRef(const_cast<koopa_raw_value_data_t*>(inst), [&](koopa_raw_value_t& op) {
+          op = Resolve(op);
+        });
+      if (!block.insts.empty()) {
+        auto& kind = const_cast<koopa_raw_value_data_t*>(block.insts.back())->kind;
+        auto slice = [&](size_t e) {
+          vector<const void*> args;
+          for (auto arg : block.args[e])
+            args.push_back(Resolve(arg));
+          return arena.Slice(args, KOOPA_RSIK_VALUE);
+        };
+        if (kind.tag == KOOPA_RVT_JUMP) {
+          kind.data.jump.args = slice(0);
+        } else if (kind.tag == KOOPA_RVT_BRANCH) {
+          kind.data.branch.true_args = slice(0);
+          kind.data.branch.false_args = slice(1);
+        }
+      }
+      bb->insts = arena.Slice(vector<const void*>(block.insts.begin(), block.insts.end()), KOOPA_RSIK_VALUE);
+      bbs.push_back(bb);
+    }
+    func->bbs = arena.Slice(bbs, KOOPA_RSIK_BASIC_BLOCK);
+  }
+};
+
+}  // namespace
+
+bool Mem2Reg(koopa_raw_function_data_t* func, PassManager& pm) {
+  return Promoter(func, pm).Run();
+}
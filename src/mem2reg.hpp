@@ -0,0 +1,8 @@
+#pragma once
+
+#include "koopa.h"
+#include "pass.hpp"
+
+// 将只被 load/store 访问的 alloc i32 提升为 SSA 值, 汇合处使用基本块参数
+// 同时删除平凡或无用的基本块参数. 要求函数中没有不可达的基本块
+bool Mem2Reg(koopa_raw_function_data_t* func, PassManager& pm);
@@ -0,0 +1,15 @@
+#include "mir.hpp"
+
+using namespace std;
+
+void MFunction::Reset(const char* name) {
+  this->name = name;
+  labels.clear();
+  blocks.clear();
+  insts.clear();
+  blocks.push_back(mblock_t{-1, 0});
+}
+
+void MFunction::Block(label_t label) {
+  blocks.push_back(mblock_t{AddLabel(label), uint32_t(insts.size())});
+}
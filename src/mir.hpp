@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 机器指令的寄存器操作数: 物理寄存器的编号 0 ~ 31, 寄存器分配在 Koopa IR 上完成
+typedef uint16_t mreg_t;
+
+// 汇编标号: 名字后接可选的编号, 如 var_3, edge_0, 或基本块名 while_1
+typedef struct {
+  const char* name;
+  // 小于 0 时没有编号
+  int32_t index;
+} label_t;
+
+inline label_t Label(const char* name) {
+  return {name, -1};
+}
+
+inline label_t Label(const char* prefix, int32_t index) {
+  return {prefix, index};
+}
+
+// 机器指令的操作码
+enum class mop_t : uint8_t {
+  // rd, rs1, rs2
+  ADD, SUB, MUL, DIV, REM,
+  AND, OR, XOR,
+  SLL, SRL, SRA,
+  SLT, SGT,
+  // rd, rs1
+  MV, SEQZ, SNEZ,
+  // rd, rs1, imm
+  ADDI,
+  // rd, imm
+  LI,
+  // lw rd, imm(rs1) / sw rs2, imm(rs1)
+  LW, SW,
+  // 以下 imm 为标号在函数标号表中的下标
+  // la rd, label
+  LA,
+  // beqz/bnez rs1, label
+  BEQZ, BNEZ,
+  J, CALL,
+  RET,
+};
+
+// 一条机器指令, 未用到的操作数为 0
+typedef struct {
+  mop_t op;
+  mreg_t rd;
+  mreg_t rs1;
+  mreg_t rs2;
+  int32_t imm;
+} minst_t;
+
+// 基本块, 指令为 insts 中 [begin, 下一块的 begin) 的部分
+typedef struct {
+  // 块的标号在标号表中的下标, 入口块没有标号时为 -1
+  int32_t label;
+  uint32_t begin;
+} mblock_t;
+
+// 一个函数的机器指令, 按基本块连续存放
+class MFunction {
+ public:
+  // 清空并开始新的函数, 同时创建没有标号的入口块
+  void Reset(const char* name);
+
+  const char* Name() const { return name; }
+  const std::vector<mblock_t>& Blocks() const { return blocks; }
+  const std::vector<minst_t>& Insts() const { return insts; }
+  label_t LabelAt(int32_t index) const { return labels[index]; }
+  // 第 i 个块的指令结束位置
+  uint32_t BlockEnd(size_t i) const { return i + 1 < blocks.size() ? blocks[i + 1].begin : uint32_t(insts.size()); }
+
+  // 开始带标号的新块, 之后的指令加入其中
+  void Block(label_t label);
+
+  void Li(mreg_t rd, int32_t imm) { Add(mop_t::LI, rd, 0, 0, imm); }
+  void La(mreg_t rd, label_t label) { Add(mop_t::LA, rd, 0, 0, AddLabel(label)); }
+  void Mv(mreg_t rd, mreg_t rs) { Add(mop_t::MV, rd, rs, 0, 0); }
+  void Addi(mreg_t rd, mreg_t rs, int32_t imm) { Add(mop_t::ADDI, rd, rs, 0, imm); }
+  void Lw(mreg_t rd, int32_t off, mreg_t base) { Add(mop_t::LW, rd, base, 0, off); }
+  void Sw(mreg_t rs, int32_t off, mreg_t base) { Add(mop_t::SW, 0, base, rs, off); }
+  // 三个寄存器操作数的运算
+  void Op(mop_t op, mreg_t rd, mreg_t rs1, mreg_t rs2) { Add(op, rd, rs1, rs2, 0); }
+  void Seqz(mreg_t rd, mreg_t rs) { Add(mop_t::SEQZ, rd, rs, 0, 0); }
+  void Snez(mreg_t rd, mreg_t rs) { Add(mop_t::SNEZ, rd, rs, 0, 0); }
+  void Beqz(mreg_t rs, label_t label) { Add(mop_t::BEQZ, 0, rs, 0, AddLabel(label)); }
+  void Bnez(mreg_t rs, label_t label) { Add(mop_t::BNEZ, 0, rs, 0, AddLabel(label)); }
+  void J(label_t label) { Add(mop_t::J, 0, 0, 0, AddLabel(label)); }
+  void Call(label_t label) { Add(mop_t::CALL, 0, 0, 0, AddLabel(label)); }
+  void Ret() { Add(mop_t::RET, 0, 0, 0, 0); }
+
+ private:
+  const char* name = nullptr;
+  std::vector<label_t> labels;
+  std::vector<mblock_t> blocks;
+  std::vector<minst_t> insts;
+
+  void Add(mop_t op, mreg_t rd, mreg_t rs1, mreg_t rs2, int32_t imm) {
+    insts.push_back(minst_t{op, rd, rs1, rs2, imm});
+  }
+  int32_t AddLabel(label_t label) {
+    labels.push_back(label);
+    return labels.size() - 1;
+  }
+};
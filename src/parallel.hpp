@@ -0,0 +1,85 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// 工作窃取: 每个线程持有一段连续的下标 [begin, end), 打包在一个原子变量中
+// 自己从前端逐个取出, 取完后从剩余最多的线程处取走后一半. 下标只会被分出一次, 不存在 ABA
+typedef struct alignas(64) {
+  std::atomic<uint64_t> range;
+} work_range_t;
+
+inline uint64_t PackRange(uint32_t begin, uint32_t end) {
+  return (uint64_t(begin) << 32) | end;
+}
+
+// 用 jobs 个线程 (包括调用线程) 对 0 .. n-1 各调用一次 f(i, worker), worker 为线程编号 0 .. jobs-1
+// 各线程先处理相邻的下标, 耗时不均时由空闲的线程窃取其他线程剩余的部分
+template <typename F>
+void ParallelFor(size_t n, int jobs, F f) {
+  jobs = std::max(1, int(std::min<size_t>(jobs, n)));
+  std::vector<work_range_t> ranges(jobs);
+  for (int worker = 0; worker < jobs; worker++)
+    ranges[worker].range.store(PackRange(n * worker / jobs, n * (worker + 1) / jobs));
+
+  // 从自己的一段中取出一个下标
+  auto pop = [&](int worker, uint32_t& index) {
+    auto& range = ranges[worker].range;
+    uint64_t cur = range.load();
+    while (uint32_t(cur >> 32) < uint32_t(cur)) {
+      if (range.compare_exchange_weak(cur, cur + (uint64_t(1) << 32))) {
+        index = cur >> 32;
+        return true;
+      }
+    }
+    return false;
+  };
+
+  // 从剩余最多的线程处取走后一半作为自己的一段, 都已取完时返回 false
+  auto steal = [&](int worker) {
+    while (true) {
+      int victim = -1;
+      uint32_t most = 0;
+      for (int other = 0; other < jobs; other++) {
+        uint64_t cur = ranges[other].range.load();
+        uint32_t begin = cur >> 32, end = uint32_t(cur);
+        if (begin < end && end - begin > most) {
+          victim = other;
+          most = end - begin;
+        }
+      }
+      if (victim < 0)
+        return false;
+
+      auto& range = ranges[victim].range;
+      uint64_t cur = range.load();
+      uint32_t begin = cur >> 32, end = uint32_t(cur);
+      if (begin >= end)
+        continue;
+      uint32_t mid = begin + (end - begin) / 2;
+      if (range.compare_exchange_strong(cur, PackRange(begin, mid))) {
+        ranges[worker].range.store(PackRange(mid, end));
+        return true;
+      }
+    }
+  };
+
+  auto work = [&](int worker) {
+    uint32_t index;
+    do {
+      while (pop(worker, index))
+        f(size_t(index), worker);
+    } while (steal(worker));
+  };
+
+  std::vector<std::thread> threads;
+  for (int worker = 1; worker < jobs; worker++)
+    threads.emplace_back(work, worker);
+  work(0);
+  for (auto& thread : threads)
+    thread.join();
+}
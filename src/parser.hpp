@@ -0,0 +1,28 @@
+#pragma once
+
+#include "ast.hpp"
+#include "source.hpp"
+
+// 一次解析的上下文, 作为 yyparse 与 yylex 的参数
+// lexer 与 parser 都不使用全局状态, 不同线程可以同时解析各自的输入
+typedef struct {
+  // lexer 的状态, 由 ScannerCreate 创建
+  void* scanner;
+  // 解析得到的 AST 的根节点
+  BaseAST* ast;
+  // 不为空时流式解析: 每归约出一个顶层声明或函数定义即交给 unit 处理, 不构建 CompUnitAST
+  void (*unit)(BaseAST* item);
+} parse_context_t;
+
+// 以下由 sysy.l 或手写的 lexer.cpp 实现
+// 创建读取 source 的 lexer
+void* ScannerCreate(const SourceFile& source);
+void ScannerDestroy(void* scanner);
+// 当前 token 的文本及行号, 用于报错
+const char* ScannerText(void* scanner);
+int ScannerLine(void* scanner);
+
+// 解析 source, 出错时返回 nullptr, 定义在 sysy.y 中
+BaseAST* Parse(const SourceFile& source);
+// 流式解析 source, 顶层声明与函数定义按出现顺序逐个交给 unit, 返回是否解析成功
+bool ParseUnits(const SourceFile& source, void (*unit)(BaseAST* item));
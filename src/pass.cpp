@@ -0,0 +1,151 @@
+#include "pass.hpp"
+
+#include "cfg.hpp"
+#include "mem2reg.hpp"
+
+using namespace std;
+
+void PassManager::Add(const char* name, pass_t pass, bool preserves_cfg) {
+  passes.push_back(entry_t{name, pass, preserves_cfg});
+}
+
+void PassManager::Run(koopa_raw_program_t& program) {
+  for (auto& entry : passes) {
+    bool changed = false;
+    for (uint32_t i = 0; i < program.funcs.len; i++) {
+      auto func = const_cast<koopa_raw_function_data_t*>(reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]));
+      if (func->bbs.len == 0)
+        continue;
+      if (entry.pass(func, *this)) {
+        changed = true;
+        if (!entry.preserves_cfg)
+          cache.erase(func);
+      }
+    }
+    if (changed)
+      RebuildUses(program, arena);
+  }
+}
+
+const cfg_t& PassManager::CFG(koopa_raw_function_t func) {
+  auto& analyses = cache[func];
+  if (analyses.has_cfg)
+    return analyses.cfg;
+
+  auto& cfg = analyses.cfg;
+  for (uint32_t i = 0; i < func->bbs.len; i++) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    cfg.index[bb] = cfg.blocks.size();
+    cfg.blocks.push_back(bb);
+  }
+  cfg.succ.resize(cfg.blocks.size());
+  cfg.preds.resize(cfg.blocks.size());
+  for (size_t i = 0; i < cfg.blocks.size(); i++)
+    for (auto s : Successors(cfg.blocks[i])) {
+      cfg.succ[i].push_back(cfg.index[s]);
+      cfg.preds[cfg.index[s]].push_back(i);
+    }
+  analyses.has_cfg = true;
+  return cfg;
+}
+
+const vector<int>& PassManager::Dominators(koopa_raw_function_t func) {
+  const auto& cfg = CFG(func);
+  auto& analyses = cache[func];
+  if (!analyses.has_idom) {
+    analyses.idom = ImmediateDominators(cfg.succ);
+    analyses.has_idom = true;
+  }
+  return analyses.idom;
+}
+
+const vector<vector<int>>& PassManager::DominanceFrontiers(koopa_raw_function_t func) {
+  const auto& idom = Dominators(func);
+  auto& analyses = cache[func];
+  if (!analyses.has_df) {
+    analyses.df = ::DominanceFrontiers(analyses.cfg.succ, idom);
+    analyses.has_df = true;
+  }
+  return analyses.df;
+}
+
+void BuildPipeline(PassManager& pm, int opt_level) {
+  if (opt_level >= 1) {
+    pm.Add("unreachable", RemoveUnreachableBlocks, false);
+    pm.Add("mem2reg", Mem2Reg, true);
+    pm.Add("dce", EliminateDeadCode, true);
+  }
+}
+
+bool RemoveUnreachableBlocks(koopa_raw_function_data_t* func, PassManager& pm) {
+  const auto& cfg = pm.CFG(func);
+  vector<bool> reachable(cfg.blocks.size(), false);
+  size_t count = 0;
+  for (int b : ReversePostorder(cfg.succ)) {
+    reachable[b] = true;
+    count++;
+  }
+  if (count == cfg.blocks.size())
+    return false;
+
+  vector<const void*> bbs;
+  for (size_t i = 0; i < cfg.blocks.size(); i++)
+    if (reachable[i])
+      bbs.push_back(cfg.blocks[i]);
+  func->bbs = pm.Arena().Slice(bbs, KOOPA_RSIK_BASIC_BLOCK);
+  return true;
+}
+
+// 删除后不影响程序行为的指令
+static bool IsPure(koopa_raw_value_t inst) {
+  switch (inst->kind.tag) {
+    case KOOPA_RVT_ALLOC:
+    case KOOPA_RVT_LOAD:
+    case KOOPA_RVT_GET_PTR:
+    case KOOPA_RVT_GET_ELEM_PTR:
+    case KOOPA_RVT_BINARY:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool EliminateDeadCode(koopa_raw_function_data_t* func, PassManager& pm) {
+  // 剩余使用次数, 由 used_by 得到, 删除指令时递减其操作数的使用次数
+  unordered_map<koopa_raw_value_t, uint32_t> uses;
+  unordered_map<koopa_raw_value_t, bool> dead;
+  vector<koopa_raw_value_t> worklist;
+  for (uint32_t i = 0; i < func->bbs.len; i++) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    for (uint32_t j = 0; j < bb->insts.len; j++) {
+      auto inst = ValueAt(bb->insts, j);
+      uses[inst] = inst->used_by.len;
+      if (inst->used_by.len == 0 && IsPure(inst))
+        worklist.push_back(inst);
+    }
+  }
+  if (worklist.empty())
+    return false;
+
+  while (!worklist.empty()) {
+    auto inst = worklist.back();
+    worklist.pop_back();
+    dead[inst] = true;
+    ForEachOperandRef(const_cast<koopa_raw_value_data_t*>(inst), [&](koopa_raw_value_t& op) {
+      auto it = uses.find(op);
+      if (it != uses.end() && --it->second == 0 && IsPure(op))
+        worklist.push_back(op);
+    });
+  }
+
+  for (uint32_t i = 0; i < func->bbs.len; i++) {
+    auto bb = const_cast<koopa_raw_basic_block_data_t*>(reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]));
+    vector<const void*> insts;
+    for (uint32_t j = 0; j < bb->insts.len; j++)
+      if (!dead.count(ValueAt(bb->insts, j)))
+        insts.push_back(bb->insts.buffer[j]);
+    if (insts.size() != bb->insts.len)
+      bb->insts = pm.Arena().Slice(insts, KOOPA_RSIK_VALUE);
+  }
+  return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "koopa.h"
+#include "rawbuilder.hpp"
+
+// 函数的控制流图, 基本块以在函数中的下标表示, 0 为入口
+typedef struct {
+  std::vector<koopa_raw_basic_block_t> blocks;
+  std::unordered_map<koopa_raw_basic_block_t, int> index;
+  std::vector<std::vector<int>> succ;
+  std::vector<std::vector<int>> preds;
+} cfg_t;
+
+class PassManager;
+
+// 函数级 pass, 返回函数是否被修改
+typedef bool (*pass_t)(koopa_raw_function_data_t* func, PassManager& pm);
+
+// 依次对每个函数运行 pass, 并缓存分析结果
+// 每个 pass 结束后重新计算 used_by, 因此 pass 可以依赖 used_by 的正确性
+class PassManager {
+ public:
+  explicit PassManager(RawArena& arena) : arena(arena) {}
+
+  RawArena& Arena() { return arena; }
+
+  // preserves_cfg 表示 pass 不增删基本块与跳转, 修改函数后控制流相关的分析仍然有效
+  void Add(const char* name, pass_t pass, bool preserves_cfg);
+  void Run(koopa_raw_program_t& program);
+
+  // 以下分析结果在函数的控制流被修改前有效
+  const cfg_t& CFG(koopa_raw_function_t func);
+  // 直接支配者, 入口的直接支配者为自身, 不可达的基本块为 -1
+  const std::vector<int>& Dominators(koopa_raw_function_t func);
+  const std::vector<std::vector<int>>& DominanceFrontiers(koopa_raw_function_t func);
+
+ private:
+  typedef struct {
+    const char* name;
+    pass_t pass;
+    bool preserves_cfg;
+  } entry_t;
+
+  typedef struct {
+    bool has_cfg;
+    cfg_t cfg;
+    bool has_idom;
+    std::vector<int> idom;
+    bool has_df;
+    std::vector<std::vector<int>> df;
+  } analyses_t;
+
+  RawArena& arena;
+  std::vector<entry_t> passes;
+  std::unordered_map<koopa_raw_function_t, analyses_t> cache;
+};
+
+// 按优化等级组装 pass 序列
+void BuildPipeline(PassManager& pm, int opt_level);
+
+// 删除从入口不可达的基本块
+bool RemoveUnreachableBlocks(koopa_raw_function_data_t* func, PassManager& pm);
+
+// 删除结果未被使用且没有副作用的指令
+bool EliminateDeadCode(koopa_raw_function_data_t* func, PassManager& pm);
@@ -0,0 +1,212 @@
+#include <cassert>
+
+#include "cfg.hpp"
+#include "location.hpp"
+#include "printer.hpp"
+
+using namespace std;
+
+// 当前函数中没有名字的值的编号
+static ValueIndex temps;
+
+static const char* const binary_ops[] = {
+    "ne", "eq", "gt", "lt", "ge", "le", "add", "sub", "mul",
+    "div", "mod", "and", "or", "xor", "shl", "shr", "sar",
+};
+
+static void PrintType(koopa_raw_type_t ty, Writer& out) {
+  switch (ty->tag) {
+    case KOOPA_RTT_INT32:
+      out << "i32";
+      break;
+    case KOOPA_RTT_UNIT:
+      out << "unit";
+      break;
+    case KOOPA_RTT_POINTER:
+      out << '*';
+      PrintType(ty->data.pointer.base, out);
+      break;
+    default:
+      assert(false);
+  }
+}
+
+static void PrintValue(koopa_raw_value_t value, Writer& out) {
+  switch (value->kind.tag) {
+    case KOOPA_RVT_INTEGER:
+      out << value->kind.data.integer.value;
+      break;
+    case KOOPA_RVT_ZERO_INIT:
+      out << "zeroinit";
+      break;
+    case KOOPA_RVT_UNDEF:
+      out << "undef";
+      break;
+    default:
+      if (value->name != nullptr)
+        out << value->name;
+      else
+        out << '%' << int32_t(temps[value]);
+  }
+}
+
+// 以逗号分隔的值, 用于调用与跳转的参数
+static void PrintValues(const koopa_raw_slice_t& values, Writer& out) {
+  for (uint32_t i = 0; i < values.len; i++) {
+    if (i > 0)
+      out << ", ";
+    PrintValue(ValueAt(values, i), out);
+  }
+}
+
+// 跳转目标及其参数
+static void PrintTarget(koopa_raw_basic_block_t bb, const koopa_raw_slice_t& args, Writer& out) {
+  out << bb->name;
+  if (args.len > 0) {
+    out << '(';
+    PrintValues(args, out);
+    out << ')';
+  }
+}
+
+// 带类型的参数列表, 用于函数与基本块的参数
+static void PrintParams(const koopa_raw_slice_t& params, Writer& out) {
+  for (uint32_t i = 0; i < params.len; i++) {
+    if (i > 0)
+      out << ", ";
+    auto param = ValueAt(params, i);
+    PrintValue(param, out);
+    out << ": ";
+    PrintType(param->ty, out);
+  }
+}
+
+static void PrintInst(koopa_raw_value_t inst, Writer& out) {
+  const auto& kind = inst->kind;
+  out << "  ";
+  // 有结果的指令先输出结果的名字
+  if (inst->ty->tag != KOOPA_RTT_UNIT) {
+    PrintValue(inst, out);
+    out << " = ";
+  }
+  switch (kind.tag) {
+    case KOOPA_RVT_ALLOC:
+      out << "alloc ";
+      PrintType(inst->ty->data.pointer.base, out);
+      break;
+    case KOOPA_RVT_LOAD:
+      out << "load ";
+      PrintValue(kind.data.load.src, out);
+      break;
+    case KOOPA_RVT_STORE:
+      out << "store ";
+      PrintValue(kind.data.store.value, out);
+      out << ", ";
+      PrintValue(kind.data.store.dest, out);
+      break;
+    case KOOPA_RVT_BINARY:
+      out << binary_ops[kind.data.binary.op] << ' ';
+      PrintValue(kind.data.binary.lhs, out);
+      out << ", ";
+      PrintValue(kind.data.binary.rhs, out);
+      break;
+    case KOOPA_RVT_BRANCH:
+      out << "br ";
+      PrintValue(kind.data.branch.cond, out);
+      out << ", ";
+      PrintTarget(kind.data.branch.true_bb, kind.data.branch.true_args, out);
+      out << ", ";
+      PrintTarget(kind.data.branch.false_bb, kind.data.branch.false_args, out);
+      break;
+    case KOOPA_RVT_JUMP:
+      out << "jump ";
+      PrintTarget(kind.data.jump.target, kind.data.jump.args, out);
+      break;
+    case KOOPA_RVT_CALL:
+      out << "call " << kind.data.call.callee->name << '(';
+      PrintValues(kind.data.call.args, out);
+      out << ')';
+      break;
+    case KOOPA_RVT_RETURN:
+      out << "ret";
+      if (kind.data.ret.value != nullptr) {
+        out << ' ';
+        PrintValue(kind.data.ret.value, out);
+      }
+      break;
+    default:
+      assert(false);
+  }
+  out << '\n';
+}
+
+static void PrintFunction(koopa_raw_function_t func, Writer& out) {
+  const auto& ty = func->ty->data.function;
+  // 函数声明只有类型
+  if (func->bbs.len == 0) {
+    out << "decl " << func->name << '(';
+    for (uint32_t i = 0; i < ty.params.len; i++) {
+      if (i > 0)
+        out << ", ";
+      PrintType(reinterpret_cast<koopa_raw_type_t>(ty.params.buffer[i]), out);
+    }
+    out << ')';
+    if (ty.ret->tag != KOOPA_RTT_UNIT) {
+      out << ": ";
+      PrintType(ty.ret, out);
+    }
+    out << '\n';
+    return;
+  }
+
+  // 先按出现顺序为没有名字的指令编号, 使用可能出现在定义之前
+  size_t expected = 0;
+  for (uint32_t i = 0; i < func->bbs.len; i++)
+    expected += reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i])->insts.len;
+  temps.Reset(expected);
+  for (uint32_t i = 0; i < func->bbs.len; i++) {
+    const auto& insts = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i])->insts;
+    for (uint32_t j = 0; j < insts.len; j++) {
+      auto inst = ValueAt(insts, j);
+      if (inst->name == nullptr && inst->ty->tag != KOOPA_RTT_UNIT)
+        temps.Insert(inst);
+    }
+  }
+
+  out << "\nfun " << func->name << '(';
+  PrintParams(func->params, out);
+  out << ')';
+  if (ty.ret->tag != KOOPA_RTT_UNIT) {
+    out << ": ";
+    PrintType(ty.ret, out);
+  }
+  out << " {\n";
+  for (uint32_t i = 0; i < func->bbs.len; i++) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    out << bb->name;
+    if (bb->params.len > 0) {
+      out << '(';
+      PrintParams(bb->params, out);
+      out << ')';
+    }
+    out << ":\n";
+    for (uint32_t j = 0; j < bb->insts.len; j++)
+      PrintInst(ValueAt(bb->insts, j), out);
+  }
+  out << "}\n";
+}
+
+void PrintKoopa(const koopa_raw_program_t& program, Writer& out) {
+  for (uint32_t i = 0; i < program.values.len; i++) {
+    auto global = ValueAt(program.values, i);
+    out << "global " << global->name << " = alloc ";
+    PrintType(global->ty->data.pointer.base, out);
+    out << ", ";
+    PrintValue(global->kind.data.global_alloc.init, out);
+    out << '\n';
+  }
+  if (program.values.len > 0)
+    out << '\n';
+  for (uint32_t i = 0; i < program.funcs.len; i++)
+    PrintFunction(reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]), out);
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "koopa.h"
+#include "writer.hpp"
+
+// 将 raw program 以 Koopa IR 文本输出, 边遍历边写出, 不构建完整的字符串
+// 没有名字的值按其在函数中出现的顺序命名为 %0, %1, ...
+void PrintKoopa(const koopa_raw_program_t& program, Writer& out);
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+
+// 单生产者单消费者的有界无锁队列, 用于流水线中相邻两级之间传递工作
+// head 与 tail 只增不减, 各由一方写入; 队列满时 Push 等待, 空时 Pop 等待, 等待时让出 CPU
+template <typename T, size_t N>
+class SpscQueue {
+ public:
+  SpscQueue() = default;
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  void Push(T item) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    while (t - head.load(std::memory_order_acquire) == N)
+      std::this_thread::yield();
+    items[t % N] = item;
+    tail.store(t + 1, std::memory_order_release);
+  }
+
+  T Pop() {
+    size_t h = head.load(std::memory_order_relaxed);
+    while (tail.load(std::memory_order_acquire) == h)
+      std::this_thread::yield();
+    T item = items[h % N];
+    head.store(h + 1, std::memory_order_release);
+    return item;
+  }
+
+ private:
+  T items[N];
+  // 分别位于不同的缓存行, 生产者与消费者不争用同一行
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+};
@@ -0,0 +1,167 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "rawbuilder.hpp"
+
+using namespace std;
+
+// 每次向系统申请的内存块大小
+static const size_t CHUNK_SIZE = 64 * 1024;
+
+RawArena::~RawArena() {
+  for (char* chunk : chunks)
+    free(chunk);
+}
+
+void* RawArena::Alloc(size_t size) {
+  size = (size + 15) / 16 * 16;
+  if (size > CHUNK_SIZE) {
+    // 大块内存单独申请, 放在当前块之前, 不影响当前块的剩余空间
+    char* big = static_cast<char*>(malloc(size));
+    chunks.insert(chunks.end() - (chunks.empty() ? 0 : 1), big);
+    return big;
+  }
+  if (used + size > capacity) {
+    chunks.push_back(static_cast<char*>(malloc(CHUNK_SIZE)));
+    used = 0;
+    capacity = CHUNK_SIZE;
+  }
+  void* ptr = chunks.back() + used;
+  used += size;
+  return ptr;
+}
+
+const char* RawArena::Name(const string& name) {
+  char* buffer = static_cast<char*>(Alloc(name.size() + 1));
+  memcpy(buffer, name.c_str(), name.size() + 1);
+  return buffer;
+}
+
+koopa_raw_slice_t RawArena::Slice(const vector<const void*>& items, koopa_raw_slice_item_kind_t kind) {
+  koopa_raw_slice_t slice;
+  slice.buffer = items.empty() ? nullptr : static_cast<const void**>(Alloc(items.size() * sizeof(const void*)));
+  if (!items.empty())
+    memcpy(slice.buffer, items.data(), items.size() * sizeof(const void*));
+  slice.len = items.size();
+  slice.kind = kind;
+  return slice;
+}
+
+koopa_raw_slice_t RawArena::Slice(const koopa_raw_slice_t& slice) {
+  return Slice(vector<const void*>(slice.buffer, slice.buffer + slice.len), slice.kind);
+}
+
+koopa_raw_type_t RawArena::Int32() {
+  if (int32 == nullptr) {
+    auto ty = New<koopa_raw_type_kind_t>();
+    ty->tag = KOOPA_RTT_INT32;
+    int32 = ty;
+  }
+  return int32;
+}
+
+koopa_raw_type_t RawArena::Unit() {
+  if (unit == nullptr) {
+    auto ty = New<koopa_raw_type_kind_t>();
+    ty->tag = KOOPA_RTT_UNIT;
+    unit = ty;
+  }
+  return unit;
+}
+
+koopa_raw_type_t RawArena::Pointer(koopa_raw_type_t base) {
+  // *i32 最常用, 只构建一次
+  if (base == Int32() && int32_pointer != nullptr)
+    return int32_pointer;
+  auto ty = New<koopa_raw_type_kind_t>();
+  ty->tag = KOOPA_RTT_POINTER;
+  ty->data.pointer.base = base;
+  if (base == Int32())
+    int32_pointer = ty;
+  return ty;
+}
+
+koopa_raw_type_t RawArena::Function(const vector<koopa_raw_type_t>& params, koopa_raw_type_t ret) {
+  auto ty = New<koopa_raw_type_kind_t>();
+  ty->tag = KOOPA_RTT_FUNCTION;
+  ty->data.function.params = Slice(vector<const void*>(params.begin(), params.end()), KOOPA_RSIK_TYPE);
+  ty->data.function.ret = ret;
+  return ty;
+}
+
+koopa_raw_value_t RawArena::Integer(int32_t value) {
+  auto data = NewValue(Int32(), nullptr, KOOPA_RVT_INTEGER);
+  data->kind.data.integer.value = value;
+  return data;
+}
+
+koopa_raw_value_data_t* RawArena::NewValue(koopa_raw_type_t ty, const char* name, koopa_raw_value_tag_t tag) {
+  auto data = New<koopa_raw_value_data_t>();
+  data->ty = ty;
+  data->name = name;
+  data->used_by = Slice({}, KOOPA_RSIK_VALUE);
+  data->kind.tag = tag;
+  return data;
+}
+
+void RebuildUses(const koopa_raw_program_t& program, RawArena& arena) {
+  // 所有定义的值与基本块. 常量只作为操作数出现, 不在其中
+  vector<koopa_raw_value_data_t*> defs;
+  vector<koopa_raw_basic_block_data_t*> bbs;
+  auto add = [&](const koopa_raw_slice_t& slice) {
+    for (uint32_t i = 0; i < slice.len; i++)
+      defs.push_back(const_cast<koopa_raw_value_data_t*>(reinterpret_cast<koopa_raw_value_t>(slice.buffer[i])));
+  };
+  add(program.values);
+  for (uint32_t i = 0; i < program.funcs.len; i++) {
+    auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+    add(func->params);
+    for (uint32_t j = 0; j < func->bbs.len; j++) {
+      auto bb = const_cast<koopa_raw_basic_block_data_t*>(reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[j]));
+      bbs.push_back(bb);
+      add(bb->params);
+      add(bb->insts);
+    }
+  }
+
+  // 对每个值的使用者调用 f(被使用的值或基本块的 used_by, 使用者)
+  auto each_use = [&](auto f) {
+    for (auto data : defs) {
+      ForEachOperandRef(data, [&](koopa_raw_value_t& op) {
+        // 全局变量可能同时被其他线程中编译的函数使用, 不记录它的使用者
+        if (op->kind.tag != KOOPA_RVT_GLOBAL_ALLOC)
+          f(const_cast<koopa_raw_value_data_t*>(op)->used_by, data);
+      });
+      if (data->kind.tag == KOOPA_RVT_BRANCH) {
+        f(const_cast<koopa_raw_basic_block_data_t*>(data->kind.data.branch.true_bb)->used_by, data);
+        f(const_cast<koopa_raw_basic_block_data_t*>(data->kind.data.branch.false_bb)->used_by, data);
+      } else if (data->kind.tag == KOOPA_RVT_JUMP) {
+        f(const_cast<koopa_raw_basic_block_data_t*>(data->kind.data.jump.target)->used_by, data);
+      }
+    }
+  };
+
+  // 不使用哈希表: 先清空, 再以 used_by.len 计数, 按计数分配 buffer 后重新填入
+  auto reset = [](koopa_raw_slice_t& used_by) {
+    used_by.buffer = nullptr;
+    used_by.len = 0;
+    used_by.kind = KOOPA_RSIK_VALUE;
+  };
+  for (auto data : defs)
+    reset(data->used_by);
+  for (auto bb : bbs)
+    reset(bb->used_by);
+  each_use([&](koopa_raw_slice_t& used_by, koopa_raw_value_t) { reset(used_by); });
+
+  each_use([](koopa_raw_slice_t& used_by, koopa_raw_value_t) { used_by.len++; });
+
+  // 同一个常量可能被多次访问, 已分配 buffer 的跳过; 分配后 len 作为填入位置
+  each_use([&](koopa_raw_slice_t& used_by, koopa_raw_value_t) {
+    if (used_by.buffer == nullptr) {
+      used_by.buffer = static_cast<const void**>(arena.Alloc(used_by.len * sizeof(const void*)));
+      used_by.len = 0;
+    }
+  });
+
+  each_use([](koopa_raw_slice_t& used_by, koopa_raw_value_t user) { used_by.buffer[used_by.len++] = user; });
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "koopa.h"
+
+// raw program 的内存池
+// 在内存池中构建的 raw program 中所有结构体均可直接修改, 其内存随内存池一同释放
+class RawArena {
+ public:
+  RawArena() = default;
+  RawArena(const RawArena&) = delete;
+  RawArena& operator=(const RawArena&) = delete;
+  ~RawArena();
+
+  void* Alloc(size_t size);
+  // 分配并清零一个 C 结构体
+  template <typename T>
+  T* New() {
+    return new (Alloc(sizeof(T))) T();
+  }
+
+  const char* Name(const std::string& name);
+  koopa_raw_slice_t Slice(const std::vector<const void*>& items, koopa_raw_slice_item_kind_t kind);
+  koopa_raw_slice_t Slice(const koopa_raw_slice_t& slice);
+
+  koopa_raw_type_t Int32();
+  koopa_raw_type_t Unit();
+  koopa_raw_type_t Pointer(koopa_raw_type_t base);
+  koopa_raw_type_t Function(const std::vector<koopa_raw_type_t>& params, koopa_raw_type_t ret);
+  koopa_raw_value_t Integer(int32_t value);
+  koopa_raw_value_data_t* NewValue(koopa_raw_type_t ty, const char* name, koopa_raw_value_tag_t tag);
+
+ private:
+  std::vector<char*> chunks;
+  size_t used = 0;
+  size_t capacity = 0;
+  koopa_raw_type_t int32 = nullptr;
+  koopa_raw_type_t unit = nullptr;
+  koopa_raw_type_t int32_pointer = nullptr;
+};
+
+// 根据所有指令的操作数重新计算各值与基本块的 used_by, 全局变量的 used_by 总为空
+void RebuildUses(const koopa_raw_program_t& program, RawArena& arena);
+
+// 对值引用的每个值调用 f, f 可以改写引用. 引用的基本块与函数不在此列
+template <typename F>
+void ForEachOperandRef(koopa_raw_value_data_t* value, F f) {
+  auto each = [&](koopa_raw_slice_t& slice) {
+    for (uint32_t i = 0; i < slice.len; i++)
+      f(reinterpret_cast<koopa_raw_value_t&>(slice.buffer[i]));
+  };
+
+  auto& kind = value->kind;
+  switch (kind.tag) {
+    case KOOPA_RVT_AGGREGATE:
+      each(kind.data.aggregate.elems);
+      break;
+    case KOOPA_RVT_GLOBAL_ALLOC:
+      f(kind.data.global_alloc.init);
+      break;
+    case KOOPA_RVT_LOAD:
+      f(kind.data.load.src);
+      break;
+    case KOOPA_RVT_STORE:
+      f(kind.data.store.value);
+      f(kind.data.store.dest);
+      break;
+    case KOOPA_RVT_GET_PTR:
+      f(kind.data.get_ptr.src);
+      f(kind.data.get_ptr.index);
+      break;
+    case KOOPA_RVT_GET_ELEM_PTR:
+      f(kind.data.get_elem_ptr.src);
+      f(kind.data.get_elem_ptr.index);
+      break;
+    case KOOPA_RVT_BINARY:
+      f(kind.data.binary.lhs);
+      f(kind.data.binary.rhs);
+      break;
+    case KOOPA_RVT_BRANCH:
+      f(kind.data.branch.cond);
+      each(kind.data.branch.true_args);
+      each(kind.data.branch.false_args);
+      break;
+    case KOOPA_RVT_JUMP:
+      each(kind.data.jump.args);
+      break;
+    case KOOPA_RVT_CALL:
+      each(kind.data.call.args);
+      break;
+    case KOOPA_RVT_RETURN:
+      if (kind.data.ret.value != nullptr)
+        f(kind.data.ret.value);
+      break;
+    default:
+      break;
+  }
+}
@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <unordered_set>
+
+#include "regalloc.hpp"
+
+using namespace std;
+
+// 可分配的 caller-saved 寄存器, t0 ~ t2 留作临时寄存器
+static const vector<reg_t> caller_regs = {T3, T4, T5, T6, A7, A6, A5, A4, A3, A2, A1, A0};
+// 可分配的 callee-saved 寄存器
+static const vector<reg_t> callee_regs = {S0, S1, S2, S3, S4, S5, S6, S7, S8, S9, S10, S11};
+
+reg_alloc_mode_t reg_alloc_mode = LINEAR_SCAN;
+
+bool NeedsLocation(const koopa_raw_value_t value) {
+  switch (value->kind.tag) {
+    case KOOPA_RVT_LOAD:
+    case KOOPA_RVT_BINARY:
+    case KOOPA_RVT_FUNC_ARG_REF:
+    case KOOPA_RVT_BLOCK_ARG_REF:
+      return true;
+    case KOOPA_RVT_CALL:
+      return value->ty->tag != KOOPA_RTT_UNIT;
+    default:
+      return false;
+  }
+}
+
+vector<koopa_raw_value_t> Operands(const koopa_raw_value_t inst) {
+  vector<koopa_raw_value_t> ops;
+  ForEachOperand(inst, [&](koopa_raw_value_t value) {
+    if (NeedsLocation(value))
+      ops.push_back(value);
+  });
+  return ops;
+}
+
+liveness_t AnalyzeLiveness(const koopa_raw_function_t& func) {
+  liveness_t live;
+  int n = func->bbs.len;
+  unordered_map<koopa_raw_basic_block_t, int> index;
+  for (int i = 0; i < n; i++) {
+    live.blocks.push_back(reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]));
+    index[live.blocks[i]] = i;
+  }
+
+  vector<unordered_set<koopa_raw_value_t>> use(n), def(n);
+  live.succ.resize(n);
+  live.live_in.resize(n);
+  live.live_out.resize(n);
+  for (int i = 0; i < n; i++) {
+    auto bb = live.blocks[i];
+    for (auto succ : Successors(bb))
+      live.succ[i].push_back(index[succ]);
+    for (uint32_t j = 0; j < bb->params.len; j++)
+      def[i].insert(ValueAt(bb->params, j));
+    for (uint32_t j = 0; j < bb->insts.len; j++) {
+      auto inst = ValueAt(bb->insts, j);
+      for (auto op : Operands(inst))
+        if (!def[i].count(op))
+          use[i].insert(op);
+      if (NeedsLocation(inst))
+        def[i].insert(inst);
+    }
+  }
+
+  // 逆序迭代至不动点
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int i = n - 1; i >= 0; i--) {
+      for (int s : live.succ[i])
+        for (auto value : live.live_in[s])
+          live.live_out[i].insert(value);
+      size_t old_size = live.live_in[i].size();
+      live.live_in[i] = use[i];
+      for (auto value : live.live_out[i])
+        if (!def[i].count(value))
+          live.live_in[i].insert(value);
+      if (live.live_in[i].size() != old_size)
+        changed = true;
+    }
+  }
+  return live;
+}
+
+vector<live_interval_t> BuildIntervals(const koopa_raw_function_t& func, vector<int>& calls) {
+  liveness_t live = AnalyzeLiveness(func);
+
+  // 以覆盖所有定义/使用/跨块活跃点的最小区间近似活跃范围
+  unordered_map<koopa_raw_value_t, live_interval_t> intervals;
+  vector<koopa_raw_value_t> order;
+  auto extend = [&](koopa_raw_value_t value, int at) {
+    auto it = intervals.find(value);
+    if (it == intervals.end()) {
+      intervals[value] = {value, at, at};
+      order.push_back(value);
+    } else {
+      it->second.start = min(it->second.start, at);
+      it->second.end = max(it->second.end, at);
+    }
+  };
+
+  // 函数参数在进入函数时即已定义
+  for (uint32_t i = 0; i < func->params.len; i++)
+    extend(ValueAt(func->params, i), -1);
+
+  // 为指令编号, 每个基本块的起始位置留给基本块参数
+  int counter = 0;
+  for (size_t i = 0; i < live.blocks.size(); i++) {
+    auto bb = live.blocks[i];
+    int from = counter;
+    counter += 2;
+    for (auto value : live.live_in[i])
+      extend(value, from);
+    // 基本块参数同时定义, 即使未被使用也不能共用寄存器
+    for (uint32_t j = 0; j < bb->params.len; j++) {
+      extend(ValueAt(bb->params, j), from);
+      extend(ValueAt(bb->params, j), from + 1);
+    }
+    for (uint32_t j = 0; j < bb->insts.len; j++) {
+      auto inst = ValueAt(bb->insts, j);
+      for (auto op : Operands(inst))
+        extend(op, counter);
+      if (NeedsLocation(inst))
+        extend(inst, counter);
+      if (inst->kind.tag == KOOPA_RVT_CALL)
+        calls.push_back(counter);
+      counter += 2;
+    }
+    for (auto value : live.live_out[i])
+      extend(value, counter);
+  }
+
+  vector<live_interval_t> result;
+  for (auto value : order)
+    result.push_back(intervals[value]);
+  return result;
+}
+
+reg_alloc_t LinearScan(const koopa_raw_function_t& func) {
+  reg_alloc_t alloc;
+  vector<int> calls;
+  vector<live_interval_t> intervals = BuildIntervals(func, calls);
+  stable_sort(intervals.begin(), intervals.end(), [](const live_interval_t& a, const live_interval_t& b) {
+    return a.start < b.start;
+  });
+
+  auto crosses_call = [&](const live_interval_t& it) {
+    for (int c : calls)
+      if (it.start < c && c < it.end)
+        return true;
+    return false;
+  };
+
+  // 前若干个参数所在的 a 寄存器不参与分配
+  int reg_params = min(int(func->params.len), 8);
+  vector<reg_t> caller_pool;
+  for (reg_t reg : caller_regs)
+    if (reg < A0 || reg >= A0 + reg_params)
+      caller_pool.push_back(reg);
+
+  vector<bool> free_regs(32, false), used_callee(32, false);
+  for (reg_t reg : caller_pool)
+    free_regs[reg] = true;
+  for (reg_t reg : callee_regs)
+    free_regs[reg] = true;
+
+  // 当前占有寄存器的区间, fixed 表示预着色的参数
+  typedef struct {
+    live_interval_t interval;
+    reg_t reg;
+    bool fixed;
+  } active_t;
+  vector<active_t> active;
+
+  auto take = [&](const vector<reg_t>& pool) -> reg_t {
+    for (reg_t reg : pool)
+      if (free_regs[reg]) {
+        free_regs[reg] = false;
+        return reg;
+      }
+    return ZERO;
+  };
+
+  for (auto& cur : intervals) {
+    // 释放已结束的区间
+    for (auto it = active.begin(); it != active.end();) {
+      if (it->interval.end <= cur.start) {
+        if (!it->fixed)
+          free_regs[it->reg] = true;
+        it = active.erase(it);
+      } else {
+        it++;
+      }
+    }
+
+    bool cross = crosses_call(cur);
+    // 不跨越调用的寄存器参数直接留在 a 寄存器中
+    if (cur.value->kind.tag == KOOPA_RVT_FUNC_ARG_REF) {
+      size_t index = cur.value->kind.data.func_arg_ref.index;
+      if (index >= 8)
+        continue;
+      if (!cross) {
+        reg_t reg = A0 + index;
+        alloc.reg[cur.value] = reg;
+        active.push_back({cur, reg, true});
+        continue;
+      }
+    }
+
+    reg_t reg = cross ? ZERO : take(caller_pool);
+    if (reg == ZERO)
+      reg = take(callee_regs);
+
+    if (reg == ZERO) {
+      // 寄存器不足, 溢出结束最晚的区间
+      auto victim = active.end();
+      for (auto it = active.begin(); it != active.end(); it++) {
+        if (it->fixed || (cross && !IsCalleeSaved(it->reg)))
+          continue;
+        if (victim == active.end() || it->interval.end > victim->interval.end)
+          victim = it;
+      }
+      if (victim != active.end() && victim->interval.end > cur.end) {
+        reg = victim->reg;
+        alloc.reg.erase(victim->interval.value);
+        alloc.spilled.push_back(victim->interval.value);
+        active.erase(victim);
+      } else {
+        alloc.spilled.push_back(cur.value);
+        continue;
+      }
+    }
+
+    if (IsCalleeSaved(reg))
+      used_callee[reg] = true;
+    alloc.reg[cur.value] = reg;
+    active.push_back({cur, reg, false});
+  }
+
+  for (reg_t reg : callee_regs)
+    if (used_callee[reg])
+      alloc.callee_saved.push_back(reg);
+  return alloc;
+}
+
+reg_alloc_t AllocateRegisters(const koopa_raw_function_t& func) {
+  if (reg_alloc_mode == GRAPH_COLORING)
+    return GraphColoring(func);
+  return LinearScan(func);
+}
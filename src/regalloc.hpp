@@ -0,0 +1,104 @@
+#pragma once
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "cfg.hpp"
+#include "koopa.h"
+#include "location.hpp"
+
+// 寄存器分配结果
+typedef struct {
+  // 分配到寄存器的值
+  std::unordered_map<koopa_raw_value_t, reg_t> reg;
+  // 溢出到栈上的值
+  std::vector<koopa_raw_value_t> spilled;
+  // 使用到的 callee-saved 寄存器, 需要在序言/尾声中保存恢复
+  std::vector<reg_t> callee_saved;
+} reg_alloc_t;
+
+// 活跃区间 [start, end], 以指令编号计
+typedef struct {
+  koopa_raw_value_t value;
+  int start;
+  int end;
+} live_interval_t;
+
+// 基本块级活跃变量分析结果, 下标与 func->bbs 中的顺序一致
+typedef struct {
+  std::vector<koopa_raw_basic_block_t> blocks;
+  std::vector<std::vector<int>> succ;
+  std::vector<std::unordered_set<koopa_raw_value_t>> live_in;
+  std::vector<std::unordered_set<koopa_raw_value_t>> live_out;
+} liveness_t;
+
+// 寄存器分配算法
+typedef enum {
+  LINEAR_SCAN,
+  GRAPH_COLORING,
+} reg_alloc_mode_t;
+
+extern reg_alloc_mode_t reg_alloc_mode;
+
+// 是否是需要分配位置的值 (有结果的指令 / 函数参数 / 基本块参数)
+bool NeedsLocation(const koopa_raw_value_t value);
+
+// 对指令读取的每个操作数调用 f
+template <typename F>
+void ForEachOperand(const koopa_raw_value_t inst, F f) {
+  auto each = [&](const koopa_raw_slice_t& slice) {
+    for (uint32_t i = 0; i < slice.len; i++)
+      f(reinterpret_cast<koopa_raw_value_t>(slice.buffer[i]));
+  };
+
+  const auto& kind = inst->kind;
+  switch (kind.tag) {
+    case KOOPA_RVT_LOAD:
+      f(kind.data.load.src);
+      break;
+    case KOOPA_RVT_STORE:
+      f(kind.data.store.value);
+      f(kind.data.store.dest);
+      break;
+    case KOOPA_RVT_BINARY:
+      f(kind.data.binary.lhs);
+      f(kind.data.binary.rhs);
+      break;
+    case KOOPA_RVT_BRANCH:
+      f(kind.data.branch.cond);
+      each(kind.data.branch.true_args);
+      each(kind.data.branch.false_args);
+      break;
+    case KOOPA_RVT_JUMP:
+      each(kind.data.jump.args);
+      break;
+    case KOOPA_RVT_CALL:
+      each(kind.data.call.args);
+      break;
+    case KOOPA_RVT_RETURN:
+      if (kind.data.ret.value != nullptr)
+        f(kind.data.ret.value);
+      break;
+    default:
+      break;
+  }
+}
+
+// 指令读取的操作数 (仅包含需要分配位置的值)
+std::vector<koopa_raw_value_t> Operands(const koopa_raw_value_t inst);
+
+// 活跃变量分析
+liveness_t AnalyzeLiveness(const koopa_raw_function_t& func);
+
+// 基于活跃变量分析计算函数内各值的活跃区间, 同时记录所有 call 的位置
+std::vector<live_interval_t> BuildIntervals(const koopa_raw_function_t& func, std::vector<int>& calls);
+
+// 线性扫描寄存器分配
+reg_alloc_t LinearScan(const koopa_raw_function_t& func);
+
+// 迭代合并的图着色寄存器分配 (-O2)
+reg_alloc_t GraphColoring(const koopa_raw_function_t& func);
+
+// 按 reg_alloc_mode 选择分配算法
+reg_alloc_t AllocateRegisters(const koopa_raw_function_t& func);
@@ -0,0 +1,397 @@
+#include <cassert>
+#include <vector>
+
+#include "resolve.hpp"
+
+// 名字解析
+// 按源程序顺序遍历 AST, 为每个声明创建符号, 将每个使用绑定到当时可见的符号, 并求出常量的值
+// 符号表是一张以标识符编号为下标的扁平数组, 保存每个标识符当前可见的符号,
+// 内层声明通过 shadowed 链接遮蔽外层符号, 离开作用域时按声明顺序逆序恢复, 查找为 O(1)
+
+// 每个标识符当前可见的符号
+static std::vector<stored_object*> visible;
+// 已声明的标识符, 按声明顺序
+static std::vector<symbol_t> declared;
+// 每层作用域开始时 declared 的长度
+static std::vector<size_t> scope_marks;
+// 每层作用域对应的块编号
+static std::vector<int> scope_blocks;
+// 块计数器, 与生成 IR 时的块编号顺序一致
+static int block_cnt = 0;
+// 到目前为止的 if (含 && 与 || 的每个运算符) 与 while 的个数
+// 生成 IR 时以它们为每个函数的 if_cnt 与 while_cnt 的起点, 各函数的标号互不重复, 可以分别生成
+static int if_total = 0;
+static int while_total = 0;
+// 全局作用域中的符号, 流式编译时 ast_arena 在每个函数之后重置, 全局符号需要一直保留
+static AstArena global_symbols;
+
+static void EnterScope() {
+  scope_marks.push_back(declared.size());
+  scope_blocks.push_back(block_cnt++);
+}
+
+static void ExitScope() {
+  while (declared.size() > scope_marks.back()) {
+    symbol_t sym = declared.back();
+    visible[sym] = visible[sym]->shadowed;
+    declared.pop_back();
+  }
+  scope_marks.pop_back();
+  scope_blocks.pop_back();
+}
+
+static stored_object* Declare(symbol_t sym, value_type type) {
+  // 流水线编译时 lexer 在另一个线程中继续驻留新名字, 这里不读取 interner.size()
+  if (sym >= visible.size())
+    visible.resize(sym + 1, nullptr);
+
+  int block = scope_blocks.back();
+  AstArena& arena = block == 0 ? global_symbols : ast_arena;
+  auto object = static_cast<stored_object*>(arena.Alloc(sizeof(stored_object)));
+  object->type = type;
+  object->value.val = 0;
+  object->block = block;
+  object->shadowed = visible[sym];
+  visible[sym] = object;
+  declared.push_back(sym);
+  return object;
+}
+
+static stored_object* DeclareFunction(symbol_t sym, func_type ty) {
+  auto object = Declare(sym, FUNCTION);
+  object->value.type = ty;
+  return object;
+}
+
+static stored_object* Lookup(symbol_t sym) {
+  assert(sym < visible.size() && visible[sym]);
+  return visible[sym];
+}
+
+// 名字解析的入口, 在显式栈上反复执行各节点的步进函数
+void BaseAST::Resolve() {
+  AstStack stack(this);
+  stack.Run([&](BaseAST* node) { return node->ResolveStep(stack); });
+}
+
+void ResolveBegin() {
+  visible.assign(interner.size(), nullptr);
+  declared.clear();
+  block_cnt = 0;
+  if_total = 0;
+  while_total = 0;
+  global_symbols.Clear();
+
+  // 全局作用域, 其中包含库函数
+  EnterScope();
+  DeclareFunction(interner.Intern("getint"), INT);
+  DeclareFunction(interner.Intern("getch"), INT);
+  DeclareFunction(interner.Intern("getarray"), INT);
+  DeclareFunction(interner.Intern("putint"), VOID);
+  DeclareFunction(interner.Intern("putch"), VOID);
+  DeclareFunction(interner.Intern("putarray"), VOID);
+  DeclareFunction(interner.Intern("starttime"), VOID);
+  DeclareFunction(interner.Intern("stoptime"), VOID);
+}
+
+void ResolveEnd() {
+  ExitScope();
+}
+
+bool CompUnitAST::ResolveStep(AstStack& stack) {
+  if (stack.Top().state == 0) {
+    ResolveBegin();
+    return stack.Call(1, sub);
+  }
+  ResolveEnd();
+  return true;
+}
+
+bool CompUnitSubWithDeclAST::ResolveStep(AstStack& stack) {
+  if (stack.Top().state == 0 && compUnit)
+    return stack.Call(1, compUnit);
+  return stack.Tail(decl);
+}
+
+bool CompUnitSubWithFuncAST::ResolveStep(AstStack& stack) {
+  if (stack.Top().state == 0 && compUnit)
+    return stack.Call(1, compUnit);
+  return stack.Tail(func_def);
+}
+
+bool DeclWithConstAST::ResolveStep(AstStack& stack) {
+  return stack.Tail(constDecl);
+}
+
+bool DeclWithVarAST::ResolveStep(AstStack& stack) {
+  return stack.Tail(varDecl);
+}
+
+bool ConstDeclAST::ResolveStep(AstStack& stack) {
+  // 按声明顺序逐个求值, 引用前面的常量时直接读取其符号中的值, 每个表达式只遍历一次
+  auto& frame = stack.Top();
+  if (frame.index < constDefList.size())
+    return stack.Call(1, constDefList[frame.index++]);
+  return true;
+}
+
+bool ConstDefAST::ResolveStep(AstStack& stack) {
+  // 初值中的名字在声明之前解析, 常量的值在此时求出
+  if (stack.Top().state == 0)
+    return stack.Call(1, constInitVal);
+  int value = search(((ConstInitValAST*)constInitVal)->constExp);
+  symbol = Declare(ident, CONSTANT);
+  symbol->value.val = value;
+  return true;
+}
+
+bool ConstInitValAST::ResolveStep(AstStack& stack) {
+  return stack.Tail(constExp);
+}
+
+bool VarDeclAST::ResolveStep(AstStack& stack) {
+  auto& frame = stack.Top();
+  if (frame.index < varDefList.size())
+    return stack.Call(1, varDefList[frame.index++]);
+  return true;
+}
+
+bool VarDefAST::ResolveStep(AstStack& stack) {
+  symbol = Declare(ident, VARIABLE);
+  return true;
+}
+
+bool VarDefWithAssignAST::ResolveStep(AstStack& stack) {
+  if (stack.Top().state == 0)
+    return stack.Call(1, initVal);
+  symbol = Declare(ident, VARIABLE);
+  return true;
+}
+
+bool InitValAST::ResolveStep(AstStack& stack) {
+  return stack.Tail(exp);
+}
+
+bool FuncDefAST::ResolveStep(AstStack& stack) {
+  switch (stack.Top().state) {
+    case 0:
+      symbol = DeclareFunction(ident, !strcmp(funcType, "int") ? INT : !strcmp(funcType, "void") ? VOID : UND);
+
+      // 参数位于函数自身的作用域中
+      EnterScope();
+      blockId = scope_blocks.back();
+      firstIf = if_total;
+      firstWhile = while_total;
+      if (params)
+        return stack.Call(1, params);
+      [[fallthrough]];
+    case 1:
+      return stack.Call(2, block);
+    default:
+      ExitScope();
+      return true;
+  }
+}
+
+bool FuncFParamsAST::ResolveStep(AstStack& stack) {
+  auto& frame = stack.Top();
+  if (frame.index < paramList.size())
+    return stack.Call(1, paramList[frame.index++]);
+  return true;
+}
+
+bool FuncFParamAST::ResolveStep(AstStack& stack) {
+  symbol = Declare(ident, VARIABLE);
+  return true;
+}
+
+bool BlockAST::ResolveStep(AstStack& stack) {
+  auto& frame = stack.Top();
+  if (frame.state == 0)
+    EnterScope();
+  if (frame.index < blockItemList.size())
+    return stack.Call(1, blockItemList[frame.index++]);
+  ExitScope();
+  return true;
+}
+
+bool BlockItemWithDeclAST::ResolveStep(AstStack& stack) {
+  return stack.Tail(decl);
+}
+
+bool BlockItemWithStmtAST::ResolveStep(AstStack& stack) {
+  return stack.Tail(stmt);
+}
+
+bool StmtWithAssignAST::ResolveStep(AstStack& stack) {
+  if (stack.Top().state == 0)
+    return stack.Call(1, lVal);
+  assert(((LValAST*)lVal)->symbol->type == VARIABLE);
+  return stack.Tail(exp);
+}
+
+bool StmtWithExpAST::ResolveStep(AstStack& stack) {
+  if (exp)
+    return stack.Tail(exp);
+  return true;
+}
+
+bool StmtWithBlockAST::ResolveStep(AstStack& stack) {
+  return stack.Tail(block);
+}
+
+bool StmtWithIfAST::ResolveStep(AstStack& stack) {
+  switch (stack.Top().state) {
+    case 0:
+      if_total++;
+      return stack.Call(1, exp);
+    case 1:
+      if (!else_stmt)
+        return stack.Tail(if_stmt);
+      return stack.Call(2, if_stmt);
+    default:
+      // else if 链逐个代替当前栈帧, 不随链长增加栈深
+      return stack.Tail(else_stmt);
+  }
+}
+
+bool StmtWithWhileAST::ResolveStep(AstStack& stack) {
+  if (stack.Top().state == 0) {
+    while_total++;
+    return stack.Call(1, exp);
+  }
+  return stack.Tail(stmt);
+}
+
+bool StmtWithBreakAST::ResolveStep(AstStack& stack) {
+  return true;
+}
+
+bool StmtWithContinueAST::ResolveStep(AstStack& stack) {
+  return true;
+}
+
+bool StmtWithReturnAST::ResolveStep(AstStack& stack) {
+  if (exp)
+    return stack.Tail(exp);
+  return true;
+}
+
+bool ExpAST::ResolveStep(AstStack& stack) {
+  return stack.Tail(lOrExp);
+}
+
+bool LValAST::ResolveStep(AstStack& stack) {
+  symbol = Lookup(ident);
+  assert(symbol->type != FUNCTION);
+  return true;
+}
+
+bool PrimaryExpWithBrAST::ResolveStep(AstStack& stack) {
+  return stack.Tail(exp);
+}
+
+bool PrimaryExpWithLValAST::ResolveStep(AstStack& stack) {
+  return stack.Tail(lVal);
+}
+
+bool PrimaryExpWithNumAST::ResolveStep(AstStack& stack) {
+  return true;
+}
+
+bool UnaryExpAST::ResolveStep(AstStack& stack) {
+  return stack.Tail(primaryExp);
+}
+
+bool UnaryExpWithFuncAST::ResolveStep(AstStack& stack) {
+  symbol = Lookup(ident);
+  assert(symbol->type == FUNCTION);
+  if (params)
+    return stack.Tail(params);
+  return true;
+}
+
+bool UnaryExpWithOpAST::ResolveStep(AstStack& stack) {
+  return stack.Tail(unaryExp);
+}
+
+bool FuncRParamsAST::ResolveStep(AstStack& stack) {
+  auto& frame = stack.Top();
+  if (frame.index < paramList.size())
+    return stack.Call(1, paramList[frame.index++]);
+  return true;
+}
+
+bool MulExpAST::ResolveStep(AstStack& stack) {
+  return stack.Tail(unaryExp);
+}
+
+bool MulExpWithOpAST::ResolveStep(AstStack& stack) {
+  auto& frame = stack.Top();
+  if (frame.index < chain.len)
+    return stack.Call(1, chain.operands[frame.index++]);
+  return true;
+}
+
+bool AddExpAST::ResolveStep(AstStack& stack) {
+  return stack.Tail(mulExp);
+}
+
+bool AddExpWithOpAST::ResolveStep(AstStack& stack) {
+  auto& frame = stack.Top();
+  if (frame.index < chain.len)
+    return stack.Call(1, chain.operands[frame.index++]);
+  return true;
+}
+
+bool RelExpAST::ResolveStep(AstStack& stack) {
+  return stack.Tail(addExp);
+}
+
+bool RelExpWithOpAST::ResolveStep(AstStack& stack) {
+  auto& frame = stack.Top();
+  if (frame.index < chain.len)
+    return stack.Call(1, chain.operands[frame.index++]);
+  return true;
+}
+
+bool EqExpAST::ResolveStep(AstStack& stack) {
+  return stack.Tail(relExp);
+}
+
+bool EqExpWithOpAST::ResolveStep(AstStack& stack) {
+  auto& frame = stack.Top();
+  if (frame.index < chain.len)
+    return stack.Call(1, chain.operands[frame.index++]);
+  return true;
+}
+
+bool LAndExpAST::ResolveStep(AstStack& stack) {
+  return stack.Tail(eqExp);
+}
+
+bool LAndExpWithOpAST::ResolveStep(AstStack& stack) {
+  auto& frame = stack.Top();
+  if (frame.state == 0)
+    if_total += chain.len - 1;
+  if (frame.index < chain.len)
+    return stack.Call(1, chain.operands[frame.index++]);
+  return true;
+}
+
+bool LOrExpAST::ResolveStep(AstStack& stack) {
+  return stack.Tail(lAndExp);
+}
+
+bool LOrExpWithOpAST::ResolveStep(AstStack& stack) {
+  auto& frame = stack.Top();
+  if (frame.state == 0)
+    if_total += chain.len - 1;
+  if (frame.index < chain.len)
+    return stack.Call(1, chain.operands[frame.index++]);
+  return true;
+}
+
+bool ConstExpAST::ResolveStep(AstStack& stack) {
+  return stack.Tail(exp);
+}
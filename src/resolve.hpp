@@ -0,0 +1,34 @@
+#pragma once
+
+#include "ast.hpp"
+
+typedef enum {
+  CONSTANT,
+  VARIABLE,
+  FUNCTION,
+} value_type;
+
+typedef enum {
+  INT,
+  VOID,
+  UND,
+} func_type;
+
+// 名字解析得到的符号, 全局符号单独保存, 其余由 ast_arena 分配
+// 声明与使用处的 AST 节点直接保存指向它的指针, 生成 IR 时不再查表
+typedef struct stored_object {
+  value_type type;
+  union Value {
+    func_type type;
+    int val;
+  } value;
+  // 声明所在的块, 0 为全局, 与标识符一起决定 IR 中的变量名
+  int block;
+  // 被它遮蔽的外层同名符号
+  struct stored_object* shadowed;
+} stored_object;
+
+// 流式编译时逐个解析顶层声明与函数定义, 代替 CompUnitAST 的遍历
+// ResolveBegin 进入全局作用域并声明库函数, 之后对每个单元调用 Resolve, 最后调用 ResolveEnd
+void ResolveBegin();
+void ResolveEnd();
@@ -0,0 +1,51 @@
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "source.hpp"
+
+using namespace std;
+
+SourceFile::~SourceFile() {
+  if (data)
+    munmap(data, mapped);
+  if (stream && stream != stdin)
+    fclose(stream);
+}
+
+bool SourceFile::Open(const char* path) {
+  int fd = strcmp(path, "-") ? open(path, O_RDONLY) : STDIN_FILENO;
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    // 先保留一段足够放下文件与两个 '\0' 的匿名内存, 再将文件映射到其开头
+    // 文件最后一页超出文件长度的部分与之后的匿名页都为 0, 正好作为结束标记
+    long page = sysconf(_SC_PAGESIZE);
+    size_t len = st.st_size;
+    size_t total = (len + 2 + page - 1) / page * page;
+    void* base = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base != MAP_FAILED) {
+      if (len == 0 || mmap(base, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED) {
+        data = static_cast<char*>(base);
+        size = len;
+        mapped = total;
+        if (fd != STDIN_FILENO)
+          close(fd);
+        return true;
+      }
+      munmap(base, total);
+    }
+  }
+
+  // 无法映射时按流读取
+  stream = fd == STDIN_FILENO ? stdin : fdopen(fd, "r");
+  if (!stream) {
+    close(fd);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+
+// 编译器的输入
+// 普通文件以 mmap 映射到内存, lexer 直接在映射上扫描, 不再经过 stdio 与 flex 缓冲区的复制
+// 映射在文件内容之后至少有两个 '\0', 满足 flex 的 yy_scan_buffer 对结束标记的要求
+// 管道等无法映射的输入 (包括以 "-" 表示的标准输入) 退回到由 flex 按块读取
+class SourceFile {
+ public:
+  SourceFile() = default;
+  SourceFile(const SourceFile&) = delete;
+  SourceFile& operator=(const SourceFile&) = delete;
+  ~SourceFile();
+
+  // 打开输入, 失败时返回 false
+  bool Open(const char* path);
+
+  // 映射的文件内容, 流式读取时为 nullptr
+  // 可写: flex 扫描时会临时改写 token 之后的字节, 映射为私有, 不影响文件本身
+  char* Data() const { return data; }
+  // 文件内容的长度, 不含末尾的 '\0'
+  size_t Size() const { return size; }
+  // 流式读取时的输入
+  FILE* Stream() const { return stream; }
+
+ private:
+  char* data = nullptr;
+  size_t size = 0;
+  size_t mapped = 0;
+  FILE* stream = nullptr;
+};
@@ -0,0 +1,165 @@
+#include "stream.hpp"
+
+#include <thread>
+
+#include "ast.hpp"
+#include "irbuilder.hpp"
+#include "parser.hpp"
+#include "pass.hpp"
+#include "printer.hpp"
+#include "queue.hpp"
+#include "rawbuilder.hpp"
+#include "resolve.hpp"
+#include "visit.hpp"
+
+// 当前流式编译的设置, 供各单元使用
+static bool stream_riscv = false;
+static int stream_opt_level = 1;
+static Writer* stream_out = nullptr;
+
+static void Emit(const koopa_raw_program_t& program) {
+  if (stream_riscv)
+    Visit(program, *stream_out);
+  else
+    PrintKoopa(program, *stream_out);
+}
+
+// 解析一个顶层声明或函数定义并生成 IR, 函数体构建在 body 中
+static koopa_raw_program_t LowerUnit(BaseAST* item, RawArena* body) {
+  item->Resolve();
+  ir_builder->SetBodyArena(body);
+  OutputUnit(item);
+  koopa_raw_program_t raw = ir_builder->Finish();
+  ir_builder->SetBodyArena(nullptr);
+  return raw;
+}
+
+// 优化并输出 LowerUnit 得到的 program, 之后 body 可以释放
+static void EmitUnit(koopa_raw_program_t& raw, RawArena* body) {
+  if (body) {
+    PassManager passes(*body);
+    BuildPipeline(passes, stream_opt_level);
+    passes.Run(raw);
+  }
+  Emit(raw);
+
+  // 函数对象仍被之后的调用引用, 清空其中指向函数体的 slice
+  for (uint32_t i = 0; i < raw.funcs.len; i++) {
+    auto func = (koopa_raw_function_data_t*)raw.funcs.buffer[i];
+    func->params = koopa_raw_slice_t{nullptr, 0, KOOPA_RSIK_VALUE};
+    func->bbs = koopa_raw_slice_t{nullptr, 0, KOOPA_RSIK_BASIC_BLOCK};
+  }
+}
+
+// 编译一个顶层声明或函数定义, 在语法分析归约出它时调用
+static void CompileUnit(BaseAST* item) {
+  // 函数体在单独的内存池中构建, 输出后整体释放
+  RawArena body;
+  bool is_func = item->kind == ast_kind_t::FUNC_DEF;
+  koopa_raw_program_t raw = LowerUnit(item, is_func ? &body : nullptr);
+  EmitUnit(raw, is_func ? &body : nullptr);
+
+  // 此时下一个单元的节点尚未分配, 可以释放所有节点
+  ast_arena.Reset();
+}
+
+// 生成库函数声明前的准备, 流式与流水线编译共用
+static void BeginUnits(bool riscv, int opt_level, Writer& out) {
+  stream_riscv = riscv;
+  stream_opt_level = opt_level;
+  stream_out = &out;
+
+  ResolveBegin();
+  OutputBegin();
+  // 库函数的声明
+  Emit(ir_builder->Finish());
+}
+
+bool CompileStreaming(const SourceFile& source, bool riscv, int opt_level, Writer& out) {
+  // 全局变量与函数声明所在的内存池
+  RawArena arena;
+  IRBuilder builder(arena);
+  ir_builder = &builder;
+  BeginUnits(riscv, opt_level, out);
+
+  bool ok = ParseUnits(source, CompileUnit);
+  ResolveEnd();
+  ast_arena.Clear();
+  ir_builder = nullptr;
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// 流水线编译
+//
+// 语法分析 (调用线程), IR 生成与后端 (优化与输出) 各占一个线程, 相邻两级之间以
+// 有界无锁队列传递单元, 以 nullptr 表示结束. 每级只有一个线程, 按源程序顺序处理,
+// 输出顺序与流式编译相同.
+// ---------------------------------------------------------------------------
+
+// 语法分析得到的单元, 连同其所有节点所在的内存池
+typedef struct {
+  BaseAST* item;
+  AstArena nodes;
+} parsed_unit_t;
+
+// 生成 IR 后的单元, 函数体所在的内存池随之交给后端
+typedef struct {
+  koopa_raw_program_t raw;
+  RawArena* body;
+} lowered_unit_t;
+
+// 队列长度, 限制各级之间积压的单元数, 也就限制了同时存在的 AST 与 IR
+static const size_t PIPELINE_DEPTH = 64;
+
+static SpscQueue<parsed_unit_t*, PIPELINE_DEPTH> parsed_units;
+static SpscQueue<lowered_unit_t*, PIPELINE_DEPTH> lowered_units;
+
+static void ParseStage(BaseAST* item) {
+  // 下一个单元的节点尚未分配, 当前 ast_arena 中只有这个单元的节点, 整体交给 IR 生成
+  auto unit = new parsed_unit_t;
+  unit->item = item;
+  unit->nodes.Swap(ast_arena);
+  parsed_units.Push(unit);
+}
+
+static void LowerStage(IRBuilder* builder) {
+  // ir_builder 是 thread_local 的, 本线程中需要重新设置
+  ir_builder = builder;
+  while (auto unit = parsed_units.Pop()) {
+    RawArena* body = unit->item->kind == ast_kind_t::FUNC_DEF ? new RawArena : nullptr;
+    lowered_units.Push(new lowered_unit_t{LowerUnit(unit->item, body), body});
+    delete unit;
+    // 名字解析中局部符号分配在本线程的 ast_arena 中
+    ast_arena.Reset();
+  }
+  lowered_units.Push(nullptr);
+}
+
+static void EmitStage() {
+  while (auto unit = lowered_units.Pop()) {
+    EmitUnit(unit->raw, unit->body);
+    delete unit->body;
+    delete unit;
+  }
+}
+
+bool CompilePipelined(const SourceFile& source, bool riscv, int opt_level, Writer& out) {
+  RawArena arena;
+  IRBuilder builder(arena);
+  ir_builder = &builder;
+  // 驻留库函数与 %result 等名字, 在启动其他线程之前完成
+  BeginUnits(riscv, opt_level, out);
+
+  std::thread lower(LowerStage, &builder);
+  std::thread emit(EmitStage);
+  bool ok = ParseUnits(source, ParseStage);
+  parsed_units.Push(nullptr);
+  lower.join();
+  emit.join();
+
+  ResolveEnd();
+  ast_arena.Clear();
+  ir_builder = nullptr;
+  return ok;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "source.hpp"
+#include "writer.hpp"
+
+// 流式编译: 语法分析每归约出一个函数定义, 即完成名字解析, 生成 IR, 运行优化并输出,
+// 随后释放该函数的 AST 与 IR. 全程只保留全局符号, 全局变量与函数的声明,
+// 内存占用取决于最大的单个函数, 而不是整个输入文件
+// riscv 为 false 时输出 Koopa IR, 返回是否解析成功
+bool CompileStreaming(const SourceFile& source, bool riscv, int opt_level, Writer& out);
+
+// 流水线编译: 与流式编译相同地逐个单元处理, 但语法分析, IR 生成与后端分别在三个线程中
+// 同时进行, 输出与 CompileStreaming 相同
+bool CompilePipelined(const SourceFile& source, bool riscv, int opt_level, Writer& out);
@@ -1,7 +1,15 @@
+// 使用 C++ parser, 语义值为 variant, 按值移动, 不再 new 列表
+%skeleton "lalr1.cc"
+%require "3.2"
+%define api.value.type variant
+%define api.token.constructor
+
 %code requires {
   #include <memory>
   #include <string>
+  #include <vector>
   #include "ast.hpp"
+  #include "parser.hpp"
 }
 
 %{
@@ -13,49 +21,55 @@
 #include <vector>
 
 #include "ast.hpp"
-
-// 声明 lexer 函数和错误处理函数
-int yylex();
-void yyerror(std::unique_ptr<BaseAST> &ast, const char *s);
+#include "parser.hpp"
 
 using namespace std;
 
+// 同一优先级的左结合运算合并为一条链: lhs 已是该类的链时直接追加, 否则新建以 lhs 开头的链
+template <typename T, typename Op>
+static BaseAST *Chain(ast_kind_t kind, BaseAST *lhs, Op op, BaseAST *rhs) {
+  T *ast;
+  if (lhs->kind == kind) {
+    ast = static_cast<T *>(lhs);
+  } else {
+    ast = new T();
+    ast->chain.Push(lhs);
+  }
+  ast->chain.Push(op, rhs);
+  return ast;
+}
+
 %}
 
-// 定义 parser 函数和错误处理函数的附加参数
-// 我们需要返回一个字符串作为 AST, 所以我们把附加参数定义成字符串的智能指针
-// 解析完成后, 我们要手动修改这个参数, 把它设置成解析得到的字符串
-%parse-param { std::unique_ptr<BaseAST> &ast }
-
-// yylval 的定义, 我们把它定义成了一个联合体 (union)
-// 因为 token 的值有的是字符串指针, 有的是整数
-// 之前我们在 lexer 中用到的 str_val 和 int_val 就是在这里被定义的
-// 至于为什么要用字符串指针而不直接用 string 或者 unique_ptr<string>?
-// 请自行 STFW 在 union 里写一个带析构函数的类会出现什么情况
-%union {
-  std::string *str_val;
-  int int_val;
-  BaseAST *ast_val;
-  std::vector<std::unique_ptr<BaseAST>> *vec_val;
+// 定义 parser 和 lexer 的附加参数: 解析的上下文
+// 解析完成后, 我们要手动把其中的 ast 设置成解析得到的 AST 的根节点
+// 节点都分配在 ast_arena 中, 由内存池统一释放
+%param { parse_context_t &ctx }
+
+// 声明 lexer 函数, 需要在 parser 类定义之后
+%code {
+  yy::parser::symbol_type yylex(parse_context_t &ctx);
 }
 
 // lexer 返回的所有 token 种类的声明
-// 注意 IDENT 和 INT_CONST 会返回 token 的值, 分别对应 str_val 和 int_val
+// 注意 IDENT 和 INT_CONST 会返回 token 的值, 分别为标识符编号和整数
+// 标识符由 lexer 驻留到 interner 中, 这里只传递编号, 不再 new 字符串
 %token INT VOID RETURN CONST IF ELSE WHILE BREAK CONTINUE
-%token <str_val> IDENT
-%token <int_val> INT_CONST
+%token <symbol_t> IDENT
+%token <int> INT_CONST
 
 // 非终结符的类型定义
-%type <ast_val> CompUnitSub
-%type <ast_val> Decl ConstDecl ConstDef ConstInitVal   
-%type <ast_val> VarDecl VarDef InitVal
-%type <ast_val> FuncDef FuncFParams FuncFParam FuncRParams
-%type <ast_val> Block BlockItem Stmt 
-%type <ast_val> Exp LVal PrimaryExp UnaryExp MulExp AddExp RelExp EqExp LAndExp LOrExp ConstExp
+// 子节点列表在解析时按值收集, 归约时复制到 ast_arena 中
+%type <BaseAST *> CompUnitSub
+%type <BaseAST *> Decl ConstDecl ConstDef ConstInitVal
+%type <BaseAST *> VarDecl VarDef InitVal
+%type <BaseAST *> FuncDef FuncFParams FuncFParam FuncRParams
+%type <BaseAST *> Block BlockItem Stmt
+%type <BaseAST *> Exp LVal PrimaryExp UnaryExp MulExp AddExp RelExp EqExp LAndExp LOrExp ConstExp
 
-%type <vec_val> BlockItemList ConstDefList VarDefList FuncFParamList ExpList
+%type <std::vector<BaseAST *>> BlockItemList ConstDefList VarDefList FuncFParamList ExpList
 
-%type <int_val> Number
+%type <int> Number
 
 %%
 
@@ -64,48 +78,71 @@ using namespace std;
 // 而 parser 一旦解析完 CompUnit, 就说明所有的 token 都被解析了, 即解析结束了
 // 此时我们应该把 FuncDef 返回的结果收集起来, 作为 AST 传给调用 parser 的函数
 // $1 指代规则里第一个符号的返回值, 也就是 FuncDef 的返回值
+// 流式解析时顶层声明与函数定义在归约时直接交给 ctx.unit, CompUnitSub 的值为空
 CompUnit
   : CompUnitSub {
-    auto comp_unit = make_unique<CompUnitAST>();
-    comp_unit->sub = unique_ptr<BaseAST>($1);
-    ast = move(comp_unit);
+    if (!ctx.unit) {
+      auto comp_unit = new CompUnitAST();
+      comp_unit->sub = $1;
+      ctx.ast = comp_unit;
+    }
   }
   ;
 
 CompUnitSub
   : FuncDef {
-    auto ast = new CompUnitSubWithFuncAST();
-    ast->func_def = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    if (ctx.unit) {
+      ctx.unit($1);
+      $$ = nullptr;
+    } else {
+      auto ast = new CompUnitSubWithFuncAST();
+      ast->func_def = $1;
+      $$ = ast;
+    }
   }
   | Decl {
-    auto ast = new CompUnitSubWithDeclAST();
-    ast->decl = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    if (ctx.unit) {
+      ctx.unit($1);
+      $$ = nullptr;
+    } else {
+      auto ast = new CompUnitSubWithDeclAST();
+      ast->decl = $1;
+      $$ = ast;
+    }
   }
   | CompUnitSub FuncDef {
-    auto ast = new CompUnitSubWithFuncAST();
-    ast->compUnit = make_optional(unique_ptr<BaseAST>($1));
-    ast->func_def = unique_ptr<BaseAST>($2);
-    $$ = ast;
+    if (ctx.unit) {
+      ctx.unit($2);
+      $$ = nullptr;
+    } else {
+      auto ast = new CompUnitSubWithFuncAST();
+      ast->compUnit = $1;
+      ast->func_def = $2;
+      $$ = ast;
+    }
   }
   | CompUnitSub Decl {
-    auto ast = new CompUnitSubWithDeclAST();
-    ast->compUnit = make_optional(unique_ptr<BaseAST>($1));
-    ast->decl = unique_ptr<BaseAST>($2);
-    $$ = ast;
+    if (ctx.unit) {
+      ctx.unit($2);
+      $$ = nullptr;
+    } else {
+      auto ast = new CompUnitSubWithDeclAST();
+      ast->compUnit = $1;
+      ast->decl = $2;
+      $$ = ast;
+    }
   }
   ;
 
 Decl
   : ConstDecl {
     auto ast = new DeclWithConstAST();
-    ast->constDecl = unique_ptr<BaseAST>($1);
+    ast->constDecl = $1;
     $$ = ast;
   }
   | VarDecl {
     auto ast = new DeclWithVarAST();
-    ast->varDecl = unique_ptr<BaseAST>($1);
+    ast->varDecl = $1;
     $$ = ast;
   }
   ;
@@ -113,33 +150,27 @@ Decl
 ConstDecl
   : CONST INT ConstDef ConstDefList ';' {
     auto ast = new ConstDeclAST();
-    string * type = new string("int");
-    ast->bType = *unique_ptr<string>(type);
-    ast->constDefList.push_back(unique_ptr<BaseAST>($3));
-    vector<unique_ptr<BaseAST> > *vec = ($4);
-    for (auto it = vec->begin(); it != vec->end(); it++)
-      ast->constDefList.push_back(move(*it));
+    ast->bType = "int";
+    ast->constDefList = AstList($3, $4);
     $$ = ast;
   }
   ;
 
 ConstDefList
   : {
-    vector<unique_ptr<BaseAST>> *vec = new vector<unique_ptr<BaseAST>>;
-    $$ = vec;
+    $$ = vector<BaseAST *>();
   }
   | ConstDefList ',' ConstDef {
-    vector<unique_ptr<BaseAST>> *vec = ($1);
-    vec->push_back(unique_ptr<BaseAST>($3));
-    $$ = vec;
+    $$ = std::move($1);
+    $$.push_back($3);
   }
   ;
 
 ConstDef
   : IDENT '=' ConstInitVal {
     auto ast = new ConstDefAST();
-    ast->ident = *unique_ptr<string>($1);
-    ast->constInitVal = unique_ptr<BaseAST>($3);
+    ast->ident = $1;
+    ast->constInitVal = $3;
     $$ = ast;
   }
   ;
@@ -147,7 +178,7 @@ ConstDef
 ConstInitVal
   : ConstExp {
     auto ast = new ConstInitValAST();
-    ast->constExp = unique_ptr<BaseAST>($1);
+    ast->constExp = $1;
     $$ = ast;
   }
   ;
@@ -155,38 +186,32 @@ ConstInitVal
 VarDecl
   : INT VarDef VarDefList ';' {
     auto ast = new VarDeclAST();
-    string * type = new string("int");
-    ast->bType = *unique_ptr<string>(type);
-    ast->varDefList.push_back(unique_ptr<BaseAST>($2));
-    vector<unique_ptr<BaseAST> > *vec = ($3);
-    for (auto it = vec->begin(); it != vec->end(); it++)
-      ast->varDefList.push_back(move(*it));
+    ast->bType = "int";
+    ast->varDefList = AstList($2, $3);
     $$ = ast;
   }
   ;
 
 VarDefList
   : {
-    vector<unique_ptr<BaseAST>> *vec = new vector<unique_ptr<BaseAST>>;
-    $$ = vec;
+    $$ = vector<BaseAST *>();
   }
   | VarDefList ',' VarDef {
-    vector<unique_ptr<BaseAST>> *vec = ($1);
-    vec->push_back(unique_ptr<BaseAST>($3));
-    $$ = vec;
+    $$ = std::move($1);
+    $$.push_back($3);
   }
   ;
 
 VarDef
   : IDENT {
     auto ast = new VarDefAST();
-    ast->ident = *unique_ptr<string>($1);
+    ast->ident = $1;
     $$ = ast;
   }
   | IDENT '=' InitVal {
     auto ast = new VarDefWithAssignAST();
-    ast->ident = *unique_ptr<string>($1);
-    ast->initVal = unique_ptr<BaseAST>($3);
+    ast->ident = $1;
+    ast->initVal = $3;
     $$ = ast;
   }
   ;
@@ -194,7 +219,7 @@ VarDef
 InitVal
   : Exp {
     auto ast = new InitValAST();
-    ast->exp = unique_ptr<BaseAST>($1);
+    ast->exp = $1;
     $$ = ast;
   }
   ;
@@ -203,45 +228,36 @@ InitVal
 // 我们这里可以直接写 '(' 和 ')', 因为之前在 lexer 里已经处理了单个字符的情况
 // 解析完成后, 把这些符号的结果收集起来, 然后拼成一个新的字符串, 作为结果返回
 // $$ 表示非终结符的返回值, 我们可以通过给这个符号赋值的方法来返回结果
-// 你可能会问, FuncType, IDENT 之类的结果已经是字符串指针了
-// 为什么还要用 unique_ptr 接住它们, 然后再解引用, 把它们拼成另一个字符串指针呢
-// 因为所有的字符串指针都是我们 new 出来的, new 出来的内存一定要 delete
-// 否则会发生内存泄漏, 而 unique_ptr 这种智能指针可以自动帮我们 delete
-// 虽然此处你看不出用 unique_ptr 和手动 delete 的区别, 但当我们定义了 AST 之后
-// 这种写法会省下很多内存管理的负担
+// IDENT 的结果是 lexer 驻留后的标识符编号, 直接存入 AST
 FuncDef
   : INT IDENT '(' ')' Block {
     auto ast = new FuncDefAST();
-    string * type = new string("int");
-    ast->funcType = *unique_ptr<string>(type);
-    ast->ident = *unique_ptr<string>($2);
-    ast->block = unique_ptr<BaseAST>($5);
+    ast->funcType = "int";
+    ast->ident = $2;
+    ast->block = $5;
     $$ = ast;
   }
   | INT IDENT '(' FuncFParams ')' Block {
     auto ast = new FuncDefAST();
-    string * type = new string("int");
-    ast->funcType = *unique_ptr<string>(type);
-    ast->ident = *unique_ptr<string>($2);
-    ast->params = make_optional(unique_ptr<BaseAST>($4));
-    ast->block = unique_ptr<BaseAST>($6);
+    ast->funcType = "int";
+    ast->ident = $2;
+    ast->params = $4;
+    ast->block = $6;
     $$ = ast;
   }
   | VOID IDENT '(' ')' Block {
     auto ast = new FuncDefAST();
-    string * type = new string("void");
-    ast->funcType = *unique_ptr<string>(type);
-    ast->ident = *unique_ptr<string>($2);
-    ast->block = unique_ptr<BaseAST>($5);
+    ast->funcType = "void";
+    ast->ident = $2;
+    ast->block = $5;
     $$ = ast;
   }
   | VOID IDENT '(' FuncFParams ')' Block {
     auto ast = new FuncDefAST();
-    string * type = new string("void");
-    ast->funcType = *unique_ptr<string>(type);
-    ast->ident = *unique_ptr<string>($2);
-    ast->params = make_optional(unique_ptr<BaseAST>($4));
-    ast->block = unique_ptr<BaseAST>($6);
+    ast->funcType = "void";
+    ast->ident = $2;
+    ast->params = $4;
+    ast->block = $6;
     $$ = ast;
   }
   ;
@@ -249,32 +265,26 @@ FuncDef
 FuncFParams
   : FuncFParam FuncFParamList {
     auto ast = new FuncFParamsAST();
-    ast->paramList.push_back(unique_ptr<BaseAST>($1));
-    vector<unique_ptr<BaseAST>> *vec = ($2);
-    for (auto it = vec->begin(); it != vec->end(); it++)
-      ast->paramList.push_back(move(*it));
+    ast->paramList = AstList($1, $2);
     $$ = ast;
   }
   ;
 
 FuncFParamList
   : {
-    vector<unique_ptr<BaseAST>> *vec = new vector<unique_ptr<BaseAST>>;
-    $$ = vec;
+    $$ = vector<BaseAST *>();
   }
   | FuncFParamList ',' FuncFParam {
-    vector<unique_ptr<BaseAST>> *vec = ($1);
-    vec->push_back(unique_ptr<BaseAST>($3));
-    $$ = vec;
+    $$ = std::move($1);
+    $$.push_back($3);
   }
   ;
 
 FuncFParam
   : INT IDENT {
     auto ast = new FuncFParamAST();
-    string * type = new string("int");
-    ast->bType = *unique_ptr<string>(type);
-    ast->ident = *unique_ptr<string>($2);
+    ast->bType = "int";
+    ast->ident = $2;
     $$ = ast;
   }
   ;
@@ -282,41 +292,37 @@ FuncFParam
 Block
   : '{' BlockItemList '}' {
     auto ast = new BlockAST();
-    vector<unique_ptr<BaseAST> > *vec = ($2);
-    for (auto it = vec->begin(); it != vec->end(); it++)
-      ast->blockItemList.push_back(move(*it));
+    ast->blockItemList = AstList(nullptr, $2);
     $$ = ast;
   }
   ;
 
 BlockItemList
   : {
-    vector<unique_ptr<BaseAST>> *vec = new vector<unique_ptr<BaseAST>>;
-    $$ = vec;
+    $$ = vector<BaseAST *>();
   }
   | BlockItemList BlockItem {
-    vector<unique_ptr<BaseAST>> *vec = ($1);
-    vec->push_back(unique_ptr<BaseAST>($2));
-    $$ = vec;
+    $$ = std::move($1);
+    $$.push_back($2);
   }
 
 BlockItem
   : Decl {
     auto ast = new BlockItemWithDeclAST();
-    ast->decl = unique_ptr<BaseAST>($1);
+    ast->decl = $1;
     $$ = ast;
   }
   | Stmt {  
     auto ast = new BlockItemWithStmtAST();
-    ast->stmt = unique_ptr<BaseAST>($1);
+    ast->stmt = $1;
     $$ = ast;
   }
 
 Stmt
   : LVal '=' Exp ';' {
     auto ast = new StmtWithAssignAST();
-    ast->lVal = unique_ptr<BaseAST>($1);
-    ast->exp = unique_ptr<BaseAST>($3);
+    ast->lVal = $1;
+    ast->exp = $3;
     $$ = ast;
   }
   | ';' {
@@ -325,31 +331,31 @@ Stmt
   }
   | Exp ';' {
     auto ast = new StmtWithExpAST();
-    ast->exp = make_optional(unique_ptr<BaseAST>($1)); 
+    ast->exp = $1; 
     $$ = ast;
   }
   | Block {
     auto ast = new StmtWithBlockAST();
-    ast->block = unique_ptr<BaseAST>($1);
+    ast->block = $1;
     $$ = ast;
   }
   | IF '(' Exp ')' Stmt {
     auto ast = new StmtWithIfAST();
-    ast->exp = unique_ptr<BaseAST>($3);
-    ast->if_stmt = unique_ptr<BaseAST>($5);
+    ast->exp = $3;
+    ast->if_stmt = $5;
     $$ = ast;
   }
   | IF '(' Exp ')' Stmt ELSE Stmt {
     auto ast = new StmtWithIfAST();
-    ast->exp = unique_ptr<BaseAST>($3);
-    ast->if_stmt = unique_ptr<BaseAST>($5);
-    ast->else_stmt = unique_ptr<BaseAST>($7);
+    ast->exp = $3;
+    ast->if_stmt = $5;
+    ast->else_stmt = $7;
     $$ = ast;
   }
   | WHILE '(' Exp ')' Stmt {
     auto ast = new StmtWithWhileAST();
-    ast->exp = unique_ptr<BaseAST>($3);
-    ast->stmt = unique_ptr<BaseAST>($5);
+    ast->exp = $3;
+    ast->stmt = $5;
     $$ = ast;
   }
   | BREAK ';' {
@@ -366,7 +372,7 @@ Stmt
   }
   | RETURN Exp ';' {
     auto ast = new StmtWithReturnAST();
-    ast->exp = make_optional(unique_ptr<BaseAST>($2));
+    ast->exp = $2;
     $$ = ast;
   }
   ;
@@ -374,7 +380,7 @@ Stmt
 Exp
   : LOrExp {
     auto ast = new ExpAST();
-    ast->lOrExp = unique_ptr<BaseAST>($1);
+    ast->lOrExp = $1;
     $$ = ast;
   }
   ;
@@ -382,7 +388,7 @@ Exp
 LVal
   : IDENT {
     auto ast = new LValAST();
-    ast->ident = *unique_ptr<string>($1);
+    ast->ident = $1;
     $$ = ast;
   }
   ;
@@ -390,12 +396,12 @@ LVal
 PrimaryExp
   : '(' Exp ')' {
     auto ast = new PrimaryExpWithBrAST();
-    ast->exp = unique_ptr<BaseAST>($2);
+    ast->exp = $2;
     $$ = ast;
   }
   | LVal { 
     auto ast = new PrimaryExpWithLValAST();
-    ast->lVal = unique_ptr<BaseAST>($1);
+    ast->lVal = $1;
     $$ = ast;
   }
   | Number {
@@ -414,36 +420,36 @@ Number
 UnaryExp
   : PrimaryExp {
     auto ast = new UnaryExpAST();
-    ast->primaryExp = unique_ptr<BaseAST>($1);
+    ast->primaryExp = $1;
     $$ = ast;
   }
   | IDENT '(' ')'  {
     auto ast = new UnaryExpWithFuncAST();
-    ast->ident = *unique_ptr<string>($1);
+    ast->ident = $1;
     $$ = ast;
   }
   | IDENT '(' FuncRParams ')'  {
     auto ast = new UnaryExpWithFuncAST();
-    ast->ident = *unique_ptr<string>($1);
-    ast->params = make_optional(unique_ptr<BaseAST>($3));
+    ast->ident = $1;
+    ast->params = $3;
     $$ = ast;
   }
   | '!' UnaryExp {
     auto ast = new UnaryExpWithOpAST();
     ast->unaryOp = '!';
-    ast->unaryExp = unique_ptr<BaseAST>($2);
+    ast->unaryExp = $2;
     $$ = ast;
   }
   | '+' UnaryExp {
     auto ast = new UnaryExpWithOpAST();
     ast->unaryOp = '+';
-    ast->unaryExp = unique_ptr<BaseAST>($2);
+    ast->unaryExp = $2;
     $$ = ast;
   }
   | '-' UnaryExp {
     auto ast = new UnaryExpWithOpAST();
     ast->unaryOp = '-';
-    ast->unaryExp = unique_ptr<BaseAST>($2);
+    ast->unaryExp = $2;
     $$ = ast;
   }
   ;
@@ -451,190 +457,140 @@ UnaryExp
 FuncRParams
   : Exp ExpList {
     auto ast = new FuncRParamsAST();
-    ast->paramList.push_back(unique_ptr<BaseAST>($1));
-    vector<unique_ptr<BaseAST>> *vec = ($2);
-    for (auto it = vec->begin(); it != vec->end(); it++)
-      ast->paramList.push_back(move(*it));
+    ast->paramList = AstList($1, $2);
     $$ = ast;
   }
   ;
 
 ExpList
   : {
-    vector<unique_ptr<BaseAST>> *vec = new vector<unique_ptr<BaseAST>>;
-    $$ = vec;
+    $$ = vector<BaseAST *>();
   }
   | ExpList ',' Exp {
-    vector<unique_ptr<BaseAST>> *vec = ($1);
-    vec->push_back(unique_ptr<BaseAST>($3));
-    $$ = vec;
+    $$ = std::move($1);
+    $$.push_back($3);
   }
   ;
 
 MulExp
   : UnaryExp {
     auto ast = new MulExpAST();
-    ast->unaryExp = unique_ptr<BaseAST>($1);
+    ast->unaryExp = $1;
     $$ = ast;
   }
   | MulExp '*' UnaryExp {
-    auto ast = new MulExpWithOpAST();
-    ast->mulExp = unique_ptr<BaseAST>($1);
-    ast->mulOp = '*';
-    ast->unaryExp = unique_ptr<BaseAST>($3);
-    $$ = ast;
+    $$ = Chain<MulExpWithOpAST>(ast_kind_t::MUL_EXP_WITH_OP, $1, '*', $3);
   }
   | MulExp '/' UnaryExp {
-    auto ast = new MulExpWithOpAST();
-    ast->mulExp = unique_ptr<BaseAST>($1);
-    ast->mulOp = '/';
-    ast->unaryExp = unique_ptr<BaseAST>($3);
-    $$ = ast;
+    $$ = Chain<MulExpWithOpAST>(ast_kind_t::MUL_EXP_WITH_OP, $1, '/', $3);
   }
   | MulExp '%' UnaryExp {
-    auto ast = new MulExpWithOpAST();
-    ast->mulExp = unique_ptr<BaseAST>($1);
-    ast->mulOp = '%';
-    ast->unaryExp = unique_ptr<BaseAST>($3);
-    $$ = ast;
+    $$ = Chain<MulExpWithOpAST>(ast_kind_t::MUL_EXP_WITH_OP, $1, '%', $3);
   }
   ;
 
 AddExp
   : MulExp {
     auto ast = new AddExpAST();
-    ast->mulExp = unique_ptr<BaseAST>($1);
+    ast->mulExp = $1;
     $$ = ast;
   }
   | AddExp '+' MulExp {
-    auto ast = new AddExpWithOpAST();
-    ast->addExp = unique_ptr<BaseAST>($1);
-    ast->addOp = '+';
-    ast->mulExp = unique_ptr<BaseAST>($3);
-    $$ = ast;
+    $$ = Chain<AddExpWithOpAST>(ast_kind_t::ADD_EXP_WITH_OP, $1, '+', $3);
   }
   | AddExp '-' MulExp {
-    auto ast = new AddExpWithOpAST();
-    ast->addExp = unique_ptr<BaseAST>($1);
-    ast->addOp = '-';
-    ast->mulExp = unique_ptr<BaseAST>($3);
-    $$ = ast;
+    $$ = Chain<AddExpWithOpAST>(ast_kind_t::ADD_EXP_WITH_OP, $1, '-', $3);
   }
   ;
 
 RelExp
   : AddExp {
     auto ast = new RelExpAST();
-    ast->addExp = unique_ptr<BaseAST>($1);
+    ast->addExp = $1;
     $$ = ast;
   }
   | RelExp '<' AddExp {
-    auto ast = new RelExpWithOpAST();
-    ast->relExp = unique_ptr<BaseAST>($1);
-    string * op = new string("<");
-    ast->relOp = *unique_ptr<string>(op);
-    ast->addExp = unique_ptr<BaseAST>($3);
-    $$ = ast;
+    $$ = Chain<RelExpWithOpAST>(ast_kind_t::REL_EXP_WITH_OP, $1, "<", $3);
   }
   | RelExp '>' AddExp {
-    auto ast = new RelExpWithOpAST();
-    ast->relExp = unique_ptr<BaseAST>($1);
-    string * op = new string(">");
-    ast->relOp = *unique_ptr<string>(op);
-    ast->addExp = unique_ptr<BaseAST>($3);
-    $$ = ast;
+    $$ = Chain<RelExpWithOpAST>(ast_kind_t::REL_EXP_WITH_OP, $1, ">", $3);
   }
   | RelExp '<' '=' AddExp {
-    auto ast = new RelExpWithOpAST();
-    ast->relExp = unique_ptr<BaseAST>($1);
-    string * op = new string("<=");
-    ast->relOp = *unique_ptr<string>(op);
-    ast->addExp = unique_ptr<BaseAST>($4);
-    $$ = ast;
+    $$ = Chain<RelExpWithOpAST>(ast_kind_t::REL_EXP_WITH_OP, $1, "<=", $4);
   }
   | RelExp '>' '=' AddExp {
-    auto ast = new RelExpWithOpAST();
-    ast->relExp = unique_ptr<BaseAST>($1);
-    string * op = new string(">=");
-    ast->relOp = *unique_ptr<string>(op);
-    ast->addExp = unique_ptr<BaseAST>($4);
-    $$ = ast;
+    $$ = Chain<RelExpWithOpAST>(ast_kind_t::REL_EXP_WITH_OP, $1, ">=", $4);
   }
   ;
 
 EqExp
   : RelExp {
     auto ast = new EqExpAST();
-    ast->relExp = unique_ptr<BaseAST>($1);
+    ast->relExp = $1;
     $$ = ast;
   }
   | EqExp '=' '=' RelExp {
-    auto ast = new EqExpWithOpAST();
-    ast->eqExp = unique_ptr<BaseAST>($1);
-    string * op = new string("==");
-    ast->eqOp = *unique_ptr<string>(op);
-    ast->relExp = unique_ptr<BaseAST>($4);
-    $$ = ast;
+    $$ = Chain<EqExpWithOpAST>(ast_kind_t::EQ_EXP_WITH_OP, $1, "==", $4);
   }
   | EqExp '!' '=' RelExp {
-    auto ast = new EqExpWithOpAST();
-    ast->eqExp = unique_ptr<BaseAST>($1);
-    string * op = new string("!=");
-    ast->eqOp = *unique_ptr<string>(op);
-    ast->relExp = unique_ptr<BaseAST>($4);
-    $$ = ast;
+    $$ = Chain<EqExpWithOpAST>(ast_kind_t::EQ_EXP_WITH_OP, $1, "!=", $4);
   }
   ;
 
 LAndExp
   : EqExp {
     auto ast = new LAndExpAST();
-    ast->eqExp = unique_ptr<BaseAST>($1);
+    ast->eqExp = $1;
     $$ = ast;
   }
   | LAndExp '&' '&' EqExp {
-    auto ast = new LAndExpWithOpAST();
-    ast->lAndExp = unique_ptr<BaseAST>($1);
-    string * op = new string("&&");
-    ast->lAndOp = *unique_ptr<string>(op);
-    ast->eqExp = unique_ptr<BaseAST>($4);
-    $$ = ast;
+    $$ = Chain<LAndExpWithOpAST>(ast_kind_t::L_AND_EXP_WITH_OP, $1, "&&", $4);
   }
   ;
 
 LOrExp
   : LAndExp {
     auto ast = new LOrExpAST();
-    ast->lAndExp = unique_ptr<BaseAST>($1);
+    ast->lAndExp = $1;
     $$ = ast;
   }
   | LOrExp '|' '|' LAndExp {
-    auto ast = new LOrExpWithOpAST();
-    ast->lOrExp = unique_ptr<BaseAST>($1);
-    string * op = new string("||");
-    ast->lOrOp = *unique_ptr<string>(op);
-    ast->lAndExp = unique_ptr<BaseAST>($4);
-    $$ = ast;
+    $$ = Chain<LOrExpWithOpAST>(ast_kind_t::L_OR_EXP_WITH_OP, $1, "||", $4);
   }
   ;
 
 ConstExp
   : Exp {
     auto ast = new ConstExpAST();
-    ast->exp = unique_ptr<BaseAST>($1);
+    ast->exp = $1;
     $$ = ast;
   }
   ;
 
 %%
 
-// 定义错误处理函数, 其中第二个参数是错误信息
+BaseAST *Parse(const SourceFile &source) {
+  parse_context_t ctx = {ScannerCreate(source), nullptr, nullptr};
+  yy::parser parser(ctx);
+  int ret = parser.parse();
+  ScannerDestroy(ctx.scanner);
+  return ret ? nullptr : ctx.ast;
+}
+
+bool ParseUnits(const SourceFile &source, void (*unit)(BaseAST *item)) {
+  parse_context_t ctx = {ScannerCreate(source), nullptr, unit};
+  yy::parser parser(ctx);
+  int ret = parser.parse();
+  ScannerDestroy(ctx.scanner);
+  return ret == 0;
+}
+
+// 定义错误处理函数, 参数是错误信息
 // parser 如果发生错误 (例如输入的程序出现了语法错误), 就会调用这个函数
 
 // 打印错误信息
-void yyerror(unique_ptr<BaseAST> &ast, const char *s) {
-  extern int yylineno;
-  extern char *yytext;
+void yy::parser::error(const string &s) {
+  const char *yytext = ScannerText(ctx.scanner);
 
   int len = strlen(yytext);
   int i;
@@ -644,5 +600,5 @@ void yyerror(unique_ptr<BaseAST> &ast, const char *s) {
     sprintf(buf,"%s%d ",buf,yytext[i]);
   }
 
-  fprintf(stderr, "ERROR: %s at symbol '%s' on line %d\n", s, buf, yylineno);
-}
\ No newline at end of file
+  fprintf(stderr, "ERROR: %s at symbol '%s' on line %d\n", s.c_str(), buf, ScannerLine(ctx.scanner));
+}
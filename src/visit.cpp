@@ -1,30 +1,95 @@
-#include <iostream>
+#include <algorithm>
 #include <unordered_map>
+#include <vector>
 
+#include "emitter.hpp"
+#include "location.hpp"
+#include "mir.hpp"
+#include "parallel.hpp"
+#include "regalloc.hpp"
 #include "visit.hpp"
 
 using namespace std;
 
-unordered_map<koopa_raw_value_t, string> dic;
+int codegen_jobs = 1;
+
+// 以下为当前函数的状态, 每个线程各自生成一个函数, 互不影响
+
+// 汇编输出
+static thread_local AsmEmitter* emit = nullptr;
+// 当前函数的机器指令
+static thread_local MFunction mfunc;
+// 函数内各值的稠密下标
+thread_local ValueIndex value_index;
+// 各值所在的位置, 以 value_index 给出的下标索引
+thread_local vector<location_t> locations;
 // 记录函数所用栈空间
-int stack_space = 0;
-// 栈局部变量计数器
-int stack_cnt = 0;
+thread_local int stack_space = 0;
 // 记录函数内有无调用
-int has_call = 0;
+thread_local int has_call = 0;
+// 函数用到的 callee-saved 寄存器
+thread_local vector<reg_t> callee_saved;
+// 关键边上传值代码的标号计数, 函数开始时取 edge_base 中为它预留的起点
+thread_local int edge_cnt = 0;
+
+// 以下在生成函数之前写入, 生成函数时只读
+
+// 全局变量的编号, 对应标号 var_<编号>
+unordered_map<koopa_raw_value_t, int> global_labels;
 int global_cnt = -1;
+// 之前生成的所有函数用掉的 edge 标号数
+int edge_base = 0;
 
-// Just use for single instructions.
-int reg_cnt = 0;
+// 函数中需要单独生成关键边代码的 branch 数, 即所用的 edge 标号数
+static int EdgeLabels(const koopa_raw_function_t func) {
+  int count = 0;
+  for (size_t i = 0; i < func->bbs.len; i++) {
+    const koopa_raw_slice_t& insts = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i])->insts;
+    for (size_t j = 0; j < insts.len; j++) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(insts.buffer[j]);
+      if (inst->kind.tag == KOOPA_RVT_BRANCH && inst->kind.data.branch.true_args.len != 0 &&
+          inst->kind.data.branch.false_args.len != 0)
+        count++;
+    }
+  }
+  return count;
+}
 
-// 访问 raw program
-void Visit(const koopa_raw_program_t& program) {
-  // 执行一些其他的必要操作
-  // ...
-  // 访问所有全局变量
+// 访问 raw program, 汇编写入 out
+void Visit(const koopa_raw_program_t& program, Writer& out) {
+  AsmEmitter emitter(out);
+  emit = &emitter;
+  // 访问所有全局变量, 全局变量的标号在生成函数之前确定
   Visit(program.values);
-  // 访问所有函数
-  Visit(program.funcs);
+
+  // 访问所有函数, 每个函数的 edge 标号从预留的起点开始, 结果与依次生成相同
+  size_t n = program.funcs.len;
+  vector<int> edge_start(n);
+  for (size_t i = 0; i < n; i++) {
+    edge_start[i] = edge_base;
+    edge_base += EdgeLabels(reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]));
+  }
+
+  if (codegen_jobs <= 1 || n <= 1) {
+    for (size_t i = 0; i < n; i++) {
+      edge_cnt = edge_start[i];
+      Visit(reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]));
+    }
+  } else {
+    // 各函数的汇编分别写入内存, 全部生成后按顺序拼接
+    vector<string> texts(n);
+    ParallelFor(n, codegen_jobs, [&](size_t i, int worker) {
+      Writer buffer;
+      AsmEmitter func_emitter(buffer);
+      emit = &func_emitter;
+      edge_cnt = edge_start[i];
+      Visit(reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]));
+      texts[i] = buffer.Take();
+    });
+    for (auto& text : texts)
+      out << text;
+  }
+  emit = nullptr;
 }
 
 // 访问 raw slice
@@ -52,61 +117,188 @@ void Visit(const koopa_raw_slice_t& slice) {
   }
 }
 
-// 访问函数
-void Visit(const koopa_raw_function_t& func) {
-  if (func->bbs.len == 0) return;
+// 值所在的位置
+static location_t& Loc(const koopa_raw_value_t value) {
+  return locations[value_index[value]];
+}
 
-  // 清零函数相关变量
-  stack_cnt = 0;
-  has_call = 0;
+// 为函数内出现的所有值编号, 并记录立即数与全局变量的位置
+static void IndexValues(const koopa_raw_function_t& func) {
+  size_t expected = func->params.len;
+  for (size_t i = 0; i < func->bbs.len; i++) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    expected += bb->params.len + bb->insts.len * 2;
+  }
+  value_index.Reset(expected);
+  locations.clear();
+
+  auto add = [&](koopa_raw_value_t value) {
+    uint32_t index = value_index.Insert(value);
+    if (index < locations.size())
+      return;
+    location_t loc = {location_t::NONE, ZERO, 0};
+    if (value->kind.tag == KOOPA_RVT_INTEGER)
+      loc = {location_t::IMM, ZERO, value->kind.data.integer.value};
+    else if (value->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
+      loc = {location_t::GLOBAL, ZERO, global_labels.at(value)};
+    locations.push_back(loc);
+  };
+
+  for (size_t i = 0; i < func->params.len; i++)
+    add(reinterpret_cast<koopa_raw_value_t>(func->params.buffer[i]));
+  for (size_t i = 0; i < func->bbs.len; i++) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    for (size_t j = 0; j < bb->params.len; j++)
+      add(reinterpret_cast<koopa_raw_value_t>(bb->params.buffer[j]));
+    for (size_t j = 0; j < bb->insts.len; j++) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+      add(inst);
+      ForEachOperand(inst, add);
+    }
+  }
+}
 
-  // 执行一些其他的必要操作
-  cout << "\t.text\n";
-  cout << "\t.globl " << func->name + 1 << "\n";
-  cout << func->name + 1 << ":\n";
+static location_t RegLoc(reg_t reg) {
+  return {location_t::REG, reg, 0};
+}
 
-  // 记录函数内部局部变量数量
-  int var_cnt = 0;
-  int call_cnt = 0;
+static bool SameLoc(const location_t& a, const location_t& b) {
+  return a.kind == b.kind && a.reg == b.reg && a.data == b.data;
+}
 
-  for (int i = 0; i < func->bbs.len; i++) {
-    const koopa_raw_slice_t& insts = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i])->insts;
-    int cnt = insts.len;
-    for (size_t i = 0; i < insts.len; ++i) {
-      auto inst = reinterpret_cast<koopa_raw_value_t>(insts.buffer[i]);
-      // 无返回值语句
-      if (inst->ty->tag == KOOPA_RTT_UNIT) {
-        cnt--;
+// 在两个位置间传送一个值, 栈到栈时借助 t1
+static void Move(const location_t& dst, const location_t& src) {
+  if (SameLoc(dst, src))
+    return;
+  reg_t rs = src.kind == location_t::REG ? src.reg : dst.kind == location_t::REG ? dst.reg : T1;
+  if (src.kind == location_t::IMM) {
+    if (src.data == 0)
+      rs = ZERO;
+    else
+      mfunc.Li(rs, src.data);
+  } else if (src.kind == location_t::STACK) {
+    mfunc.Lw(rs, src.data, SP);
+  }
+  if (dst.kind == location_t::REG) {
+    if (rs != dst.reg)
+      mfunc.Mv(dst.reg, rs);
+  } else {
+    mfunc.Sw(rs, dst.data, SP);
+  }
+}
+
+// 依次输出一组并行的传送 (目标, 源), 出现环时借助 t0 打破
+static void ParallelMove(vector<pair<location_t, location_t>> moves) {
+  moves.erase(remove_if(moves.begin(), moves.end(), [](const pair<location_t, location_t>& move) {
+                return move.first.kind == location_t::NONE || SameLoc(move.first, move.second);
+              }),
+              moves.end());
+  while (!moves.empty()) {
+    bool progress = false;
+    for (size_t i = 0; i < moves.size() && !progress; i++) {
+      bool blocked = false;
+      for (size_t j = 0; j < moves.size(); j++)
+        if (j != i && SameLoc(moves[j].second, moves[i].first))
+          blocked = true;
+      if (!blocked) {
+        Move(moves[i].first, moves[i].second);
+        moves.erase(moves.begin() + i);
+        progress = true;
       }
+    }
+    if (!progress) {
+      location_t src = moves[0].second;
+      Move(RegLoc(T0), src);
+      for (auto& move : moves)
+        if (SameLoc(move.second, src))
+          move.second = RegLoc(T0);
+    }
+  }
+}
+
+// 分配寄存器, 将各值的位置写入 locations, 并计算栈帧大小
+static void Allocate(const koopa_raw_function_t& func) {
+  reg_alloc_t alloc = AllocateRegisters(func);
+
+  // 栈帧自底向上依次为: 调用时超出 8 个的参数, 局部变量与溢出值, callee-saved 寄存器, ra
+  int call_cnt = 0;
+  vector<koopa_raw_value_t> locals;
+  for (size_t i = 0; i < func->bbs.len; i++) {
+    const koopa_raw_slice_t& insts = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i])->insts;
+    for (size_t j = 0; j < insts.len; ++j) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(insts.buffer[j]);
+      if (inst->kind.tag == KOOPA_RVT_ALLOC)
+        locals.push_back(inst);
       // 记录函数内有无调用
       if (inst->kind.tag == KOOPA_RVT_CALL) {
         has_call = 1;
-        int cur = max(int(inst->kind.data.call.args.len) - 8, 0);
-        call_cnt = max(call_cnt, cur);
+        call_cnt = max(call_cnt, int(inst->kind.data.call.args.len) - 8);
       }
     }
-    var_cnt += cnt;
   }
 
-  stack_cnt = call_cnt;
+  int slot = call_cnt;
+  for (auto value : locals)
+    Loc(value) = {location_t::STACK, ZERO, slot++ * 4};
+  for (auto value : alloc.spilled)
+    Loc(value) = {location_t::STACK, ZERO, slot++ * 4};
+  for (auto& [value, reg] : alloc.reg)
+    Loc(value) = {location_t::REG, reg, 0};
+
+  callee_saved = alloc.callee_saved;
+  // 栈空间按 16 字节对齐
+  stack_space = (slot + int(callee_saved.size()) + has_call) * 4;
+  stack_space = (stack_space + 15) / 16 * 16;
+
+  // 超出 8 个的参数位于调用者的栈帧中
+  for (size_t i = 8; i < func->params.len; i++)
+    Loc(reinterpret_cast<koopa_raw_value_t>(func->params.buffer[i])) = {location_t::STACK, ZERO, int32_t(stack_space + (i - 8) * 4)};
+}
+
+// 第 i 个 callee-saved 寄存器的保存位置: 栈帧顶部依次为 ra (有调用时) 与各 callee-saved 寄存器
+static int32_t CalleeSavedOffset(size_t i) {
+  return stack_space - 4 * (has_call + 1 + int32_t(i));
+}
+
+// 访问函数
+void Visit(const koopa_raw_function_t& func) {
+  if (func->bbs.len == 0) return;
+
+  // 清零函数相关变量
+  has_call = 0;
+
+  // 执行一些其他的必要操作
+  mfunc.Reset(func->name + 1);
+
+  IndexValues(func);
+  Allocate(func);
 
-  // 更新栈所需空间
-  stack_space = (var_cnt + has_call + call_cnt) * 4;
   if (stack_space != 0)
-    cout << "\taddi sp, sp, " << -stack_space << "\n";
+    mfunc.Addi(SP, SP, -stack_space);
 
   if (has_call)
-    cout << "\tsw ra, " << stack_space - 4 << "(sp)\n";
+    mfunc.Sw(RA, stack_space - 4, SP);
+
+  for (size_t i = 0; i < callee_saved.size(); i++)
+    mfunc.Sw(callee_saved[i], CalleeSavedOffset(i), SP);
+
+  // 参数从 a 寄存器转移到分配的位置
+  vector<pair<location_t, location_t>> moves;
+  for (size_t i = 0; i < min(size_t(func->params.len), size_t(8)); i++)
+    moves.push_back(make_pair(Loc(reinterpret_cast<koopa_raw_value_t>(func->params.buffer[i])), RegLoc(A0 + i)));
+  ParallelMove(moves);
 
   // 访问所有基本块
   Visit(func->bbs);
+
+  emit->Function(mfunc);
 }
 
 // 访问基本块
 void Visit(const koopa_raw_basic_block_t& bb) {
   // 执行一些其他的必要操作
   if (strcmp(bb->name + 1, "entry"))
-    cout << bb->name + 1 << ":\n";
+    mfunc.Block(Label(bb->name + 1));
   // 访问所有指令
   Visit(bb->insts);
 }
@@ -155,471 +347,250 @@ void Visit(const koopa_raw_value_t& value) {
       break;
     default:
       // 其他类型暂时遇不到
-      cout << "\t" << kind.tag << "\n";
-      // assert(false);
+      assert(false);
       break;
   }
 }
 
-void Search(const koopa_raw_value_t value) {
-  // cout << "\tTAG: " << value->kind.tag << "\n";
-
-  if (value->kind.tag == KOOPA_RVT_INTEGER && value->kind.data.integer.value != 0) {
-    cout << "\tli t" << reg_cnt << ", ";
-    Visit(value->kind.data.integer);
-    cout << "\n";
-
-    dic[value] = "t" + to_string(reg_cnt);
-    reg_cnt++;
-  } else if (value->kind.tag == KOOPA_RVT_INTEGER && value->kind.data.integer.value == 0) {
-    dic[value] = "x0";
-  } else if (value->kind.tag == KOOPA_RVT_ALLOC || value->kind.tag == KOOPA_RVT_LOAD || value->kind.tag == KOOPA_RVT_BINARY || value->kind.tag == KOOPA_RVT_CALL) {
-    cout << "\tlw t" << reg_cnt << ", " << dic[value] << "\n";
-    dic[value] = "t" + to_string(reg_cnt);
-    reg_cnt++;
-  } else if (value->kind.tag == KOOPA_RVT_FUNC_ARG_REF) {
-    size_t index = value->kind.data.func_arg_ref.index;
-    if (index < 8) {
-      dic[value] = "a" + to_string(index);
-    } else {
-      cout << "\tlw t0, " << stack_space + (index - 8) * 4 << "(sp)\n";
-      dic[value] = "t0";
-    }
+// 取得存放该值的寄存器, 值不在寄存器中时装入 scratch
+static reg_t Fetch(const koopa_raw_value_t value, reg_t scratch) {
+  const location_t& loc = Loc(value);
+  switch (loc.kind) {
+    case location_t::REG:
+      return loc.reg;
+    case location_t::IMM:
+      if (loc.data == 0)
+        return ZERO;
+      mfunc.Li(scratch, loc.data);
+      return scratch;
+    case location_t::STACK:
+      mfunc.Lw(scratch, loc.data, SP);
+      return scratch;
+    default:
+      assert(false);
+      return scratch;
   }
 }
 
+// 结果应写入的寄存器, 未分配到寄存器时使用 t0
+static reg_t Target(const koopa_raw_value_t value) {
+  const location_t& loc = Loc(value);
+  return loc.kind == location_t::REG ? loc.reg : T0;
+}
+
+// 结果被溢出时写回栈
+static void WriteBack(const koopa_raw_value_t value, reg_t reg) {
+  const location_t& loc = Loc(value);
+  if (loc.kind == location_t::STACK)
+    mfunc.Sw(reg, loc.data, SP);
+}
+
 void Visit(const koopa_raw_global_alloc_t& global, const koopa_raw_value_t& value) {
   global_cnt++;
-  cout << "\t.data\n";
-  string label = "var_" + to_string(global_cnt);
-  cout << "\t.globl " << label << "\n";
-  cout << label << ":\n";
   switch (global.init->kind.tag) {
   case KOOPA_RVT_ZERO_INIT:
-    cout << "\t.zero 4\n\n";
+    emit->Global(Label("var_", global_cnt), true, 0);
     break;
   case KOOPA_RVT_INTEGER:
-    cout << "\t.word " << global.init->kind.data.integer.value << "\n\n";
+    emit->Global(Label("var_", global_cnt), false, global.init->kind.data.integer.value);
     break;
   default:
-    cout << "\tTAG: " << global.init->kind.tag << "\n";
     assert(false);
     break;
   }
-  dic[value] = label;
+  global_labels[value] = global_cnt;
 }
 
 void Visit(const koopa_raw_load_t& load, const koopa_raw_value_t& value) {
-  if (load.src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
-    cout << "\tla t0, " << dic[load.src] << "\n";
-    cout << "\tlw t0, 0(t0)" << "\n";
+  reg_t rd = Target(value);
+  const location_t& src = Loc(load.src);
+  if (src.kind == location_t::GLOBAL) {
+    mfunc.La(rd, Label("var_", src.data));
+    mfunc.Lw(rd, 0, rd);
   } else {
-    cout << "\tlw t0, " << dic[load.src] << "\n";
+    mfunc.Lw(rd, src.data, SP);
   }
-  
-  cout << "\tsw t0, " << stack_cnt * 4 << "(sp)"
-       << "\n";
-  dic[value] = to_string(stack_cnt * 4) + "(sp)";
-  stack_cnt++;
+  WriteBack(value, rd);
 }
 
 void Visit(const koopa_raw_store_t& store) {
-  reg_cnt = 0;
-  Search(store.value);
-  if (dic.find(store.dest) == dic.end()) {
-    dic[store.dest] = to_string(stack_cnt * 4) + "(sp)";
-    stack_cnt++;
-  }
-
-  if (store.dest->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
-    cout << "\tla t" << reg_cnt << ", " << dic[store.dest] << "\n";
-    reg_cnt++;
-    cout << "\tsw " << dic[store.value] << ", " << "0(t" << reg_cnt-1 << ")\n";
+  reg_t rs = Fetch(store.value, T0);
+  const location_t& dest = Loc(store.dest);
+  if (dest.kind == location_t::GLOBAL) {
+    mfunc.La(T1, Label("var_", dest.data));
+    mfunc.Sw(rs, 0, T1);
   } else {
-    cout << "\tsw " << dic[store.value] << ", " << dic[store.dest] << "\n";
+    mfunc.Sw(rs, dest.data, SP);
   }
 }
 
+// 立即数不单独生成代码, 由使用处通过 Fetch 装入
 void Visit(const koopa_raw_integer_t& integer) {
-  cout << integer.value;
 }
 
-bool isNum(const koopa_raw_value_t value);
-
 void Visit(const koopa_raw_binary_t& binary, const koopa_raw_value_t& value) {
+  reg_t lhs = Fetch(binary.lhs, T0);
+  reg_t rhs = Fetch(binary.rhs, T1);
+  reg_t rd = Target(value);
+
   switch (binary.op) {
     /// Not equal to.
-    case 0: {
-      reg_cnt = 0;
-
-      Search(binary.lhs);
-      Search(binary.rhs);
-
-      cout << "\txor t0"
-           << ", " << dic[binary.lhs] << ", " << dic[binary.rhs] << "\n";
-      cout << "\tsnez t0"
-           << ", t0"
-           << "\n";
-      cout << "\tsw t0, " << stack_cnt * 4 << "(sp)"
-           << "\n";
-
-      dic[value] = to_string(stack_cnt * 4) + "(sp)";
-      stack_cnt++;
-
+    case KOOPA_RBO_NOT_EQ:
+      mfunc.Op(mop_t::XOR, rd, lhs, rhs);
+      mfunc.Snez(rd, rd);
       break;
-    }
-
     /// Equal to.
-    case 1: {
-      reg_cnt = 0;
-
-      Search(binary.lhs);
-      Search(binary.rhs);
-
-      cout << "\txor t0"
-           << ", " << dic[binary.lhs] << ", " << dic[binary.rhs] << "\n";
-      cout << "\tseqz t0"
-           << ", t0"
-           << "\n";
-      cout << "\tsw t0, " << stack_cnt * 4 << "(sp)"
-           << "\n";
-
-      dic[value] = to_string(stack_cnt * 4) + "(sp)";
-      stack_cnt++;
-
+    case KOOPA_RBO_EQ:
+      mfunc.Op(mop_t::XOR, rd, lhs, rhs);
+      mfunc.Seqz(rd, rd);
       break;
-    }
-
     /// Greater than.
-    case 2: {
-      reg_cnt = 0;
-
-      Search(binary.lhs);
-      Search(binary.rhs);
-
-      cout << "\tsgt t0"
-           << ", " << dic[binary.lhs] << ", " << dic[binary.rhs] << "\n";
-      cout << "\tsw t0, " << stack_cnt * 4 << "(sp)"
-           << "\n";
-
-      dic[value] = to_string(stack_cnt * 4) + "(sp)";
-      stack_cnt++;
-
+    case KOOPA_RBO_GT:
+      mfunc.Op(mop_t::SGT, rd, lhs, rhs);
       break;
-    }
-
     /// Less than.
-    case 3: {
-      reg_cnt = 0;
-
-      Search(binary.lhs);
-      Search(binary.rhs);
-
-      cout << "\tslt t0"
-           << ", " << dic[binary.lhs] << ", " << dic[binary.rhs] << "\n";
-      cout << "\tsw t0, " << stack_cnt * 4 << "(sp)"
-           << "\n";
-
-      dic[value] = to_string(stack_cnt * 4) + "(sp)";
-      stack_cnt++;
-
+    case KOOPA_RBO_LT:
+      mfunc.Op(mop_t::SLT, rd, lhs, rhs);
       break;
-    }
-
     /// Greater than or equal to.
-    case 4: {
-      reg_cnt = 0;
-
-      Search(binary.lhs);
-      Search(binary.rhs);
-
-      cout << "\tslt t0"
-           << ", " << dic[binary.lhs] << ", " << dic[binary.rhs] << "\n";
-      cout << "\tseqz t0"
-           << ", t0"
-           << "\n";
-      cout << "\tsw t0, " << stack_cnt * 4 << "(sp)"
-           << "\n";
-
-      dic[value] = to_string(stack_cnt * 4) + "(sp)";
-      stack_cnt++;
-
+    case KOOPA_RBO_GE:
+      mfunc.Op(mop_t::SLT, rd, lhs, rhs);
+      mfunc.Seqz(rd, rd);
       break;
-    }
-
     /// Less than or equal to.
-    case 5: {
-      reg_cnt = 0;
-
-      Search(binary.lhs);
-      Search(binary.rhs);
-
-      cout << "\tsgt t0"
-           << ", " << dic[binary.lhs] << ", " << dic[binary.rhs] << "\n";
-      cout << "\tseqz t0, t0"
-           << "\n";
-      cout << "\tsw t0, " << stack_cnt * 4 << "(sp)"
-           << "\n";
-
-      dic[value] = to_string(stack_cnt * 4) + "(sp)";
-      stack_cnt++;
-
+    case KOOPA_RBO_LE:
+      mfunc.Op(mop_t::SGT, rd, lhs, rhs);
+      mfunc.Seqz(rd, rd);
       break;
-    }
-
     /// Addition.
-    case 6: {
-      reg_cnt = 0;
-
-      Search(binary.lhs);
-      Search(binary.rhs);
-
-      cout << "\tadd t0"
-           << ", " << dic[binary.lhs] << ", " << dic[binary.rhs] << "\n";
-      cout << "\tsw t0, " << stack_cnt * 4 << "(sp)"
-           << "\n";
-
-      dic[value] = to_string(stack_cnt * 4) + "(sp)";
-      stack_cnt++;
-
+    case KOOPA_RBO_ADD:
+      mfunc.Op(mop_t::ADD, rd, lhs, rhs);
       break;
-    }
-
     /// Subtraction.
-    case 7: {
-      reg_cnt = 0;
-
-      Search(binary.lhs);
-      Search(binary.rhs);
-
-      cout << "\tsub t0"
-           << ", " << dic[binary.lhs] << ", " << dic[binary.rhs] << "\n";
-      cout << "\tsw t0, " << stack_cnt * 4 << "(sp)"
-           << "\n";
-
-      dic[value] = to_string(stack_cnt * 4) + "(sp)";
-      stack_cnt++;
-
+    case KOOPA_RBO_SUB:
+      mfunc.Op(mop_t::SUB, rd, lhs, rhs);
       break;
-    }
-
     /// Multiplication.
-    case 8: {
-      reg_cnt = 0;
-
-      Search(binary.lhs);
-      Search(binary.rhs);
-
-      cout << "\tmul t0"
-           << ", " << dic[binary.lhs] << ", " << dic[binary.rhs] << "\n";
-      cout << "\tsw t0, " << stack_cnt * 4 << "(sp)"
-           << "\n";
-
-      dic[value] = to_string(stack_cnt * 4) + "(sp)";
-      stack_cnt++;
-
+    case KOOPA_RBO_MUL:
+      mfunc.Op(mop_t::MUL, rd, lhs, rhs);
       break;
-    }
-
     /// Division.
-    case 9: {
-      reg_cnt = 0;
-
-      Search(binary.lhs);
-      Search(binary.rhs);
-
-      cout << "\tdiv t0"
-           << ", " << dic[binary.lhs] << ", " << dic[binary.rhs] << "\n";
-      cout << "\tsw t0, " << stack_cnt * 4 << "(sp)"
-           << "\n";
-
-      dic[value] = to_string(stack_cnt * 4) + "(sp)";
-      stack_cnt++;
-
+    case KOOPA_RBO_DIV:
+      mfunc.Op(mop_t::DIV, rd, lhs, rhs);
       break;
-    }
-
     /// Modulo.
-    case 10: {
-      reg_cnt = 0;
-
-      Search(binary.lhs);
-      Search(binary.rhs);
-
-      cout << "\trem t0"
-           << ", " << dic[binary.lhs] << ", " << dic[binary.rhs] << "\n";
-      cout << "\tsw t0, " << stack_cnt * 4 << "(sp)"
-           << "\n";
-
-      dic[value] = to_string(stack_cnt * 4) + "(sp)";
-      stack_cnt++;
-
+    case KOOPA_RBO_MOD:
+      mfunc.Op(mop_t::REM, rd, lhs, rhs);
       break;
-    }
-
     /// Bitwise AND.
-    case 11: {
-      reg_cnt = 0;
-
-      bool int_l = isNum(binary.lhs);
-      bool int_r = isNum(binary.rhs);
-
-      if (int_l && int_r) {
-        cout << "\tli t" << reg_cnt << ", ";
-        Visit(binary.lhs->kind.data.integer);
-        cout << "\n";
-
-        dic[binary.lhs] = "t" + to_string(reg_cnt);
-        reg_cnt++;
-
-        cout << "\tandi t0"
-             << ", " << dic[binary.lhs] << ", ";
-        Visit(binary.lhs->kind.data.integer);
-        cout << "\n";
-      } else if (int_l && !int_r) {
-        cout << "\tandi t0"
-             << ", " << dic[binary.rhs] << ", ";
-        Visit(binary.lhs->kind.data.integer);
-        cout << "\n";
-      } else if (!int_l && int_r) {
-        cout << "\tandi t0"
-             << ", " << dic[binary.lhs] << ", ";
-        Visit(binary.rhs->kind.data.integer);
-        cout << "\n";
-      } else {
-        cout << "\tand t0"
-             << ", " << dic[binary.lhs] << ", " << dic[binary.rhs] << "\n";
-      }
-
-      cout << "\tsw t0, " << stack_cnt * 4 << "(sp)"
-           << "\n";
-
-      dic[value] = to_string(stack_cnt * 4) + "(sp)";
-      stack_cnt++;
-
+    case KOOPA_RBO_AND:
+      mfunc.Op(mop_t::AND, rd, lhs, rhs);
       break;
-    }
-
     /// Bitwise OR.
-    case 12: {
-      reg_cnt = 0;
-
-      bool int_l = isNum(binary.lhs);
-      bool int_r = isNum(binary.rhs);
-
-      if (int_l && int_r) {
-        cout << "\tli t" << reg_cnt << ", ";
-        Visit(binary.lhs->kind.data.integer);
-        cout << "\n";
-
-        dic[binary.lhs] = "t" + to_string(reg_cnt);
-        reg_cnt++;
-
-        cout << "\tori t0"
-             << ", " << dic[binary.lhs] << ", ";
-        Visit(binary.lhs->kind.data.integer);
-        cout << "\n";
-      } else if (int_l && !int_r) {
-        cout << "\tori t0"
-             << ", " << dic[binary.rhs] << ", ";
-        Visit(binary.lhs->kind.data.integer);
-        cout << "\n";
-      } else if (!int_l && int_r) {
-        cout << "\tori t0"
-             << ", " << dic[binary.lhs] << ", ";
-        Visit(binary.rhs->kind.data.integer);
-        cout << "\n";
-      } else {
-        cout << "\tor t0"
-             << ", " << dic[binary.lhs] << ", " << dic[binary.rhs] << "\n";
-      }
-
-      cout << "\tsw t0, " << stack_cnt * 4 << "(sp)"
-           << "\n";
-
-      dic[value] = to_string(stack_cnt * 4) + "(sp)";
-      stack_cnt++;
-
+    case KOOPA_RBO_OR:
+      mfunc.Op(mop_t::OR, rd, lhs, rhs);
+      break;
+    /// Bitwise XOR.
+    case KOOPA_RBO_XOR:
+      mfunc.Op(mop_t::XOR, rd, lhs, rhs);
+      break;
+    /// Shift left logical.
+    case KOOPA_RBO_SHL:
+      mfunc.Op(mop_t::SLL, rd, lhs, rhs);
+      break;
+    /// Shift right logical.
+    case KOOPA_RBO_SHR:
+      mfunc.Op(mop_t::SRL, rd, lhs, rhs);
+      break;
+    /// Shift right arithmetic.
+    case KOOPA_RBO_SAR:
+      mfunc.Op(mop_t::SRA, rd, lhs, rhs);
       break;
-    }
-
     default:
+      assert(false);
       break;
   }
+
+  WriteBack(value, rd);
 }
 
-bool isNum(const koopa_raw_value_t value) {
-  if (value->kind.tag == KOOPA_RVT_INTEGER) {
-    return true;
-  }
-  cout << "\tlw t" << reg_cnt << ", " << dic[value] << "\n";
-  dic[value] = "t" + to_string(reg_cnt);
-  reg_cnt++;
-  return false;
+// 沿控制流边向目标基本块的参数传值
+static void EdgeMoves(const koopa_raw_basic_block_t target, const koopa_raw_slice_t& args) {
+  vector<pair<location_t, location_t>> moves;
+  for (size_t i = 0; i < args.len; i++)
+    moves.push_back(make_pair(Loc(reinterpret_cast<koopa_raw_value_t>(target->params.buffer[i])),
+                              Loc(reinterpret_cast<koopa_raw_value_t>(args.buffer[i]))));
+  ParallelMove(moves);
 }
 
 void Visit(const koopa_raw_branch_t& branch) {
-  reg_cnt = 0;
-  Search(branch.cond);
-  cout << "\tbnez " << dic[branch.cond] << ", " << branch.true_bb->name + 1 << "\n";
-  cout << "\tj " << branch.false_bb->name + 1 << "\n";
+  reg_t cond = Fetch(branch.cond, T0);
+  label_t true_bb = Label(branch.true_bb->name + 1);
+  label_t false_bb = Label(branch.false_bb->name + 1);
+  if (branch.true_args.len == 0) {
+    mfunc.Bnez(cond, true_bb);
+    EdgeMoves(branch.false_bb, branch.false_args);
+    mfunc.J(false_bb);
+  } else if (branch.false_args.len == 0) {
+    mfunc.Beqz(cond, false_bb);
+    EdgeMoves(branch.true_bb, branch.true_args);
+    mfunc.J(true_bb);
+  } else {
+    // 两条边都需要传值时, 为 true 边单独生成一段代码
+    label_t edge = Label("edge_", edge_cnt++);
+    mfunc.Bnez(cond, edge);
+    EdgeMoves(branch.false_bb, branch.false_args);
+    mfunc.J(false_bb);
+    mfunc.Block(edge);
+    EdgeMoves(branch.true_bb, branch.true_args);
+    mfunc.J(true_bb);
+  }
 }
 
 void Visit(const koopa_raw_jump_t& jump) {
-  cout << "\tj " << jump.target->name + 1 << "\n";
+  EdgeMoves(jump.target, jump.args);
+  mfunc.J(Label(jump.target->name + 1));
 }
 
 void Visit(const koopa_raw_call_t& call, const koopa_raw_value_t& value) {
-  for (int i = 0; i < min(int(call.args.len), 8); i++) {
-    if (reinterpret_cast<koopa_raw_value_t>(call.args.buffer[i])->kind.tag == KOOPA_RVT_INTEGER)
-      cout << "\tli a" << i << ", " << reinterpret_cast<koopa_raw_value_t>(call.args.buffer[i])->kind.data.integer.value << "\n";
-    else {
-      cout << "\tlw t0, " << dic[reinterpret_cast<koopa_raw_value_t>(call.args.buffer[i])] << "\n";
-      cout << "\tmv a" << i << ", t0\n";
-    }
+  // 先处理经栈传递的参数, 此时 a 寄存器尚未被改写
+  for (size_t i = 8; i < call.args.len; i++) {
+    reg_t rs = Fetch(reinterpret_cast<koopa_raw_value_t>(call.args.buffer[i]), T0);
+    mfunc.Sw(rs, (i - 8) * 4, SP);
   }
 
-  for (int i = 8; i < call.args.len; i++) {
-    if (reinterpret_cast<koopa_raw_value_t>(call.args.buffer[i])->kind.tag == KOOPA_RVT_INTEGER) {
-      cout << "\tli t0"
-           << ", " << reinterpret_cast<koopa_raw_value_t>(call.args.buffer[i])->kind.data.integer.value << "\n";
-      cout << "\tsw t0"
-           << ", " << (i - 8) * 4 << "(sp)\n";
-    } else {
-      cout << "\tmv t0"
-           << ", " << dic[reinterpret_cast<koopa_raw_value_t>(call.args.buffer[i])] << "\n";
-      cout << "\tsw t0"
-           << ", " << (i - 8) * 4 << "(sp)\n";
-    }
-  }
+  // 寄存器间的传递可能互相覆盖, 作为并行传送处理
+  vector<pair<location_t, location_t>> moves;
+  for (size_t i = 0; i < min(size_t(call.args.len), size_t(8)); i++)
+    moves.push_back(make_pair(RegLoc(A0 + i), Loc(reinterpret_cast<koopa_raw_value_t>(call.args.buffer[i]))));
+  ParallelMove(moves);
 
-  cout << "\tcall " << call.callee->name + 1 << "\n";
+  mfunc.Call(Label(call.callee->name + 1));
 
-  // 根据ir是否保存返回值决定是否保存a0
+  // 根据返回值是否被使用决定是否保存 a0
   if (value->ty->tag != KOOPA_RTT_UNIT) {
-    cout << "\tsw a0, " << stack_cnt * 4 << "(sp)\n";
-    dic[value] = std::to_string(stack_cnt*4) + "(sp)";
-    stack_cnt++;
+    const location_t& loc = Loc(value);
+    if (loc.kind == location_t::REG && loc.reg != A0)
+      mfunc.Mv(loc.reg, A0);
+    else if (loc.kind == location_t::STACK)
+      mfunc.Sw(A0, loc.data, SP);
   }
 }
 
 void Visit(const koopa_raw_return_t& ret) {
   if (ret.value != nullptr) {
-    if (ret.value->kind.tag == KOOPA_RVT_INTEGER) {
-      cout << "\tli a0, ";
-      Visit(ret.value->kind.data.integer);
-      cout << "\n";
-    } else if (ret.value->kind.tag == KOOPA_RVT_BINARY || ret.value->kind.tag == KOOPA_RVT_LOAD || ret.value->kind.tag == KOOPA_RVT_CALL) {
-      cout << "\tlw a0, " << dic[ret.value] << "\n";
-    } else {
-      cout << "\tERROR: Undefined Tag: " << ret.value->kind.tag << "\n";
-    }
+    reg_t rs = Fetch(ret.value, A0);
+    if (rs != A0)
+      mfunc.Mv(A0, rs);
   }
 
+  for (size_t i = 0; i < callee_saved.size(); i++)
+    mfunc.Lw(callee_saved[i], CalleeSavedOffset(i), SP);
+
   if (has_call)
-    cout << "\tlw ra, " << stack_space - 4 << "(sp)\n";
+    mfunc.Lw(RA, stack_space - 4, SP);
 
   if (stack_space != 0)
-    cout << "\taddi sp, sp, " << stack_space << "\n";
-  cout << "\tret\n\n";
-}
\ No newline at end of file
+    mfunc.Addi(SP, SP, stack_space);
+  mfunc.Ret();
+}
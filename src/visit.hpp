@@ -4,8 +4,13 @@
 #include <cstring>
 
 #include "koopa.h"
+#include "writer.hpp"
 
-void Visit(const koopa_raw_program_t& program);
+// 生成汇编的线程数, 大于 1 时各函数并行生成, 输出与单线程相同
+extern int codegen_jobs;
+
+// 生成 RISC-V 汇编并写入 out
+void Visit(const koopa_raw_program_t& program, Writer& out);
 void Visit(const koopa_raw_slice_t& slice);
 void Visit(const koopa_raw_function_t& func);
 void Visit(const koopa_raw_basic_block_t& bb);
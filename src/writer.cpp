@@ -0,0 +1,89 @@
+#include <cassert>
+#include <cstring>
+#include <unistd.h>
+
+#include "writer.hpp"
+
+using namespace std;
+
+// 00 ~ 99 的两位数字, 每次转换两位
+static const char kDigitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+void Writer::Write(const char* s, size_t len) {
+  if (size + len > kChunkSize) {
+    Flush();
+    // 超过一块的内容直接写出, 不经过缓冲区
+    if (len > kChunkSize && fd < 0) {
+      text.append(s, len);
+      return;
+    }
+    if (len > kChunkSize) {
+      while (len > 0) {
+        ssize_t n = write(fd, s, len);
+        assert(n > 0);
+        s += n;
+        len -= n;
+      }
+      return;
+    }
+  }
+  memcpy(buffer + size, s, len);
+  size += len;
+}
+
+Writer& Writer::operator<<(const char* s) {
+  Write(s, strlen(s));
+  return *this;
+}
+
+void Writer::WriteInt(int32_t value) {
+  // 以无符号数处理, INT32_MIN 取负也不会溢出
+  uint32_t u = value < 0 ? 0u - uint32_t(value) : uint32_t(value);
+  char digits[11];
+  char* p = digits + sizeof(digits);
+  while (u >= 100) {
+    uint32_t pair = u % 100 * 2;
+    u /= 100;
+    *--p = kDigitPairs[pair + 1];
+    *--p = kDigitPairs[pair];
+  }
+  if (u >= 10) {
+    *--p = kDigitPairs[u * 2 + 1];
+    *--p = kDigitPairs[u * 2];
+  } else {
+    *--p = char('0' + u);
+  }
+  if (value < 0)
+    *--p = '-';
+  Write(p, digits + sizeof(digits) - p);
+}
+
+void Writer::Flush() {
+  if (fd < 0) {
+    text.append(buffer, size);
+    size = 0;
+    return;
+  }
+  const char* p = buffer;
+  while (size > 0) {
+    ssize_t n = write(fd, p, size);
+    assert(n > 0);
+    p += n;
+    size -= n;
+  }
+}
+
+string Writer::Take() {
+  Flush();
+  return std::move(text);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 分块输出缓冲区: 写满一块即写入文件描述符, 内存占用与输出规模无关
+// 不指定文件描述符时写入内存, 由 Take 取出, 用于分别生成各部分的输出后再按顺序拼接
+class Writer {
+ public:
+  explicit Writer(int fd) : fd(fd) {}
+  Writer() : fd(-1) {}
+  ~Writer() { Flush(); }
+
+  Writer(const Writer&) = delete;
+  Writer& operator=(const Writer&) = delete;
+
+  void Write(const char* s, size_t len);
+  // 十进制整数, 不经过 to_string
+  void WriteInt(int32_t value);
+  // 将缓冲区中的内容全部写出
+  void Flush();
+  // 取出写入内存的全部内容
+  std::string Take();
+
+  Writer& operator<<(char c) {
+    if (size == kChunkSize)
+      Flush();
+    buffer[size++] = c;
+    return *this;
+  }
+  Writer& operator<<(const char* s);
+  Writer& operator<<(const std::string& s) {
+    Write(s.data(), s.size());
+    return *this;
+  }
+  Writer& operator<<(int32_t value) {
+    WriteInt(value);
+    return *this;
+  }
+
+ private:
+  static constexpr size_t kChunkSize = 1 << 16;
+
+  int fd;
+  // 写入内存时的内容
+  std::string text;
+  size_t size = 0;
+  char buffer[kChunkSize];
+};
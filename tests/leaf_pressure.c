@@ -0,0 +1,27 @@
+// 不含调用的函数中同时存活的值很多时, 溢出槽与 callee-saved 寄存器的保存位置不能重叠
+int seed = 0;
+
+int leaf(int x) {
+  int a0 = x + 1; int a1 = x + 2; int a2 = x + 3; int a3 = x + 4; int a4 = x + 5;
+  int a5 = x + 6; int a6 = x + 7; int a7 = x + 8; int a8 = x + 9; int a9 = x + 10;
+  int b0 = x + 11; int b1 = x + 12; int b2 = x + 13; int b3 = x + 14; int b4 = x + 15;
+  int b5 = x + 16; int b6 = x + 17; int b7 = x + 18; int b8 = x + 19; int b9 = x + 20;
+  int c0 = x + 21; int c1 = x + 22; int c2 = x + 23; int c3 = x + 24; int c4 = x + 25;
+  int c5 = x + 26; int c6 = x + 27; int c7 = x + 28; int c8 = x + 29; int c9 = x + 30;
+  int d0 = x + 31;
+  return a0 * 1 + a1 * 2 + a2 * 3 + a3 * 4 + a4 * 5 + a5 * 6 + a6 * 7 + a7 * 8 + a8 * 9 + a9 * 10
+       + b0 * 11 + b1 * 12 + b2 * 13 + b3 * 14 + b4 * 15 + b5 * 16 + b6 * 17 + b7 * 18 + b8 * 19 + b9 * 20
+       + c0 * 21 + c1 * 22 + c2 * 23 + c3 * 24 + c4 * 25 + c5 * 26 + c6 * 27 + c7 * 28 + c8 * 29 + c9 * 30
+       + d0 * 31;
+}
+
+int main() {
+  // 以下各值跨越调用存活, 占用调用者的 callee-saved 寄存器
+  int v0 = seed; int v1 = v0 + 1; int v2 = v0 + 2; int v3 = v0 + 3; int v4 = v0 + 4; int v5 = v0 + 5;
+  int v6 = v0 + 6; int v7 = v0 + 7; int v8 = v0 + 8; int v9 = v0 + 9; int v10 = v0 + 10; int v11 = v0 + 11;
+  int r = leaf(v0);
+  int s = v0 + v1 + v2 + v3 + v4 + v5 + v6 + v7 + v8 + v9 + v10 + v11;
+  if (r != 10416 || s != 66)
+    return 1;
+  return 0;
+}
@@ -0,0 +1,76 @@
+#!/bin/bash
+# 回归测试, 用法: tests/run.sh <compiler>
+# tests/*.c 分别以 -O0, -O1, -O2 编译为 RISC-V 并在 qemu 中运行, main 返回 0 即通过
+# 运行需要实验环境中的 clang, ld.lld, qemu-riscv32-static 与 libsysy, 缺少时只检查能否编译
+
+COMPILER=$(realpath "$1")
+TEST_DIR=$(dirname "$(realpath "$0")")
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+CAN_RUN=1
+for tool in clang ld.lld qemu-riscv32-static; do
+  command -v $tool > /dev/null || CAN_RUN=0
+done
+[ -n "$CDE_LIBRARY_PATH" ] || CAN_RUN=0
+
+failed=0
+fail() {
+  echo "FAIL $*"
+  failed=1
+}
+
+# 运行编译得到的汇编, 返回 main 的返回值
+run() {
+  clang "$1" -c -o "$WORK_DIR/a.o" -target riscv32-unknown-linux-elf -march=rv32im -mabi=ilp32 &&
+    ld.lld "$WORK_DIR/a.o" -L"$CDE_LIBRARY_PATH/riscv32" -lsysy -o "$WORK_DIR/a.out" || return 255
+  qemu-riscv32-static "$WORK_DIR/a.out" > /dev/null
+}
+
+# 由 4000 个 && 与 || 组成的表达式, 生成 IR 的时间与 phi 数应与链长成线性关系
+gen_long_logic_chain() {
+  local n=4000 i
+  echo "int seed = 1;"
+  echo "int main() {"
+  echo "  int x = seed;"
+  echo "  int y = seed - 1;"
+  printf "  int a = x"
+  for ((i = 0; i < n; i++)); do printf " && x"; done
+  echo ";"
+  printf "  int b = y"
+  for ((i = 0; i < n; i++)); do printf " || y"; done
+  echo ";"
+  echo "  if (a != 1 || b != 0)"
+  echo "    return 1;"
+  echo "  return 0;"
+  echo "}"
+}
+gen_long_logic_chain > "$WORK_DIR/long_logic_chain.c"
+
+# 每次编译限时 (秒), 超时视为失败
+TIME_LIMIT=10
+
+# 以给出的各优化级别编译并运行一个程序
+check() {
+  local src=$1 name opt asm status
+  name=$(basename "$src" .c)
+  shift
+  for opt in "$@"; do
+    asm="$WORK_DIR/$name$opt.S"
+    timeout $TIME_LIMIT "$COMPILER" -riscv "$src" -o "$asm" $opt || { fail "$name $opt: compile error or timeout"; continue; }
+    [ $CAN_RUN = 1 ] || continue
+    run "$asm"
+    status=$?
+    [ $status = 0 ] || fail "$name $opt: exit code $status"
+  done
+}
+
+for src in "$TEST_DIR"/*.c; do
+  check "$src" -O0 -O1 -O2
+done
+# -O0 下每个运算符的结果都在栈上, 栈帧超出 addi 立即数的范围, 只检查 SSA 形式
+check "$WORK_DIR/long_logic_chain.c" -O1 -O2
+
+[ $CAN_RUN = 1 ] || echo "riscv32 toolchain not found, test programs were compiled but not run"
+[ $failed = 0 ] && echo "all tests passed"
+exit $failed